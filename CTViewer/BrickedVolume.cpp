@@ -0,0 +1,362 @@
+// BrickedVolume.cpp
+#include "pch.h"
+#include "BrickedVolume.h"
+#include "ParallelFor.h"
+#include "VolumeStatistics.h"
+#include <emmintrin.h>
+#include <chrono>
+#include <cstring>
+
+BrickedVolume::BrickedVolume()
+    : m_width(0), m_height(0), m_depth(0), m_bricksX(0), m_bricksY(0), m_bricksZ(0),
+    m_minValue(0), m_maxValue(0)
+{
+}
+
+bool BrickedVolume::Build(const unsigned char* data, int width, int height, int depth,
+    VolumeStatistics* statistics)
+{
+    Clear();
+    if (!data || width <= 0 || height <= 0 || depth <= 0) {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_depth = depth;
+    m_bricksX = (width + BRICK_SIZE - 1) >> BRICK_SHIFT;
+    m_bricksY = (height + BRICK_SIZE - 1) >> BRICK_SHIFT;
+    m_bricksZ = (depth + BRICK_SIZE - 1) >> BRICK_SHIFT;
+
+    const size_t brickRowStride = static_cast<size_t>(m_bricksX) * BRICK_VOXELS;
+    const size_t brickSliceStride = brickRowStride * m_bricksY;
+
+    m_offsetX.resize(width + 1);
+    m_offsetY.resize(height + 1);
+    m_offsetZ.resize(depth + 1);
+    for (int x = 0; x < width; x++) {
+        m_offsetX[x] = static_cast<size_t>(x >> BRICK_SHIFT) * BRICK_VOXELS + (x & (BRICK_SIZE - 1));
+    }
+    for (int y = 0; y < height; y++) {
+        m_offsetY[y] = (y >> BRICK_SHIFT) * brickRowStride + (y & (BRICK_SIZE - 1)) * BRICK_SIZE;
+    }
+    for (int z = 0; z < depth; z++) {
+        m_offsetZ[z] = (z >> BRICK_SHIFT) * brickSliceStride + (z & (BRICK_SIZE - 1)) * BRICK_SIZE * BRICK_SIZE;
+    }
+    m_offsetX[width] = m_offsetX[width - 1];
+    m_offsetY[height] = m_offsetY[height - 1];
+    m_offsetZ[depth] = m_offsetZ[depth - 1];
+
+    m_data.assign(brickSliceStride * m_bricksZ, 0);
+
+    // Each source row splits into 8-byte runs, one per brick it crosses
+    const size_t sliceSize = static_cast<size_t>(width) * height;
+    if (statistics) {
+        statistics->Reset(depth);
+    }
+    ParallelForRange(0, depth, [&](int, int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            for (int y = 0; y < height; y++) {
+                const unsigned char* src = data + sliceSize * z + static_cast<size_t>(width) * y;
+                unsigned char* dst = m_data.data() + m_offsetY[y] + m_offsetZ[z];
+                for (int x = 0; x < width; x += BRICK_SIZE) {
+                    memcpy(dst + m_offsetX[x], src + x, min(BRICK_SIZE, width - x));
+                }
+                if (statistics) {
+                    statistics->CountRow(z, src, width);
+                }
+            }
+        }
+    });
+    if (statistics) {
+        statistics->Finish();
+    }
+
+    BuildBrickRanges();
+    return true;
+}
+
+void BrickedVolume::BuildBrickRanges()
+{
+    const size_t brickCount = static_cast<size_t>(m_bricksX) * m_bricksY * m_bricksZ;
+    std::vector<unsigned char> ownMin(brickCount);
+    std::vector<unsigned char> ownMax(brickCount);
+
+    // Range of each brick's own voxels; bricks cut by the volume edge are
+    // scanned voxel by voxel so their zero padding does not count
+    ParallelForRange(0, m_bricksZ, [&](int, int bzBegin, int bzEnd) {
+        for (int bz = bzBegin; bz < bzEnd; bz++) {
+            for (int by = 0; by < m_bricksY; by++) {
+                for (int bx = 0; bx < m_bricksX; bx++) {
+                    size_t brick = BrickIndex(bx, by, bz);
+                    int x0 = bx << BRICK_SHIFT, y0 = by << BRICK_SHIFT, z0 = bz << BRICK_SHIFT;
+                    bool full = x0 + BRICK_SIZE <= m_width && y0 + BRICK_SIZE <= m_height && z0 + BRICK_SIZE <= m_depth;
+                    unsigned char mn = 255, mx = 0;
+
+                    if (full) {
+                        const unsigned char* p = Brick(bx, by, bz);
+                        __m128i lo = _mm_set1_epi8(static_cast<char>(0xFF));
+                        __m128i hi = _mm_setzero_si128();
+                        for (int i = 0; i < BRICK_VOXELS; i += 16) {
+                            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+                            lo = _mm_min_epu8(lo, v);
+                            hi = _mm_max_epu8(hi, v);
+                        }
+                        unsigned char loBytes[16], hiBytes[16];
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(loBytes), lo);
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(hiBytes), hi);
+                        for (int i = 0; i < 16; i++) {
+                            mn = min(mn, loBytes[i]);
+                            mx = max(mx, hiBytes[i]);
+                        }
+                    }
+                    else {
+                        for (int z = z0; z < min(z0 + BRICK_SIZE, m_depth); z++) {
+                            for (int y = y0; y < min(y0 + BRICK_SIZE, m_height); y++) {
+                                for (int x = x0; x < min(x0 + BRICK_SIZE, m_width); x++) {
+                                    unsigned char v = At(x, y, z);
+                                    mn = min(mn, v);
+                                    mx = max(mx, v);
+                                }
+                            }
+                        }
+                    }
+
+                    ownMin[brick] = mn;
+                    ownMax[brick] = mx;
+                }
+            }
+        }
+    });
+
+    // The apron voxels belong to the 26 neighbours, so widening each range by
+    // the neighbours' ranges bounds the apron conservatively
+    m_rangeMin[0].resize(brickCount);
+    m_rangeMax[0].resize(brickCount);
+    ParallelForRange(0, m_bricksZ, [&](int, int bzBegin, int bzEnd) {
+        for (int bz = bzBegin; bz < bzEnd; bz++) {
+            for (int by = 0; by < m_bricksY; by++) {
+                for (int bx = 0; bx < m_bricksX; bx++) {
+                    unsigned char mn = 255, mx = 0;
+                    for (int nz = max(0, bz - 1); nz <= min(m_bricksZ - 1, bz + 1); nz++) {
+                        for (int ny = max(0, by - 1); ny <= min(m_bricksY - 1, by + 1); ny++) {
+                            for (int nx = max(0, bx - 1); nx <= min(m_bricksX - 1, bx + 1); nx++) {
+                                size_t neighbour = BrickIndex(nx, ny, nz);
+                                mn = min(mn, ownMin[neighbour]);
+                                mx = max(mx, ownMax[neighbour]);
+                            }
+                        }
+                    }
+                    size_t brick = BrickIndex(bx, by, bz);
+                    m_rangeMin[0][brick] = mn;
+                    m_rangeMax[0][brick] = mx;
+                }
+            }
+        }
+    });
+
+    m_minValue = 255;
+    m_maxValue = 0;
+    for (size_t i = 0; i < brickCount; i++) {
+        m_minValue = min(m_minValue, ownMin[i]);
+        m_maxValue = max(m_maxValue, ownMax[i]);
+    }
+
+    BuildRangeHierarchy();
+}
+
+void BrickedVolume::BuildRangeHierarchy()
+{
+    // Each node merges the 2x2x2 children of the level below; children past
+    // the edge of an odd-sized level simply do not exist
+    for (int level = 1; level < RANGE_LEVELS; level++) {
+        int nodesX = NodesX(level), nodesY = NodesY(level), nodesZ = NodesZ(level);
+        int childX = NodesX(level - 1), childY = NodesY(level - 1), childZ = NodesZ(level - 1);
+        const std::vector<unsigned char>& childMin = m_rangeMin[level - 1];
+        const std::vector<unsigned char>& childMax = m_rangeMax[level - 1];
+        std::vector<unsigned char>& nodeMin = m_rangeMin[level];
+        std::vector<unsigned char>& nodeMax = m_rangeMax[level];
+        nodeMin.resize(static_cast<size_t>(nodesX) * nodesY * nodesZ);
+        nodeMax.resize(nodeMin.size());
+
+        for (int nz = 0; nz < nodesZ; nz++) {
+            for (int ny = 0; ny < nodesY; ny++) {
+                for (int nx = 0; nx < nodesX; nx++) {
+                    unsigned char mn = 255, mx = 0;
+                    for (int cz = nz * 2; cz < min(nz * 2 + 2, childZ); cz++) {
+                        for (int cy = ny * 2; cy < min(ny * 2 + 2, childY); cy++) {
+                            for (int cx = nx * 2; cx < min(nx * 2 + 2, childX); cx++) {
+                                size_t child = NodeIndex(level - 1, cx, cy, cz);
+                                mn = min(mn, childMin[child]);
+                                mx = max(mx, childMax[child]);
+                            }
+                        }
+                    }
+                    size_t node = NodeIndex(level, nx, ny, nz);
+                    nodeMin[node] = mn;
+                    nodeMax[node] = mx;
+                }
+            }
+        }
+    }
+}
+
+void BrickedVolume::Clear()
+{
+    m_width = m_height = m_depth = 0;
+    m_bricksX = m_bricksY = m_bricksZ = 0;
+    m_minValue = m_maxValue = 0;
+    std::vector<unsigned char>().swap(m_data);
+    for (int level = 0; level < RANGE_LEVELS; level++) {
+        m_rangeMin[level].clear();
+        m_rangeMax[level].clear();
+    }
+    m_offsetX.clear();
+    m_offsetY.clear();
+    m_offsetZ.clear();
+}
+
+unsigned char BrickedVolume::AtClamped(int x, int y, int z) const
+{
+    x = max(0, min(m_width - 1, x));
+    y = max(0, min(m_height - 1, y));
+    z = max(0, min(m_depth - 1, z));
+    return At(x, y, z);
+}
+
+float BrickedVolume::SampleLinear(float x, float y, float z) const
+{
+    x = max(0.0f, min(static_cast<float>(m_width - 1), x));
+    y = max(0.0f, min(static_cast<float>(m_height - 1), y));
+    z = max(0.0f, min(static_cast<float>(m_depth - 1), z));
+
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int z0 = static_cast<int>(z);
+    float fx = x - x0;
+    float fy = y - y0;
+    float fz = z - z0;
+
+    const unsigned char* base = m_data.data();
+    size_t ox0 = m_offsetX[x0], ox1 = m_offsetX[x0 + 1];
+    size_t oy0 = m_offsetY[y0], oy1 = m_offsetY[y0 + 1];
+    size_t oz0 = m_offsetZ[z0], oz1 = m_offsetZ[z0 + 1];
+
+    float c00 = base[ox0 + oy0 + oz0] + fx * (base[ox1 + oy0 + oz0] - base[ox0 + oy0 + oz0]);
+    float c10 = base[ox0 + oy1 + oz0] + fx * (base[ox1 + oy1 + oz0] - base[ox0 + oy1 + oz0]);
+    float c01 = base[ox0 + oy0 + oz1] + fx * (base[ox1 + oy0 + oz1] - base[ox0 + oy0 + oz1]);
+    float c11 = base[ox0 + oy1 + oz1] + fx * (base[ox1 + oy1 + oz1] - base[ox0 + oy1 + oz1]);
+    float c0 = c00 + fy * (c10 - c00);
+    float c1 = c01 + fy * (c11 - c01);
+    return c0 + fz * (c1 - c0);
+}
+
+void BrickedVolume::Gradient(int x, int y, int z, float* gradient) const
+{
+    gradient[0] = 0.5f * (AtClamped(x + 1, y, z) - AtClamped(x - 1, y, z));
+    gradient[1] = 0.5f * (AtClamped(x, y + 1, z) - AtClamped(x, y - 1, z));
+    gradient[2] = 0.5f * (AtClamped(x, y, z + 1) - AtClamped(x, y, z - 1));
+}
+
+const unsigned char* BrickedVolume::Brick(int bx, int by, int bz) const
+{
+    return m_data.data() + m_offsetX[bx << BRICK_SHIFT] + m_offsetY[by << BRICK_SHIFT] + m_offsetZ[bz << BRICK_SHIFT];
+}
+
+void BrickedVolume::CopyToLinear(unsigned char* out) const
+{
+    const size_t sliceSize = static_cast<size_t>(m_width) * m_height;
+    ParallelForRange(0, m_depth, [&](int, int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            for (int y = 0; y < m_height; y++) {
+                unsigned char* dst = out + sliceSize * z + static_cast<size_t>(m_width) * y;
+                const unsigned char* src = m_data.data() + m_offsetY[y] + m_offsetZ[z];
+                for (int x = 0; x < m_width; x += BRICK_SIZE) {
+                    memcpy(dst + x, src + m_offsetX[x], min(BRICK_SIZE, m_width - x));
+                }
+            }
+        }
+    });
+}
+
+// Trilinear sample from a z-major array, for comparison with the bricked path
+static float SampleLinearZMajor(const unsigned char* data, int width, int height, int depth,
+    float x, float y, float z)
+{
+    x = max(0.0f, min(static_cast<float>(width - 1), x));
+    y = max(0.0f, min(static_cast<float>(height - 1), y));
+    z = max(0.0f, min(static_cast<float>(depth - 1), z));
+
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int z0 = static_cast<int>(z);
+    float fx = x - x0;
+    float fy = y - y0;
+    float fz = z - z0;
+
+    size_t sx = x0 + 1 < width ? 1 : 0;
+    size_t sy = y0 + 1 < height ? width : 0;
+    size_t sz = z0 + 1 < depth ? static_cast<size_t>(width) * height : 0;
+    const unsigned char* p = data + (static_cast<size_t>(z0) * height + y0) * width + x0;
+
+    float c00 = p[0] + fx * (p[sx] - p[0]);
+    float c10 = p[sy] + fx * (p[sy + sx] - p[sy]);
+    float c01 = p[sz] + fx * (p[sz + sx] - p[sz]);
+    float c11 = p[sz + sy] + fx * (p[sz + sy + sx] - p[sz + sy]);
+    float c0 = c00 + fy * (c10 - c00);
+    float c1 = c01 + fy * (c11 - c01);
+    return c0 + fz * (c1 - c0);
+}
+
+// Marches lines parallel to one axis, in raster order over the other two,
+// the way neighbouring pixels of an axis-aligned view would.
+template <typename Sampler>
+static double MeasureAxisThroughput(int axis, int width, int height, int depth, Sampler sample)
+{
+    const long long targetSamples = 1 << 24;
+    const int dims[3] = { width, height, depth };
+    const int u = (axis + 1) % 3;
+    const int v = (axis + 2) % 3;
+
+    long long samples = 0;
+    float sink = 0.0f;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int j = 0; j < dims[v] && samples < targetSamples; j++) {
+        for (int i = 0; i < dims[u] && samples < targetSamples; i++) {
+            float p[3];
+            p[u] = i + 0.5f;
+            p[v] = j + 0.5f;
+            for (int k = 0; k < dims[axis]; k++) {
+                p[axis] = k + 0.25f;
+                sink += sample(p[0], p[1], p[2]);
+            }
+            samples += dims[axis];
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    volatile float keep = sink;
+    (void)keep;
+    return seconds > 0.0 ? samples / seconds : 0.0;
+}
+
+void MeasureLayoutThroughput(const BrickedVolume& volume, double* samplesPerSecond)
+{
+    const int width = volume.Width();
+    const int height = volume.Height();
+    const int depth = volume.Depth();
+
+    std::vector<unsigned char> linear(static_cast<size_t>(width) * height * depth);
+    volume.CopyToLinear(linear.data());
+    const unsigned char* data = linear.data();
+
+    for (int axis = 0; axis < 3; axis++) {
+        samplesPerSecond[axis] = MeasureAxisThroughput(axis, width, height, depth,
+            [&](float x, float y, float z) { return SampleLinearZMajor(data, width, height, depth, x, y, z); });
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        samplesPerSecond[3 + axis] = MeasureAxisThroughput(axis, width, height, depth,
+            [&](float x, float y, float z) { return volume.SampleLinear(x, y, z); });
+    }
+}
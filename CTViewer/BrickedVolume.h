@@ -0,0 +1,121 @@
+// BrickedVolume.h
+#pragma once
+
+#include <vector>
+
+class VolumeStatistics;
+
+// CPU copy of an 8-bit volume stored as 8x8x8 bricks of 512 bytes, so that
+// neighbouring voxels along any axis share cache lines. Voxel addresses are
+// the sum of three per-axis offset tables, which keeps lookups as cheap as
+// the z-major layout. Coordinates are voxel indices with sample centres on
+// integers.
+//
+// Each brick also stores the value range of its voxels plus a one-voxel
+// apron, so a trilinear sample taken anywhere inside the brick is bounded
+// by it. Kernels use the ranges to skip bricks that cannot change a result.
+// The ranges are merged into a min-max hierarchy whose level L nodes cover
+// 2^L bricks per axis, so long empty stretches can be skipped in one step.
+class BrickedVolume
+{
+public:
+    static const int BRICK_SHIFT = 3;
+    static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+    static const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+    static const int RANGE_LEVELS = 5;
+
+    BrickedVolume();
+
+    // Converts a z-major array (pitch = width, slice pitch = width * height);
+    // statistics, when given, are counted from the rows as they are copied
+    bool Build(const unsigned char* data, int width, int height, int depth,
+        VolumeStatistics* statistics = nullptr);
+    void Clear();
+
+    bool IsEmpty() const { return m_data.empty(); }
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    int Depth() const { return m_depth; }
+    int BricksX() const { return m_bricksX; }
+    int BricksY() const { return m_bricksY; }
+    int BricksZ() const { return m_bricksZ; }
+    size_t MemoryUsage() const { return m_data.size(); }
+
+    // Global value range
+    unsigned char MinValue() const { return m_minValue; }
+    unsigned char MaxValue() const { return m_maxValue; }
+
+    // Value range of a brick including its apron
+    size_t BrickIndex(int bx, int by, int bz) const
+    {
+        return (static_cast<size_t>(bz) * m_bricksY + by) * m_bricksX + bx;
+    }
+    unsigned char BrickMin(size_t brick) const { return m_rangeMin[0][brick]; }
+    unsigned char BrickMax(size_t brick) const { return m_rangeMax[0][brick]; }
+
+    // Min-max hierarchy; level 0 nodes are the bricks
+    int NodesX(int level) const { return (m_bricksX + (1 << level) - 1) >> level; }
+    int NodesY(int level) const { return (m_bricksY + (1 << level) - 1) >> level; }
+    int NodesZ(int level) const { return (m_bricksZ + (1 << level) - 1) >> level; }
+    size_t NodeIndex(int level, int nx, int ny, int nz) const
+    {
+        return (static_cast<size_t>(nz) * NodesY(level) + ny) * NodesX(level) + nx;
+    }
+    unsigned char NodeMin(int level, size_t node) const { return m_rangeMin[level][node]; }
+    unsigned char NodeMax(int level, size_t node) const { return m_rangeMax[level][node]; }
+
+    // Unchecked voxel fetch; x, y, z must lie inside the volume
+    unsigned char At(int x, int y, int z) const
+    {
+        return m_data[m_offsetX[x] + m_offsetY[y] + m_offsetZ[z]];
+    }
+
+    unsigned char AtClamped(int x, int y, int z) const;
+
+    // Raw storage and per-axis offset tables for kernels that gather many
+    // voxels per sample; entry Width() (Height(), Depth()) repeats the edge
+    const unsigned char* Data() const { return m_data.data(); }
+    const size_t* OffsetsX() const { return m_offsetX.data(); }
+    const size_t* OffsetsY() const { return m_offsetY.data(); }
+    const size_t* OffsetsZ() const { return m_offsetZ.data(); }
+
+    // Trilinear sample in voxel space, clamped to the edge like the D3D sampler
+    float SampleLinear(float x, float y, float z) const;
+
+    // Central-difference gradient in voxel units
+    void Gradient(int x, int y, int z, float* gradient) const;
+
+    // Start of the 512-byte brick (voxel order x fastest, then y, then z)
+    const unsigned char* Brick(int bx, int by, int bz) const;
+
+    // Writes the volume back out in z-major order
+    void CopyToLinear(unsigned char* out) const;
+
+private:
+    int m_width;
+    int m_height;
+    int m_depth;
+    int m_bricksX;
+    int m_bricksY;
+    int m_bricksZ;
+    std::vector<unsigned char> m_data;
+
+    unsigned char m_minValue;
+    unsigned char m_maxValue;
+    std::vector<unsigned char> m_rangeMin[RANGE_LEVELS];
+    std::vector<unsigned char> m_rangeMax[RANGE_LEVELS];
+
+    void BuildBrickRanges();
+    void BuildRangeHierarchy();
+
+    // One entry past the last voxel repeats the edge so x0 + 1 is always valid
+    std::vector<size_t> m_offsetX;
+    std::vector<size_t> m_offsetY;
+    std::vector<size_t> m_offsetZ;
+};
+
+// Trilinear throughput along lines parallel to X, Y and Z, first through a
+// z-major copy and then through the bricked layout. Fills six samples/second
+// values: linear X, Y, Z then bricked X, Y, Z. The z-major copy lives only
+// for the measurement.
+void MeasureLayoutThroughput(const BrickedVolume& volume, double* samplesPerSecond);
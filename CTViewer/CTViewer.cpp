@@ -76,6 +76,37 @@ CTVIEWER_API bool Initialize(void* hwnd, int width, int height) {
     }
 }
 
+// Initialize a renderer without a window for CPU-only use
+CTVIEWER_API bool InitializeHeadless(int width, int height) {
+    try {
+        Log("InitializeHeadless called", LOG_INFO);
+
+        if (width <= 0 || height <= 0) {
+            std::string msg = "Failed to initialize: Invalid dimensions: " + std::to_string(width) + "x" + std::to_string(height);
+            Log(msg.c_str(), LOG_ERROR);
+            return false;
+        }
+
+        g_renderer = std::make_unique<VolumeRenderer>();
+        bool result = g_renderer->InitializeHeadless(width, height);
+
+        if (!result) {
+            Log("Headless renderer initialization failed", LOG_ERROR);
+        }
+
+        return result;
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception during headless initialization: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception during headless initialization", LOG_ERROR);
+        return false;
+    }
+}
+
 // Shutdown the renderer
 CTVIEWER_API void Shutdown() {
     try {
@@ -354,3 +385,1113 @@ CTVIEWER_API void SetRenderingParams(float opacity, float brightness, float cont
         Log("Unknown exception while setting rendering params", LOG_ERROR);
     }
 }
+
+// Configure automatic air cropping
+CTVIEWER_API void SetAutoCrop(bool enable, int threshold, bool circularMask) {
+    try {
+        if (!g_renderer) {
+            Log("SetAutoCrop called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = "Setting auto crop: enable=" + std::to_string(enable) +
+            ", threshold=" + std::to_string(threshold) +
+            ", circularMask=" + std::to_string(circularMask);
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetAutoCrop(enable, threshold, circularMask);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting auto crop: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting auto crop", LOG_ERROR);
+    }
+}
+
+// Get the content bounds found at load
+CTVIEWER_API bool GetContentBounds(int* bounds) {
+    try {
+        if (!g_renderer) {
+            Log("GetContentBounds called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!bounds) {
+            Log("Failed to get content bounds: Bounds pointer is null", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->GetContentBounds(bounds);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting content bounds: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while getting content bounds", LOG_ERROR);
+        return false;
+    }
+}
+
+// Set the frame-time target for dynamic resolution
+CTVIEWER_API void SetTargetFrameTime(float milliseconds, bool edgeAware) {
+    try {
+        if (!g_renderer) {
+            Log("SetTargetFrameTime called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = milliseconds > 0.0f
+            ? "Setting target frame time: " + std::to_string(milliseconds) + " ms" + (edgeAware ? ", edge-aware upscale" : ", bilinear upscale")
+            : std::string("Disabling dynamic resolution");
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetTargetFrameTime(milliseconds, edgeAware);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting target frame time: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting target frame time", LOG_ERROR);
+    }
+}
+
+// Set the clip planes applied to every ray
+CTVIEWER_API int SetClipPlanes(const float* planes, int count) {
+    try {
+        if (!g_renderer) {
+            Log("SetClipPlanes called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        std::string msg = "Setting clip planes: " + std::to_string(planes ? count : 0);
+        Log(msg.c_str(), LOG_INFO);
+
+        return g_renderer->SetClipPlanes(planes, count);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting clip planes: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while setting clip planes", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Restrict rendering to a voxel box
+CTVIEWER_API bool SetRegionOfInterest(const int* box) {
+    try {
+        if (!g_renderer) {
+            Log("SetRegionOfInterest called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (box) {
+            std::string msg = "Setting region of interest: x " + std::to_string(box[0]) + "-" + std::to_string(box[3]) +
+                ", y " + std::to_string(box[1]) + "-" + std::to_string(box[4]) +
+                ", z " + std::to_string(box[2]) + "-" + std::to_string(box[5]);
+            Log(msg.c_str(), LOG_INFO);
+        }
+        else {
+            Log("Clearing region of interest", LOG_INFO);
+        }
+
+        return g_renderer->SetRegionOfInterest(box);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting region of interest: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while setting region of interest", LOG_ERROR);
+        return false;
+    }
+}
+
+// Measure CPU sampling throughput per axis
+CTVIEWER_API bool BenchmarkVolumeLayout(double* samplesPerSecond) {
+    try {
+        if (!g_renderer) {
+            Log("BenchmarkVolumeLayout called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!samplesPerSecond) {
+            Log("Failed to benchmark volume layout: Results pointer is null", LOG_ERROR);
+            return false;
+        }
+
+        Log("Running volume layout benchmark", LOG_INFO);
+        return g_renderer->BenchmarkVolumeLayout(samplesPerSecond);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception during volume layout benchmark: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception during volume layout benchmark", LOG_ERROR);
+        return false;
+    }
+}
+
+// Select the density reconstruction filter
+CTVIEWER_API void SetSampleFilter(int filter) {
+    try {
+        if (!g_renderer) {
+            Log("SetSampleFilter called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = "Setting sample filter: " + std::to_string(filter);
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetSampleFilter(filter);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting sample filter: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting sample filter", LOG_ERROR);
+    }
+}
+
+// Set the density of the surface drawn by the isosurface mode
+CTVIEWER_API void SetIsoValue(float isoValue) {
+    try {
+        if (!g_renderer) {
+            Log("SetIsoValue called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = "Setting isovalue: " + std::to_string(isoValue);
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetIsoValue(isoValue);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting isovalue: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting isovalue", LOG_ERROR);
+    }
+}
+
+// Classify densities through a lookup table instead of the window
+CTVIEWER_API bool SetTransferFunction(const float* rgba, int entries) {
+    try {
+        if (!g_renderer) {
+            Log("SetTransferFunction called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (rgba && entries > 0) {
+            std::string msg = "Setting transfer function: " + std::to_string(entries) + " entries";
+            Log(msg.c_str(), LOG_INFO);
+        }
+        else {
+            Log("Clearing transfer function", LOG_INFO);
+        }
+
+        return g_renderer->SetTransferFunction(rgba, entries);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting transfer function: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while setting transfer function", LOG_ERROR);
+        return false;
+    }
+}
+
+// Classify by density and gradient magnitude
+CTVIEWER_API bool SetTransferFunction2D(const float* rgba, int densityEntries, int magnitudeEntries) {
+    try {
+        if (!g_renderer) {
+            Log("SetTransferFunction2D called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (rgba && densityEntries > 0 && magnitudeEntries > 0) {
+            std::string msg = "Setting 2D transfer function: " + std::to_string(densityEntries) + " x " +
+                std::to_string(magnitudeEntries) + " entries";
+            Log(msg.c_str(), LOG_INFO);
+        }
+        else {
+            Log("Clearing 2D transfer function", LOG_INFO);
+        }
+
+        return g_renderer->SetTransferFunction2D(rgba, densityEntries, magnitudeEntries);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting 2D transfer function: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while setting 2D transfer function", LOG_ERROR);
+        return false;
+    }
+}
+
+// Copy the density x gradient-magnitude histogram for the editor
+CTVIEWER_API int GetJointHistogram(unsigned int* counts, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetJointHistogram called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!counts || capacity <= 0) {
+            Log("Failed to get joint histogram: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetJointHistogram(counts, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting joint histogram: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting joint histogram", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Set the ray sample distance and pre-integration
+CTVIEWER_API void SetSampling(float stepScale, bool preIntegrated) {
+    try {
+        if (!g_renderer) {
+            Log("SetSampling called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = "Setting sampling: step scale " + std::to_string(stepScale) +
+            (preIntegrated ? ", pre-integrated" : ", point-sampled");
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetSampling(stepScale, preIntegrated);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting sampling: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting sampling", LOG_ERROR);
+    }
+}
+
+// Enable or disable the precomputed gradient volume
+CTVIEWER_API bool SetGradientVolume(bool enable) {
+    try {
+        if (!g_renderer) {
+            Log("SetGradientVolume called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        std::string msg = std::string("Setting gradient volume: ") + (enable ? "enabled" : "disabled");
+        Log(msg.c_str(), LOG_INFO);
+
+        return g_renderer->SetGradientVolume(enable);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting gradient volume: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while setting gradient volume", LOG_ERROR);
+        return false;
+    }
+}
+
+// Set the gradient-based shading flags
+CTVIEWER_API void SetShading(int flags) {
+    try {
+        if (!g_renderer) {
+            Log("SetShading called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = "Setting shading flags: " + std::to_string(flags);
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetShading(flags);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting shading: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting shading", LOG_ERROR);
+    }
+}
+
+// Render the current view on the CPU
+CTVIEWER_API bool RenderCpu(unsigned char* rgba, int width, int height) {
+    try {
+        if (!g_renderer) {
+            Log("RenderCpu called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!rgba) {
+            Log("Failed to render on CPU: Output pointer is null", LOG_ERROR);
+            return false;
+        }
+
+        if (width <= 0 || height <= 0) {
+            Log("Failed to render on CPU: Invalid dimensions", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->RenderCpu(rgba, width, height);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception during CPU render: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception during CPU render", LOG_ERROR);
+        return false;
+    }
+}
+
+// Time every CPU kernel variant
+CTVIEWER_API int BenchmarkRenderKernels(int width, int height, double* msPerFrame, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("BenchmarkRenderKernels called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!msPerFrame || capacity <= 0) {
+            Log("Failed to benchmark render kernels: Invalid results buffer", LOG_ERROR);
+            return 0;
+        }
+
+        if (width <= 0 || height <= 0) {
+            Log("Failed to benchmark render kernels: Invalid dimensions", LOG_ERROR);
+            return 0;
+        }
+
+        Log("Running render kernel benchmark", LOG_INFO);
+        return g_renderer->BenchmarkRenderKernels(width, height, msPerFrame, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception during render kernel benchmark: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception during render kernel benchmark", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Compare pre-integrated and point-sampled renders against a fine-step reference
+CTVIEWER_API int ValidatePreIntegration(int width, int height, double* rmse) {
+    try {
+        if (!g_renderer) {
+            Log("ValidatePreIntegration called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!rmse) {
+            Log("Failed to validate pre-integration: Output pointer is null", LOG_ERROR);
+            return 0;
+        }
+
+        if (width <= 0 || height <= 0) {
+            Log("Failed to validate pre-integration: Invalid dimensions", LOG_ERROR);
+            return 0;
+        }
+
+        Log("Validating pre-integration", LOG_INFO);
+        return g_renderer->ValidatePreIntegration(width, height, rmse);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception during pre-integration validation: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception during pre-integration validation", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Enable or disable temporal reprojection of CPU frames
+CTVIEWER_API void SetTemporalReprojection(bool enable) {
+    try {
+        if (!g_renderer) {
+            Log("SetTemporalReprojection called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = std::string("Setting temporal reprojection: ") + (enable ? "enabled" : "disabled");
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetTemporalReprojection(enable);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting temporal reprojection: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting temporal reprojection", LOG_ERROR);
+    }
+}
+
+// Compare reprojected and full CPU frames over a camera orbit
+CTVIEWER_API int BenchmarkReprojection(int width, int height, int frames, float degreesPerFrame, double* results) {
+    try {
+        if (!g_renderer) {
+            Log("BenchmarkReprojection called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!results) {
+            Log("Failed to benchmark reprojection: Output pointer is null", LOG_ERROR);
+            return 0;
+        }
+
+        if (width <= 0 || height <= 0 || frames <= 0) {
+            Log("Failed to benchmark reprojection: Invalid dimensions or frame count", LOG_ERROR);
+            return 0;
+        }
+
+        Log("Running reprojection benchmark", LOG_INFO);
+        return g_renderer->BenchmarkReprojection(width, height, frames, degreesPerFrame, results);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception during reprojection benchmark: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception during reprojection benchmark", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Enable or disable the deep-pixel cache for material edits
+CTVIEWER_API void SetRecolorCache(bool enable) {
+    try {
+        if (!g_renderer) {
+            Log("SetRecolorCache called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = std::string("Setting recolor cache: ") + (enable ? "enabled" : "disabled");
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetRecolorCache(enable);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting recolor cache: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting recolor cache", LOG_ERROR);
+    }
+}
+
+// Toggle the ray-cost heat map for CPU renders
+CTVIEWER_API void SetCostView(bool enable) {
+    try {
+        if (!g_renderer) {
+            Log("SetCostView called but renderer is not initialized", LOG_ERROR);
+            return;
+        }
+
+        std::string msg = std::string("Setting cost view: ") + (enable ? "enabled" : "disabled");
+        Log(msg.c_str(), LOG_INFO);
+
+        g_renderer->SetCostView(enable);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while setting cost view: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+    }
+    catch (...) {
+        Log("Unknown exception while setting cost view", LOG_ERROR);
+    }
+}
+
+// Per-pixel ray cost of the current view
+CTVIEWER_API bool RenderCostMap(unsigned char* rgba, int* counts, int width, int height) {
+    try {
+        if (!g_renderer) {
+            Log("RenderCostMap called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!rgba && !counts) {
+            Log("Failed to render cost map: No output buffer", LOG_ERROR);
+            return false;
+        }
+
+        if (width <= 0 || height <= 0) {
+            Log("Failed to render cost map: Invalid dimensions", LOG_ERROR);
+            return false;
+        }
+
+        Log("Rendering cost map", LOG_INFO);
+        return g_renderer->RenderCostMap(rgba, counts, width, height);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while rendering cost map: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while rendering cost map", LOG_ERROR);
+        return false;
+    }
+}
+
+// Render a sequence of camera poses headlessly, delivering frames in order
+CTVIEWER_API int RenderCameraPath(const float* poses, int count, int width, int height, FrameCallback callback) {
+    try {
+        if (!g_renderer) {
+            Log("RenderCameraPath called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!poses || !callback || count <= 0) {
+            Log("Failed to render camera path: Invalid poses or callback", LOG_ERROR);
+            return 0;
+        }
+
+        if (width <= 0 || height <= 0) {
+            Log("Failed to render camera path: Invalid dimensions", LOG_ERROR);
+            return 0;
+        }
+
+        std::string msg = "Rendering camera path: " + std::to_string(count) + " frames at " +
+            std::to_string(width) + "x" + std::to_string(height);
+        Log(msg.c_str(), LOG_INFO);
+
+        return g_renderer->RenderCameraPath(poses, count, width, height,
+            [&](int frame, const unsigned char* rgba) { callback(frame, rgba, width, height); });
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while rendering camera path: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while rendering camera path", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Reslice the loaded volume along an arbitrary plane
+CTVIEWER_API bool ExtractSlice(const float* origin, const float* u, const float* v, int width, int height,
+    int interpolation, unsigned char* out) {
+    try {
+        if (!g_renderer) {
+            Log("ExtractSlice called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!origin || !u || !v || !out) {
+            Log("Failed to extract slice: Null plane or output pointer", LOG_ERROR);
+            return false;
+        }
+
+        if (width <= 0 || height <= 0) {
+            Log("Failed to extract slice: Invalid dimensions", LOG_ERROR);
+            return false;
+        }
+
+        if (interpolation < SLICE_NEAREST || interpolation > SLICE_CUBIC) {
+            Log("Failed to extract slice: Invalid interpolation", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->ExtractSlice(origin, u, v, width, height, interpolation, out);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while extracting slice: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while extracting slice", LOG_ERROR);
+        return false;
+    }
+}
+
+// Size of an orthogonal slice at a level of detail
+CTVIEWER_API bool GetAxisSliceSize(int axis, int lod, int* width, int* height) {
+    try {
+        if (!g_renderer) {
+            Log("GetAxisSliceSize called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!width || !height) {
+            Log("Failed to get axis slice size: Output pointer is null", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->GetAxisSliceSize(axis, lod, width, height);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting axis slice size: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while getting axis slice size", LOG_ERROR);
+        return false;
+    }
+}
+
+// Extract an orthogonal slice through the slice cache
+CTVIEWER_API bool ExtractAxisSlice(int axis, int index, int lod, unsigned char* out) {
+    try {
+        if (!g_renderer) {
+            Log("ExtractAxisSlice called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!out) {
+            Log("Failed to extract axis slice: Output pointer is null", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->ExtractAxisSlice(axis, index, lod, out);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while extracting axis slice: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while extracting axis slice", LOG_ERROR);
+        return false;
+    }
+}
+
+// Thick-slab projection along an arbitrary direction
+CTVIEWER_API bool ProjectSlab(const float* origin, const float* u, const float* v, const float* w,
+    int thickness, int width, int height, int interpolation, int mode, unsigned char* out) {
+    try {
+        if (!g_renderer) {
+            Log("ProjectSlab called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!origin || !u || !v || !w || !out) {
+            Log("Failed to project slab: Null plane or output pointer", LOG_ERROR);
+            return false;
+        }
+
+        if (width <= 0 || height <= 0 || thickness <= 0) {
+            Log("Failed to project slab: Invalid dimensions", LOG_ERROR);
+            return false;
+        }
+
+        if (interpolation < SLICE_NEAREST || interpolation > SLICE_CUBIC || mode < SLAB_MAX || mode > SLAB_MEAN) {
+            Log("Failed to project slab: Invalid interpolation or mode", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->ProjectSlab(origin, u, v, w, thickness, width, height, interpolation, mode, out);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while projecting slab: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while projecting slab", LOG_ERROR);
+        return false;
+    }
+}
+
+// Thick-slab projection over axis slices, sliding from the previous call
+CTVIEWER_API bool ProjectAxisSlab(int axis, int first, int thickness, int mode, unsigned char* out) {
+    try {
+        if (!g_renderer) {
+            Log("ProjectAxisSlab called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (!out) {
+            Log("Failed to project axis slab: Output pointer is null", LOG_ERROR);
+            return false;
+        }
+
+        if (mode < SLAB_MAX || mode > SLAB_MEAN) {
+            Log("Failed to project axis slab: Invalid mode", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->ProjectAxisSlab(axis, first, thickness, mode, out);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while projecting axis slab: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while projecting axis slab", LOG_ERROR);
+        return false;
+    }
+}
+
+// Global density histogram from load time
+CTVIEWER_API int GetHistogram(unsigned long long* counts, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetHistogram called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!counts || capacity <= 0) {
+            Log("Failed to get histogram: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetHistogram(counts, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting histogram: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting histogram", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Density histogram of every z slice
+CTVIEWER_API int GetSliceHistograms(unsigned int* counts, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetSliceHistograms called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!counts || capacity <= 0) {
+            Log("Failed to get slice histograms: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetSliceHistograms(counts, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting slice histograms: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting slice histograms", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Min, max, mean and standard deviation of the volume and each slice
+CTVIEWER_API int GetVolumeStatistics(double* values, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetVolumeStatistics called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!values || capacity <= 0) {
+            Log("Failed to get volume statistics: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetVolumeStatistics(values, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting volume statistics: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting volume statistics", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Per-label statistics over the loaded volume and labels
+CTVIEWER_API int GetMaterialStatistics(double* values, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetMaterialStatistics called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!values || capacity <= 0) {
+            Log("Failed to get material statistics: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetMaterialStatistics(values, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting material statistics: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting material statistics", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Connected-component labelling of one material
+CTVIEWER_API int LabelComponents(int material, int connectivity, unsigned int* ids) {
+    try {
+        if (!g_renderer) {
+            Log("LabelComponents called but renderer is not initialized", LOG_ERROR);
+            return -1;
+        }
+
+        if (material < 0 || material > 255) {
+            Log("Failed to label components: Invalid material", LOG_ERROR);
+            return -1;
+        }
+
+        return g_renderer->LabelComponents(material, connectivity, ids);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while labelling components: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return -1;
+    }
+    catch (...) {
+        Log("Unknown exception while labelling components", LOG_ERROR);
+        return -1;
+    }
+}
+
+// Sizes and bounds from the last component labelling
+CTVIEWER_API int GetComponentInfo(long long* values, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetComponentInfo called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!values || capacity <= 0) {
+            Log("Failed to get component info: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetComponentInfo(values, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting component info: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting component info", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Distance map of one material
+CTVIEWER_API bool DistanceTransform(int material, const float* spacing, bool squared, void* out) {
+    try {
+        if (!g_renderer) {
+            Log("DistanceTransform called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (material < 0 || material > 255) {
+            Log("Failed to compute distance transform: Invalid material", LOG_ERROR);
+            return false;
+        }
+        if (!out) {
+            Log("Failed to compute distance transform: Invalid buffer", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->DistanceTransform(material, spacing, squared, out);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while computing distance transform: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while computing distance transform", LOG_ERROR);
+        return false;
+    }
+}
+
+// Erode/dilate/open/close one material of the labels
+CTVIEWER_API bool ApplyMorphology(int material, int operation, int element, int radius, int replacement,
+    unsigned char* out) {
+    try {
+        if (!g_renderer) {
+            Log("ApplyMorphology called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        if (material < 0 || material > 255 || replacement < 0 || replacement > 255) {
+            Log("Failed to apply morphology: Invalid material", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->ApplyMorphology(material, operation, element, radius, replacement, out);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while applying morphology: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while applying morphology", LOG_ERROR);
+        return false;
+    }
+}
+
+// Watershed grain separation of one material
+CTVIEWER_API int SeparateGrains(int material, float h, unsigned int* ids, bool display) {
+    try {
+        if (!g_renderer) {
+            Log("SeparateGrains called but renderer is not initialized", LOG_ERROR);
+            return -1;
+        }
+
+        if (material < 0 || material > 255) {
+            Log("Failed to separate grains: Invalid material", LOG_ERROR);
+            return -1;
+        }
+
+        return g_renderer->SeparateGrains(material, h, ids, display);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while separating grains: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return -1;
+    }
+    catch (...) {
+        Log("Unknown exception while separating grains", LOG_ERROR);
+        return -1;
+    }
+}
+
+// Pore network extraction of one material
+CTVIEWER_API int ExtractPoreNetwork(int material, float h, unsigned int* ids, bool display) {
+    try {
+        if (!g_renderer) {
+            Log("ExtractPoreNetwork called but renderer is not initialized", LOG_ERROR);
+            return -1;
+        }
+
+        if (material < 0 || material > 255) {
+            Log("Failed to extract pore network: Invalid material", LOG_ERROR);
+            return -1;
+        }
+
+        return g_renderer->ExtractPoreNetwork(material, h, ids, display);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while extracting pore network: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return -1;
+    }
+    catch (...) {
+        Log("Unknown exception while extracting pore network", LOG_ERROR);
+        return -1;
+    }
+}
+
+// Pores of the last extracted network
+CTVIEWER_API int GetPores(double* values, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetPores called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!values || capacity <= 0) {
+            Log("Failed to get pores: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetPores(values, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting pores: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting pores", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Throats of the last extracted network
+CTVIEWER_API int GetThroats(double* values, int capacity) {
+    try {
+        if (!g_renderer) {
+            Log("GetThroats called but renderer is not initialized", LOG_ERROR);
+            return 0;
+        }
+
+        if (!values || capacity <= 0) {
+            Log("Failed to get throats: Invalid buffer", LOG_ERROR);
+            return 0;
+        }
+
+        return g_renderer->GetThroats(values, capacity);
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while getting throats: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return 0;
+    }
+    catch (...) {
+        Log("Unknown exception while getting throats", LOG_ERROR);
+        return 0;
+    }
+}
+
+// Labels as they were before a grain or pore display
+CTVIEWER_API bool RestoreLabels() {
+    try {
+        if (!g_renderer) {
+            Log("RestoreLabels called but renderer is not initialized", LOG_ERROR);
+            return false;
+        }
+
+        return g_renderer->RestoreLabels();
+    }
+    catch (std::exception& e) {
+        std::string msg = "Exception while restoring labels: " + std::string(e.what());
+        Log(msg.c_str(), LOG_ERROR);
+        return false;
+    }
+    catch (...) {
+        Log("Unknown exception while restoring labels", LOG_ERROR);
+        return false;
+    }
+}
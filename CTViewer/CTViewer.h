@@ -7,6 +7,10 @@
 // Define logging callback type
 typedef void (*LogCallback)(const char* message, int severity);
 
+// Receives RenderCameraPath frames in order; rgba (width*height RGBA8) is
+// only valid during the call
+typedef void (*FrameCallback)(int frame, const unsigned char* rgba, int width, int height);
+
 // Add a function to set the callback
 extern "C" CTVIEWER_API void SetLogCallback(LogCallback callback);
 
@@ -17,9 +21,17 @@ extern "C" CTVIEWER_API void Shutdown();
 
 
 extern "C" {
+    // Voxel coordinates, as used by every position below (clip planes,
+    // slice origins, centroids): voxel (i, j, k) covers [i, i + 1) along
+    // each axis, so its centre is at (i + 0.5, j + 0.5, k + 0.5), as in the
+    // shaders. Integer boxes and bounds are inclusive voxel indices.
+
     // Initialize the DirectX viewer
     CTVIEWER_API bool Initialize(void* hwnd, int width, int height);
 
+    // Initialize without a window or device; only the CPU paths are available
+    CTVIEWER_API bool InitializeHeadless(int width, int height);
+
     // Clean up resources
     CTVIEWER_API void Shutdown();
 
@@ -47,6 +59,220 @@ extern "C" {
     CTVIEWER_API void SetOpacity(float opacity);
     CTVIEWER_API void SetBrightness(float brightness);
     CTVIEWER_API void SetContrast(float contrast);
-    CTVIEWER_API void SetRenderMode(int mode); // 0=Volume, 1=MIP, 2=Isosurface
+    CTVIEWER_API void SetRenderMode(int mode); // 0=Volume, 1=MIP, 2=Isosurface, 3=MinIP, 4=Average
     CTVIEWER_API void ShowLabels(bool show);
+    CTVIEWER_API void SetSampleFilter(int filter); // 0=Nearest, 1=Linear
+    CTVIEWER_API void SetIsoValue(float isoValue); // normalized density (0-1) for the isosurface mode
+
+    // Transfer function - entries RGBA floats (0-1, straight alpha) spread
+    // evenly over the density range; replaces the brightness/contrast/opacity
+    // mapping until called again with null or 0 entries. Returns true if a
+    // table was set, false when cleared or on error.
+    CTVIEWER_API bool SetTransferFunction(const float* rgba, int entries);
+
+    // 2D transfer function - densityEntries x magnitudeEntries RGBA floats,
+    // density varying fastest, magnitude spanning the 8-bit gradient range.
+    // Builds the gradient volume if needed; null or 0 entries reverts to 1D
+    // and frees it unless SetGradientVolume enabled it.
+    // Returns true if the table is in use, false when cleared or when the
+    // gradient volume cannot be built.
+    CTVIEWER_API bool SetTransferFunction2D(const float* rgba, int densityEntries, int magnitudeEntries);
+
+    // Joint histogram for the 2D editor: 256 x 256 voxel counts indexed by
+    // magnitude * 256 + density. Gradients are computed for it if needed and
+    // freed again unless shading or a 2D table uses them. Returns the number
+    // of bins written, 0 if capacity is too small or no volume is loaded.
+    CTVIEWER_API int GetJointHistogram(unsigned int* counts, int capacity);
+
+    // Density statistics counted while LoadVolumeData copies the volume,
+    // kept until the next load. GetHistogram writes 256 voxel counts;
+    // GetSliceHistograms 256 counts per z slice, slice after slice;
+    // GetVolumeStatistics min, max, mean and standard deviation for the
+    // whole volume followed by the same four values per z slice. Each
+    // returns the number of values written, 0 if capacity is too small.
+    CTVIEWER_API int GetHistogram(unsigned long long* counts, int capacity);
+    CTVIEWER_API int GetSliceHistograms(unsigned int* counts, int capacity);
+    CTVIEWER_API int GetVolumeStatistics(double* values, int capacity);
+
+    // Statistics of every label (0-255) over the loaded volume and labels,
+    // 15 values per label: voxel count, volume (count * voxelSize^3), mean,
+    // standard deviation, min and max density, inclusive voxel bounds
+    // minX, minY, minZ, maxX, maxY, maxZ and the centroid x, y, z in voxel
+    // coordinates. All 0 for absent labels. capacity must be at least 3840;
+    // returns the number of values written.
+    CTVIEWER_API int GetMaterialStatistics(double* values, int capacity);
+
+    // Connected components of the voxels labelled material in the loaded
+    // labels, with connectivity 6, 18 or 26. ids (width*height*depth, z-major,
+    // may be null) receives 0 outside the material and component ids 1 to N
+    // numbered by first voxel in z-major order. Returns N, -1 on error.
+    // GetComponentInfo then writes 7 values per component, in id order:
+    // voxel count and inclusive bounds minX, minY, minZ, maxX, maxY, maxZ;
+    // returns the number of components written.
+    CTVIEWER_API int LabelComponents(int material, int connectivity, unsigned int* ids);
+    CTVIEWER_API int GetComponentInfo(long long* values, int capacity);
+
+    // Exact Euclidean distance from each voxel labelled material in the
+    // loaded labels to the nearest voxel with another label, 0 elsewhere.
+    // spacing is the voxel size along x, y, z (null for the isotropic
+    // voxel size). out (width*height*depth, z-major) receives floats, or
+    // with squared unsigned ints holding the rounded squared distance in
+    // units of the smallest spacing, i.e. in voxels for isotropic scans.
+    CTVIEWER_API bool DistanceTransform(int material, const float* spacing, bool squared, void* out);
+
+    // Binary morphology of the voxels labelled material in the loaded labels:
+    // operation 0 erode, 1 dilate, 2 open, 3 close; element 0 box (cube of
+    // side 2*radius+1), 1 ball of the given radius in voxels. Voxels removed
+    // from the material take the replacement label and voxels added take
+    // material. out (width*height*depth, z-major) receives the labels; with
+    // a null out the result replaces the loaded labels.
+    CTVIEWER_API bool ApplyMorphology(int material, int operation, int element, int radius, int replacement,
+        unsigned char* out);
+
+    // Splits the voxels labelled material into grains by a marker-controlled
+    // watershed of their distance map; maxima need a dynamic of at least h
+    // voxels to seed a grain. ids (width*height*depth, z-major, may be null)
+    // receives 0 outside and grain ids 1 to N by first voxel. GetComponentInfo
+    // then reports the grains. With display the voxels of material show the
+    // grains, cycling through labels 1-255, while other labels stay; the
+    // analysis calls keep using the labels as loaded (a second label copy)
+    // until RestoreLabels or the next LoadLabelData. Returns N, -1 on error.
+    CTVIEWER_API int SeparateGrains(int material, float h, unsigned int* ids, bool display);
+
+    // Pore network of the voxels labelled material: pores are the grains of
+    // SeparateGrains (ids and display as there), throats the pores that share
+    // faces. Returns the pore count, -1 on error. Lengths are in voxel size
+    // units. GetPores writes 7 values per pore in id order: volume, surface
+    // area, inscribed radius, centroid x, y, z (voxel coordinates times the
+    // voxel size), coordination number.
+    // GetThroats writes 6 values per throat, sorted by pore pair: pore ids 1
+    // and 2, inscribed radius of the narrowest section, length (centre
+    // distance less both pore radii, at least one voxel), volume (cylinder)
+    // and contact area. Both return the number of items written.
+    CTVIEWER_API int ExtractPoreNetwork(int material, float h, unsigned int* ids, bool display);
+    CTVIEWER_API int GetPores(double* values, int capacity);
+    CTVIEWER_API int GetThroats(double* values, int capacity);
+
+    // Puts back the labels a grain or pore display recoloured (nothing to do
+    // without one); false if they cannot be reloaded
+    CTVIEWER_API bool RestoreLabels();
+
+    // Sample distance as a multiple of the 0.005 base step (0.25-8); with
+    // preIntegrated the volume mode composites pre-integrated segments
+    CTVIEWER_API void SetSampling(float stepScale, bool preIntegrated);
+
+    // Gradient volume - precomputed Sobel gradients (4 bytes per voxel) used
+    // for shading; built now or on the next LoadVolumeData
+    CTVIEWER_API bool SetGradientVolume(bool enable);
+    CTVIEWER_API void SetShading(int flags); // bit 0=Phong lighting, bit 1=gradient-magnitude opacity
+
+    // Dynamic resolution - both backends ray cast at a reduced internal size
+    // chosen from the measured frame cost so frames take about milliseconds,
+    // then upscale bilinearly (edge-aware keeps silhouettes sharp). 0 or less
+    // always renders at full size.
+    CTVIEWER_API void SetTargetFrameTime(float milliseconds, bool edgeAware);
+
+    // Air cropping - rays are limited to the box (and optional circular
+    // footprint) of voxels above threshold; applied on the next LoadVolumeData.
+    // Off by default, since low-intensity content below threshold is cut.
+    CTVIEWER_API void SetAutoCrop(bool enable, int threshold, bool circularMask);
+    CTVIEWER_API bool GetContentBounds(int* bounds); // minX, minY, minZ, maxX, maxY, maxZ
+
+    // Cut-away views - up to 6 planes as (a, b, c, d) in voxel coordinates,
+    // keeping the side where a*x + b*y + c*z + d >= 0, and an inclusive voxel
+    // box (minX, minY, minZ, maxX, maxY, maxZ). Null clears either; both
+    // take effect on the next frame. SetClipPlanes returns the number of
+    // planes in use. The box is clamped to the loaded volume;
+    // SetRegionOfInterest returns false, keeping the previous box, if a min
+    // exceeds its max or the box misses the volume.
+    CTVIEWER_API int SetClipPlanes(const float* planes, int count);
+    CTVIEWER_API bool SetRegionOfInterest(const int* box);
+
+    // Trilinear samples/second along X, Y, Z for the z-major and bricked
+    // CPU layouts (6 values: z-major X, Y, Z then bricked X, Y, Z). Holds a
+    // second, z-major copy of the volume (1 byte per voxel) while measuring,
+    // freed before it returns.
+    CTVIEWER_API bool BenchmarkVolumeLayout(double* samplesPerSecond);
+
+    // Render the current view with the CPU ray caster into width*height RGBA8 pixels
+    CTVIEWER_API bool RenderCpu(unsigned char* rgba, int width, int height);
+
+    // Milliseconds per CPU frame for every kernel variant, indexed by
+    // (row * 2 + showLabels) * 2 + filter. Rows 0-4 are the render modes
+    // (the volume mode with its 1D table, unshaded); rows 5-9 are the volume
+    // mode pre-integrated, shaded, pre-integrated shaded, 2D table and 2D
+    // table shaded, with Phong when shading is off. -1 where a variant
+    // cannot run: no labels, no gradient volume, or no pre-integrated or 2D
+    // table set. Returns the number of values written (up to 40).
+    CTVIEWER_API int BenchmarkRenderKernels(int width, int height, double* msPerFrame, int capacity);
+
+    // RMSE (8-bit units) of volume renders at step scales 1, 2 and 4 against
+    // a render at 1/8 step: point-sampled and pre-integrated for each scale.
+    // rmse must hold 6 values; returns the number written.
+    CTVIEWER_API int ValidatePreIntegration(int width, int height, double* rmse);
+
+    // Temporal reprojection for CPU frames - while the camera moves, the
+    // previous frame's hit points are reprojected and only disoccluded
+    // pixels, plus pixels reused for several frames, are ray cast again.
+    // Any other setting change recasts the whole frame.
+    CTVIEWER_API void SetTemporalReprojection(bool enable);
+
+    // Orbits the current view by degreesPerFrame for frames frames and fills
+    // results with: ms per full frame, ms per reprojected frame, fraction of
+    // pixels ray cast, and RMSE (8-bit units) against the full frames.
+    // Returns the number of values written (4).
+    CTVIEWER_API int BenchmarkReprojection(int width, int height, int frames, float degreesPerFrame, double* results);
+
+    // Deep-pixel cache for CPU frames - each pixel keeps the labels its ray
+    // reached and their weights, so UpdateMaterials followed by RenderCpu
+    // only recomposites colours (and re-casts the pixels that reached a
+    // label whose alpha changed). Takes precedence over temporal
+    // reprojection; costs about 32 bytes per pixel while enabled.
+    CTVIEWER_API void SetRecolorCache(bool enable);
+
+    // Ray-cost debugging on the CPU path. RenderCostMap casts the current
+    // view and writes a heat map of samples per ray (blue cheap, red at
+    // the step budget, magenta where the step limit cut the ray, black for
+    // misses) and/or 4 ints per pixel: samples, bricks entered, bricks
+    // skipped, termination (0 missed, 1 exited, 2 opaque, 3 step limit,
+    // 4 MIP/MinIP extreme, 5 surface). Either buffer may be null.
+    // SetCostView makes RenderCpu draw the heat map instead of the volume.
+    CTVIEWER_API void SetCostView(bool enable);
+    CTVIEWER_API bool RenderCostMap(unsigned char* rgba, int* counts, int width, int height);
+
+    // Headless batch rendering (turntables, fly-throughs) - renders count
+    // camera poses of 10 floats each (position xyz, target xyz, up xyz,
+    // vertical field of view in radians, 0 or less for the viewer's 45
+    // degrees) with the CPU ray caster, whole frames in parallel across the
+    // cores, and calls callback with each frame in order on the calling
+    // thread while later frames render. Returns the number of frames delivered.
+    CTVIEWER_API int RenderCameraPath(const float* poses, int count, int width, int height, FrameCallback callback);
+
+    // Multi-planar reslice of the loaded volume at any orientation into
+    // width*height 8-bit pixels. Pixel (i, j) samples origin + i*u + j*v in
+    // voxel coordinates, so the lengths of u and v are the pixel spacing;
+    // outside the volume is 0. interpolation is 0 nearest, 1 trilinear, 2
+    // tricubic. Planes along the voxel axes through voxel centres (origin
+    // at i + 0.5) are copied directly.
+    CTVIEWER_API bool ExtractSlice(const float* origin, const float* u, const float* v, int width, int height,
+        int interpolation, unsigned char* out);
+
+    // Orthogonal slices for the side and top views: axis 0 is the YZ plane
+    // at x = index (y fastest), 1 the XZ plane at y = index and 2 the XY
+    // plane at z = index. At lod > 0 each pixel averages a 2^lod square.
+    // GetAxisSliceSize gives the output size; recent slices are cached by
+    // (axis, index, lod) until the next volume load.
+    CTVIEWER_API bool GetAxisSliceSize(int axis, int lod, int* width, int* height);
+    CTVIEWER_API bool ExtractAxisSlice(int axis, int index, int lod, unsigned char* out);
+
+    // Thick-slab projections; mode is 0 MIP, 1 MinIP, 2 mean. ProjectSlab
+    // reduces thickness ExtractSlice planes origin + k*w (same u, v,
+    // width, height and interpolation), counting only samples inside the
+    // volume. ProjectAxisSlab reduces axis slices [first, first + thickness)
+    // into a GetAxisSliceSize(axis, 0) image; when the slab moves by one
+    // slice with the same axis, thickness and mode it is updated from the
+    // previous call instead of re-read, for interactive slab scrolling.
+    CTVIEWER_API bool ProjectSlab(const float* origin, const float* u, const float* v, const float* w,
+        int thickness, int width, int height, int interpolation, int mode, unsigned char* out);
+    CTVIEWER_API bool ProjectAxisSlab(int axis, int first, int thickness, int mode, unsigned char* out);
 }
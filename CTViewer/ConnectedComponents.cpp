@@ -0,0 +1,333 @@
+// ConnectedComponents.cpp
+#include "pch.h"
+#include "ConnectedComponents.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <stdexcept>
+#include <emmintrin.h>
+
+namespace
+{
+    // Material voxels [x0, x1) of one row and the provisional label they got
+    struct Run
+    {
+        int x0;
+        int x1;
+        unsigned int label;
+    };
+
+    // A row earlier in scan order that can touch the current row, and how
+    // far past a run's ends its runs may lie and still touch it
+    struct NeighbourRow
+    {
+        int dy;
+        int dz;
+        int reach;
+    };
+
+    const NeighbourRow NEIGHBOURS_6[] = { { -1, 0, 0 }, { 0, -1, 0 } };
+    const NeighbourRow NEIGHBOURS_18[] = { { -1, 0, 1 }, { 0, -1, 1 }, { -1, -1, 0 }, { 1, -1, 0 } };
+    const NeighbourRow NEIGHBOURS_26[] = { { -1, 0, 1 }, { 0, -1, 1 }, { -1, -1, 1 }, { 1, -1, 1 } };
+
+    // Provisional labels of one slab, numbered from 0 in scan order
+    struct Slab
+    {
+        int zBegin;
+        int zEnd;
+        std::vector<unsigned int> parent;
+        std::vector<ComponentInfo> info;
+    };
+
+    unsigned int FindLocal(std::vector<unsigned int>& parent, unsigned int x)
+    {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    // The smaller root always wins, so a set's root is its first label
+    void UniteLocal(std::vector<unsigned int>& parent, unsigned int a, unsigned int b)
+    {
+        a = FindLocal(parent, a);
+        b = FindLocal(parent, b);
+        if (a != b) {
+            parent[max(a, b)] = min(a, b);
+        }
+    }
+
+    unsigned int FindShared(std::atomic<unsigned int>* parent, unsigned int x)
+    {
+        for (;;) {
+            unsigned int p = parent[x].load();
+            if (p == x) {
+                return x;
+            }
+            unsigned int grandparent = parent[p].load();
+            if (grandparent != p) {
+                parent[x].compare_exchange_weak(p, grandparent);
+            }
+            x = grandparent;
+        }
+    }
+
+    // Lock-free union: link the larger root under the smaller one, retrying
+    // if another thread re-parented the root in between
+    void UniteShared(std::atomic<unsigned int>* parent, unsigned int a, unsigned int b)
+    {
+        for (;;) {
+            a = FindShared(parent, a);
+            b = FindShared(parent, b);
+            if (a == b) {
+                return;
+            }
+            if (a < b) {
+                std::swap(a, b);
+            }
+            unsigned int expected = a;
+            if (parent[a].compare_exchange_strong(expected, b)) {
+                return;
+            }
+        }
+    }
+
+    void AddRun(ComponentInfo& info, int x0, int x1, int y, int z)
+    {
+        info.size += x1 - x0;
+        info.bounds[0] = min(info.bounds[0], x0);
+        info.bounds[1] = min(info.bounds[1], y);
+        info.bounds[2] = min(info.bounds[2], z);
+        info.bounds[3] = max(info.bounds[3], x1 - 1);
+        info.bounds[4] = max(info.bounds[4], y);
+        info.bounds[5] = max(info.bounds[5], z);
+    }
+
+    void Merge(ComponentInfo& info, const ComponentInfo& other)
+    {
+        info.size += other.size;
+        for (int c = 0; c < 3; c++) {
+            info.bounds[c] = min(info.bounds[c], other.bounds[c]);
+            info.bounds[c + 3] = max(info.bounds[c + 3], other.bounds[c + 3]);
+        }
+    }
+
+    // Appends the runs of material in one row; all-match and no-match
+    // stretches of 16 voxels are classified with one compare
+    void FindRuns(const unsigned char* row, int width, unsigned char material, std::vector<Run>& runs)
+    {
+        const __m128i target = _mm_set1_epi8(static_cast<char>(material));
+        int start = -1;
+        int x = 0;
+        while (x < width) {
+            if (x + 16 <= width) {
+                int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)), target));
+                if ((mask == 0 && start < 0) || (mask == 0xFFFF && start >= 0)) {
+                    x += 16;
+                    continue;
+                }
+            }
+
+            bool inside = row[x] == material;
+            if (inside && start < 0) {
+                start = x;
+            }
+            else if (!inside && start >= 0) {
+                runs.push_back({ start, x, 0 });
+                start = -1;
+            }
+            x++;
+        }
+        if (start >= 0) {
+            runs.push_back({ start, width, 0 });
+        }
+    }
+}
+
+int LabelConnectedComponents(const BrickedVolume& labels, unsigned char material, int connectivity,
+    unsigned int* ids, std::vector<ComponentInfo>& components)
+{
+    components.clear();
+    const NeighbourRow* neighbours;
+    int neighbourCount;
+    switch (connectivity) {
+    case 6: neighbours = NEIGHBOURS_6; neighbourCount = 2; break;
+    case 18: neighbours = NEIGHBOURS_18; neighbourCount = 4; break;
+    case 26: neighbours = NEIGHBOURS_26; neighbourCount = 4; break;
+    default: return -1;
+    }
+    if (labels.IsEmpty()) {
+        return 0;
+    }
+
+    const int width = labels.Width(), height = labels.Height(), depth = labels.Depth();
+    const size_t sliceSize = static_cast<size_t>(width) * height;
+    const size_t* offX = labels.OffsetsX();
+    const size_t* offY = labels.OffsetsY();
+    const size_t* offZ = labels.OffsetsZ();
+    const int brickSize = BrickedVolume::BRICK_SIZE;
+
+    // Pass 1: each slab labels its runs; ids hold slab-local label + 1
+    std::vector<Slab> slabs(GetWorkerCount());
+    for (Slab& slab : slabs) {
+        slab.zBegin = slab.zEnd = 0;
+    }
+    ParallelForRange(0, depth, [&](int thread, int zBegin, int zEnd) {
+        Slab& slab = slabs[thread];
+        slab.zBegin = zBegin;
+        slab.zEnd = zEnd;
+
+        std::vector<unsigned char> row(width);
+        std::vector<Run> runs[2];
+        std::vector<size_t> rowStart[2];
+        rowStart[0].assign(height + 1, 0);
+        rowStart[1].assign(height + 1, 0);
+
+        for (int z = zBegin; z < zEnd; z++) {
+            std::vector<Run>& current = runs[z & 1];
+            std::vector<size_t>& currentStart = rowStart[z & 1];
+            const std::vector<Run>& previous = runs[(z & 1) ^ 1];
+            const std::vector<size_t>& previousStart = rowStart[(z & 1) ^ 1];
+            current.clear();
+
+            for (int y = 0; y < height; y++) {
+                const unsigned char* src = labels.Data() + offY[y] + offZ[z];
+                for (int x = 0; x < width; x += brickSize) {
+                    memcpy(row.data() + x, src + offX[x], min(brickSize, width - x));
+                }
+                currentStart[y] = current.size();
+                FindRuns(row.data(), width, material, current);
+                currentStart[y + 1] = current.size();
+
+                for (size_t r = currentStart[y]; r < current.size(); r++) {
+                    Run& run = current[r];
+                    bool labelled = false;
+                    for (int n = 0; n < neighbourCount; n++) {
+                        int ny = y + neighbours[n].dy;
+                        int nz = z + neighbours[n].dz;
+                        if (ny < 0 || ny >= height || nz < zBegin) {
+                            continue;
+                        }
+                        const std::vector<Run>& other = nz == z ? current : previous;
+                        const std::vector<size_t>& otherStart = nz == z ? currentStart : previousStart;
+                        int reach = neighbours[n].reach;
+                        for (size_t k = otherStart[ny]; k < otherStart[ny + 1]; k++) {
+                            const Run& candidate = other[k];
+                            if (candidate.x0 >= run.x1 + reach) {
+                                break;
+                            }
+                            if (candidate.x1 + reach <= run.x0) {
+                                continue;
+                            }
+                            if (!labelled) {
+                                run.label = candidate.label;
+                                labelled = true;
+                            }
+                            else {
+                                UniteLocal(slab.parent, run.label, candidate.label);
+                            }
+                        }
+                    }
+
+                    if (!labelled) {
+                        run.label = static_cast<unsigned int>(slab.parent.size());
+                        slab.parent.push_back(run.label);
+                        ComponentInfo empty = { 0, { INT_MAX, INT_MAX, INT_MAX, -1, -1, -1 } };
+                        slab.info.push_back(empty);
+                    }
+                    AddRun(slab.info[run.label], run.x0, run.x1, y, z);
+                }
+
+                unsigned int* out = ids + sliceSize * z + static_cast<size_t>(width) * y;
+                memset(out, 0, width * sizeof(unsigned int));
+                for (size_t r = currentStart[y]; r < current.size(); r++) {
+                    for (int x = current[r].x0; x < current[r].x1; x++) {
+                        out[x] = current[r].label + 1;
+                    }
+                }
+            }
+        }
+    });
+
+    // Shared union-find over every slab's labels, offset by slab
+    std::vector<size_t> offsets(slabs.size() + 1, 0);
+    for (size_t t = 0; t < slabs.size(); t++) {
+        offsets[t + 1] = offsets[t] + slabs[t].parent.size();
+    }
+    const size_t total = offsets.back();
+    if (total >= UINT_MAX) {
+        throw std::runtime_error("Too many provisional components");
+    }
+    std::vector<std::atomic<unsigned int>> parent(total);
+    ParallelForEach(0, static_cast<int>(slabs.size()), [&](int, int t) {
+        for (size_t l = 0; l < slabs[t].parent.size(); l++) {
+            parent[offsets[t] + l].store(static_cast<unsigned int>(offsets[t] + FindLocal(slabs[t].parent, static_cast<unsigned int>(l))));
+        }
+    });
+
+    // Stitch each slab's first slice to the last slice of the slab before
+    const int reach = connectivity == 6 ? 0 : 1;
+    ParallelForEach(1, static_cast<int>(slabs.size()), [&](int, int t) {
+        if (slabs[t].zEnd <= slabs[t].zBegin || slabs[t].zBegin == 0) {
+            return;
+        }
+        int z = slabs[t].zBegin;
+        const unsigned int* below = ids + sliceSize * (z - 1);
+        const unsigned int* above = ids + sliceSize * z;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                unsigned int id = above[static_cast<size_t>(y) * width + x];
+                if (id == 0) {
+                    continue;
+                }
+                unsigned int a = static_cast<unsigned int>(offsets[t] + id - 1);
+                for (int dy = -reach; dy <= reach; dy++) {
+                    for (int dx = -reach; dx <= reach; dx++) {
+                        int nx = x + dx, ny = y + dy;
+                        // 18-connectivity excludes the corner neighbours
+                        if (nx < 0 || nx >= width || ny < 0 || ny >= height || (connectivity == 18 && dx != 0 && dy != 0)) {
+                            continue;
+                        }
+                        unsigned int other = below[static_cast<size_t>(ny) * width + nx];
+                        if (other != 0) {
+                            UniteShared(parent.data(), a, static_cast<unsigned int>(offsets[t - 1] + other - 1));
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Roots are each component's first label in scan order, so numbering
+    // roots in label order numbers components by their first voxel
+    std::vector<unsigned int> finalId(total);
+    unsigned int count = 0;
+    for (size_t l = 0; l < total; l++) {
+        unsigned int root = FindShared(parent.data(), static_cast<unsigned int>(l));
+        finalId[l] = root == l ? ++count : finalId[root];
+    }
+
+    ParallelForEach(0, static_cast<int>(slabs.size()), [&](int, int t) {
+        const unsigned int* map = finalId.data() + offsets[t];
+        for (int z = slabs[t].zBegin; z < slabs[t].zEnd; z++) {
+            unsigned int* slice = ids + sliceSize * z;
+            for (size_t i = 0; i < sliceSize; i++) {
+                if (slice[i] != 0) {
+                    slice[i] = map[slice[i] - 1];
+                }
+            }
+        }
+    });
+
+    ComponentInfo empty = { 0, { INT_MAX, INT_MAX, INT_MAX, -1, -1, -1 } };
+    components.assign(count, empty);
+    for (size_t t = 0; t < slabs.size(); t++) {
+        for (size_t l = 0; l < slabs[t].info.size(); l++) {
+            Merge(components[finalId[offsets[t] + l] - 1], slabs[t].info[l]);
+        }
+    }
+    return static_cast<int>(count);
+}
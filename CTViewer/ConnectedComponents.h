@@ -0,0 +1,27 @@
+// ConnectedComponents.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include <vector>
+
+// Size and inclusive voxel bounds (minX, minY, minZ, maxX, maxY, maxZ) of
+// one connected component
+struct ComponentInfo
+{
+    unsigned long long size;
+    int bounds[6];
+};
+
+// Connected components of the voxels whose label is material, with 6, 18
+// or 26 connectivity. ids receives one 32-bit id per voxel in z-major
+// order, 0 outside the material and 1 to N inside, numbered in order of
+// each component's first voxel; components[id - 1] describes component id.
+//
+// Each worker labels a slab of slices as runs along x, linking every run
+// to the overlapping runs of the rows before it through a local union-find.
+// The slabs are then stitched along their borders in parallel by a shared
+// lock-free union-find whose roots are always the smallest label, which
+// keeps the numbering independent of the thread count. Returns N, or -1
+// for an unsupported connectivity.
+int LabelConnectedComponents(const BrickedVolume& labels, unsigned char material, int connectivity,
+    unsigned int* ids, std::vector<ComponentInfo>& components);
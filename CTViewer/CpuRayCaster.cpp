@@ -0,0 +1,1238 @@
+// CpuRayCaster.cpp
+#include "pch.h"
+#include "CpuRayCaster.h"
+#include "ParallelFor.h"
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    struct Vec3
+    {
+        float x, y, z;
+    };
+
+    inline Vec3 operator+(Vec3 a, Vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    inline Vec3 operator-(Vec3 a, Vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline Vec3 operator*(Vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    inline float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Vec3 Cross(Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    inline Vec3 Normalize(Vec3 a)
+    {
+        float length = sqrtf(Dot(a, a));
+        return length > 0.0f ? a * (1.0f / length) : a;
+    }
+
+    struct Color
+    {
+        float r, g, b, a;
+    };
+
+    inline float Saturate(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+    // Per-frame constants shared by all rows
+    struct RaySetup
+    {
+        const BrickedVolume* volume;
+        const BrickedVolume* labels;
+        const CpuRenderParams* params;
+        float dims[3];
+        int maxIndex[3];
+
+        // Camera in texture space ([0, 1]^3); directions stay in world units
+        // like the shader, which steps normalize(worldPos - cameraPosition)
+        Vec3 origin;
+        Vec3 forward;
+        Vec3 right;
+        Vec3 up;
+        int width;
+        int height;
+
+        const GradientVolume* gradients;    // null unless shading or the 2D table uses it and it matches the volume
+        bool phong;
+        bool gradientOpacity;
+        const float* table2D;   // density x magnitude table, null for the 1D table
+
+        const float* table;     // transfer function with alphas corrected for stepSize
+        float tableStorage[TransferFunction::TABLE_SIZE * 4];
+
+        float brickDims[3];     // volume size in bricks
+        int maxBrick[3];
+
+        float boxMin[3];
+        float boxMax[3];
+        float clipPlanes[MAX_CLIP_PLANES][4];   // texture space
+        int clipPlaneCount;
+        bool hasCircle;
+        float circleX, circleY, radius;
+
+        const unsigned char* mask;  // pixels to cast (non-zero), null for all
+        float* depth;               // per-pixel hit distance output, may be null
+        DeepPixel* deep;            // per-pixel label record output, may be null
+        RayCost* costs;             // per-pixel cost output, may be null
+    };
+
+    // What a ray reports besides its colour
+    struct RayOutput
+    {
+        float depth;            // hit distance, see CpuRayCaster::RenderMasked
+        int samples;            // RayCost counters
+        int bricks;
+        int skipped;
+        int termination;
+        bool traceLabels;       // record material weights (deep pixels)
+        int labelCount;         // above DEEP_PIXEL_LABELS once the record overflowed
+        unsigned char labels[DEEP_PIXEL_LABELS];
+        float weights[DEEP_PIXEL_LABELS];
+
+        // Adds weight to the factor the label's material RGB enters the pixel
+        // with; a zero weight still records that the label was reached
+        inline void AddLabel(unsigned char label, float weight)
+        {
+            if (!traceLabels || label == 0) {
+                return;
+            }
+            for (int i = 0; i < labelCount && i < DEEP_PIXEL_LABELS; i++) {
+                if (labels[i] == label) {
+                    weights[i] += weight;
+                    return;
+                }
+            }
+            if (labelCount < DEEP_PIXEL_LABELS) {
+                labels[labelCount] = label;
+                weights[labelCount] = weight;
+            }
+            labelCount++;
+        }
+    };
+
+    inline int NearestIndex(float p, float dim, int maxIndex)
+    {
+        int i = static_cast<int>(p * dim);
+        return i < 0 ? 0 : (i > maxIndex ? maxIndex : i);
+    }
+
+    template <int Filter>
+    inline float FetchDensity(const RaySetup& s, Vec3 p)
+    {
+        if (Filter == FILTER_LINEAR) {
+            return s.volume->SampleLinear(p.x * s.dims[0] - 0.5f, p.y * s.dims[1] - 0.5f, p.z * s.dims[2] - 0.5f) * (1.0f / 255.0f);
+        }
+        return s.volume->At(NearestIndex(p.x, s.dims[0], s.maxIndex[0]),
+            NearestIndex(p.y, s.dims[1], s.maxIndex[1]),
+            NearestIndex(p.z, s.dims[2], s.maxIndex[2])) * (1.0f / 255.0f);
+    }
+
+    // Labels are ids, so they are always fetched without interpolation
+    inline unsigned char FetchLabel(const RaySetup& s, Vec3 p)
+    {
+        return s.labels->At(NearestIndex(p.x, s.dims[0], s.maxIndex[0]),
+            NearestIndex(p.y, s.dims[1], s.maxIndex[1]),
+            NearestIndex(p.z, s.dims[2], s.maxIndex[2]));
+    }
+
+    // Transfer-function lookup, linear between table entries like the
+    // shader's filtered 1D texture
+    inline Color Classify(const RaySetup& s, float density)
+    {
+        float x = Saturate(density) * (TransferFunction::TABLE_SIZE - 1);
+        int i = min(static_cast<int>(x), TransferFunction::TABLE_SIZE - 2);
+        float f = x - i;
+        const float* e = s.table + 4 * i;
+        return { e[0] + (e[4] - e[0]) * f, e[1] + (e[5] - e[1]) * f,
+            e[2] + (e[6] - e[2]) * f, e[3] + (e[7] - e[3]) * f };
+    }
+
+    // Bilinear lookup in the 2D table; rows are gradient magnitudes
+    inline Color Classify2D(const RaySetup& s, float density, float magnitude)
+    {
+        const int size = TransferFunction::TABLE_SIZE;
+        float x = Saturate(density) * (size - 1);
+        float y = Saturate(magnitude) * (size - 1);
+        int i = min(static_cast<int>(x), size - 2);
+        int j = min(static_cast<int>(y), size - 2);
+        float fx = x - i;
+        float fy = y - j;
+        const float* e0 = s.table2D + 4 * (j * size + i);
+        const float* e1 = e0 + 4 * size;
+        auto channel = [&](int k) {
+            float top = e0[k] + (e0[k + 4] - e0[k]) * fx;
+            float bottom = e1[k] + (e1[k + 4] - e1[k]) * fx;
+            return top + (bottom - top) * fy;
+        };
+        return { channel(0), channel(1), channel(2), channel(3) };
+    }
+
+    // Projection modes show the classified colour fully opaque
+    inline Color ClassifyOpaque(const RaySetup& s, float density)
+    {
+        Color c = Classify(s, density);
+        c.a = 1.0f;
+        return c;
+    }
+
+    // Tints a sample towards its label's material by the material alpha.
+    // Returns that alpha, the factor the material RGB now enters c.rgb with,
+    // and the label (0 and 0 when unlabelled).
+    inline float BlendLabel(const RaySetup& s, Vec3 p, Color& c, unsigned char& label)
+    {
+        label = FetchLabel(s, p);
+        if (label == 0) {
+            return 0.0f;
+        }
+        const float* mat = s.params->materials + 4 * label;
+        c.r += (mat[0] - c.r) * mat[3];
+        c.g += (mat[1] - c.g) * mat[3];
+        c.b += (mat[2] - c.b) * mat[3];
+        c.a += (mat[3] - c.a) * mat[3];
+        return mat[3];
+    }
+
+    // Encoded gradient texel (GradientVolume layout) as 0-1 channels
+    template <int Filter>
+    inline void FetchGradient(const RaySetup& s, Vec3 p, float* rgba)
+    {
+        if (Filter == FILTER_LINEAR) {
+            s.gradients->SampleLinear(p.x * s.dims[0] - 0.5f, p.y * s.dims[1] - 0.5f, p.z * s.dims[2] - 0.5f, rgba);
+            return;
+        }
+        unsigned int texel = s.gradients->At(NearestIndex(p.x, s.dims[0], s.maxIndex[0]),
+            NearestIndex(p.y, s.dims[1], s.maxIndex[1]),
+            NearestIndex(p.z, s.dims[2], s.maxIndex[2]));
+        for (int c = 0; c < 4; c++) {
+            rgba[c] = ((texel >> (8 * c)) & 0xFF) * (1.0f / 255.0f);
+        }
+    }
+
+    // Decodes a voxel-space direction into a world-space unit normal; the
+    // volume is stretched to the [-1, 1] cube, so each axis scales by its size
+    inline Vec3 DecodeNormal(const RaySetup& s, const float* rgba)
+    {
+        return Normalize({ (rgba[0] * 2.0f - 1.0f) * s.dims[0],
+            (rgba[1] * 2.0f - 1.0f) * s.dims[1],
+            (rgba[2] * 2.0f - 1.0f) * s.dims[2] });
+    }
+
+    // Encoded magnitudes below one step (half a grey level per voxel) carry
+    // no direction; such samples are left unlit, as in the pixel shader
+    const float FLAT_GRADIENT = 1.0f / 255.0f;
+
+    // Headlight Phong terms, shared with the pixel shader (shininess 16)
+    const float LIGHT_AMBIENT = 0.3f;
+    const float LIGHT_DIFFUSE = 0.7f;
+    const float LIGHT_SPECULAR = 0.3f;
+
+    // Lights a straight-alpha sample and/or scales its opacity by the
+    // gradient magnitude, from an already fetched gradient. Returns the
+    // factor the incoming colour was scaled by.
+    inline float ShadeSample(const RaySetup& s, const float* gradient, Vec3 dir, Color& c)
+    {
+        float scale = 1.0f;
+        if (s.phong && gradient[3] >= FLAT_GRADIENT) {
+            float nd = fabsf(Dot(DecodeNormal(s, gradient), dir));
+            float diffuse = LIGHT_AMBIENT + LIGHT_DIFFUSE * nd;
+            float nd2 = nd * nd;
+            float nd4 = nd2 * nd2;
+            float nd8 = nd4 * nd4;
+            float specular = LIGHT_SPECULAR * nd8 * nd8;
+            c.r = c.r * diffuse + specular;
+            c.g = c.g * diffuse + specular;
+            c.b = c.b * diffuse + specular;
+            scale = diffuse;
+        }
+        if (s.gradientOpacity) {
+            c.a *= gradient[3];
+        }
+        return scale;
+    }
+
+    // Headlight diffuse shading from the precomputed gradient, or from a
+    // central difference when no gradient volume is loaded
+    template <bool ShowLabels, int Filter>
+    Color ShadeSurface(const RaySetup& s, Vec3 p, Vec3 dir, RayOutput& out)
+    {
+        float diffuse = 1.0f;
+        if (s.gradients) {
+            float gradient[4];
+            FetchGradient<Filter>(s, p, gradient);
+            if (gradient[3] >= FLAT_GRADIENT) {
+                diffuse = fabsf(Dot(DecodeNormal(s, gradient), dir));
+            }
+        }
+        else {
+            Vec3 hx = { 1.0f / s.dims[0], 0.0f, 0.0f };
+            Vec3 hy = { 0.0f, 1.0f / s.dims[1], 0.0f };
+            Vec3 hz = { 0.0f, 0.0f, 1.0f / s.dims[2] };
+            Vec3 normal = Normalize({
+                FetchDensity<Filter>(s, p + hx) - FetchDensity<Filter>(s, p - hx),
+                FetchDensity<Filter>(s, p + hy) - FetchDensity<Filter>(s, p - hy),
+                FetchDensity<Filter>(s, p + hz) - FetchDensity<Filter>(s, p - hz)
+            });
+            diffuse = fabsf(Dot(normal, dir));
+        }
+        float shade = 0.15f + 0.85f * diffuse;
+
+        Color c = { 1.0f, 1.0f, 1.0f, 1.0f };
+        if (ShowLabels) {
+            unsigned char label;
+            float tint = BlendLabel(s, p, c, label);
+            out.AddLabel(label, tint * shade);
+        }
+        c.r *= shade;
+        c.g *= shade;
+        c.b *= shade;
+        c.a = 1.0f;
+        return c;
+    }
+
+    // Brick containing a texture-space position
+    inline size_t BrickAt(const RaySetup& s, Vec3 p, int* brick)
+    {
+        brick[0] = NearestIndex(p.x, s.brickDims[0], s.maxBrick[0]);
+        brick[1] = NearestIndex(p.y, s.brickDims[1], s.maxBrick[1]);
+        brick[2] = NearestIndex(p.z, s.brickDims[2], s.maxBrick[2]);
+        return s.volume->BrickIndex(brick[0], brick[1], brick[2]);
+    }
+
+    // Ray parameter where the ray leaves a hierarchy node (a brick at level 0)
+    inline float BrickExit(const RaySetup& s, Vec3 origin, Vec3 dir, const int* node, int level)
+    {
+        const float o[3] = { origin.x, origin.y, origin.z };
+        const float d[3] = { dir.x, dir.y, dir.z };
+        float tExit = 1e30f;
+        for (int axis = 0; axis < 3; axis++) {
+            if (fabsf(d[axis]) < 1e-6f) {
+                continue;
+            }
+            int face = (d[axis] > 0.0f ? node[axis] + 1 : node[axis]) << level;
+            float bound = face / s.brickDims[axis];
+            tExit = min(tExit, (bound - o[axis]) / d[axis]);
+        }
+        return tExit;
+    }
+
+    // First sample index past a node, keeping the ray's sample spacing
+    inline int StepPastBrick(const RaySetup& s, Vec3 origin, Vec3 dir, const int* node, float tEnter, int i, int level = 0)
+    {
+        float tBrick = BrickExit(s, origin, dir, node, level);
+        int next = static_cast<int>(ceilf((tBrick - tEnter) / s.params->stepSize));
+        return next > i ? next : i + 1;
+    }
+
+    // A march that ran out of samples rather than span hit the step limit
+    inline void EndOfSpan(const CpuRenderParams& p, int i, float tEnter, float tExit, RayOutput& out)
+    {
+        if (i >= p.maxSteps && tEnter + p.maxSteps * p.stepSize <= tExit) {
+            out.termination = RAY_STEP_LIMIT;
+        }
+    }
+
+    // Accumulated opacity at which a composited ray reports its depth
+    const float HIT_OPACITY = 0.5f;
+
+    // Front-to-back compositing through the transfer function. Bricks whose
+    // range maps to zero opacity (and hold no labels when labels are shown)
+    // are stepped over. The depth is the sample that takes the ray past
+    // HIT_OPACITY, or the last visible one for fainter rays.
+    template <bool ShowLabels, int Filter, bool Shaded, bool TwoD>
+    Color MarchComposite(const RaySetup& s, Vec3 origin, Vec3 dir, float tEnter, float tExit, RayOutput& out)
+    {
+        const CpuRenderParams& p = *s.params;
+        const unsigned char visibleMask = ShowLabels ? BRICK_VISIBLE | BRICK_LABELLED : BRICK_VISIBLE;
+        Color color = { 0.0f, 0.0f, 0.0f, 0.0f };
+        size_t lastBrick = static_cast<size_t>(-1);
+
+        int i = 0;
+        while (i < p.maxSteps) {
+            float t = tEnter + i * p.stepSize;
+            if (t > tExit) {
+                break;
+            }
+
+            Vec3 pos = origin + dir * t;
+            if (p.brickFlags) {
+                int brick[3];
+                size_t brickIndex = BrickAt(s, pos, brick);
+                if (brickIndex != lastBrick) {
+                    lastBrick = brickIndex;
+                    out.bricks++;
+                    if (!(p.brickFlags[brickIndex] & visibleMask)) {
+                        out.skipped++;
+                        i = StepPastBrick(s, origin, dir, brick, tEnter, i);
+                        continue;
+                    }
+                }
+            }
+
+            // One gradient fetch serves both the 2D lookup and the shading
+            float density = FetchDensity<Filter>(s, pos);
+            out.samples++;
+            float gradient[4];
+            if (Shaded || TwoD) {
+                FetchGradient<Filter>(s, pos, gradient);
+            }
+            Color sample = TwoD ? Classify2D(s, density, gradient[3]) : Classify(s, density);
+            unsigned char label = 0;
+            float tint = 0.0f;
+            if (ShowLabels) {
+                tint = BlendLabel(s, pos, sample, label);
+            }
+            float lit = 1.0f;
+            if (Shaded) {
+                lit = ShadeSample(s, gradient, dir, sample);
+            }
+
+            // Front-to-back compositing with early ray termination
+            float weight = (1.0f - color.a) * sample.a;
+            if (weight > 0.0f && color.a < HIT_OPACITY) {
+                out.depth = t;
+            }
+            if (ShowLabels) {
+                out.AddLabel(label, weight * tint * lit);
+            }
+            color.r += weight * sample.r;
+            color.g += weight * sample.g;
+            color.b += weight * sample.b;
+            color.a += weight;
+            if (color.a >= 0.95f) {
+                out.termination = RAY_OPAQUE;
+                break;
+            }
+            i++;
+        }
+
+        EndOfSpan(p, i, tEnter, tExit, out);
+        return color;
+    }
+
+    // Maximum (IsMax) or minimum intensity projection. Bricks whose range
+    // cannot beat the running value are stepped over, and the march stops as
+    // soon as the volume's global extreme has been reached.
+    template <bool IsMax, bool ShowLabels, int Filter>
+    Color MarchExtreme(const RaySetup& s, Vec3 origin, Vec3 dir, float tEnter, float tExit, RayOutput& out)
+    {
+        const CpuRenderParams& p = *s.params;
+        const BrickedVolume& volume = *s.volume;
+        const float limit = (IsMax ? volume.MaxValue() : volume.MinValue()) * (1.0f / 255.0f);
+
+        float extreme = IsMax ? -1.0f : 2.0f;
+        float extremeT = tEnter;
+        size_t lastBrick = static_cast<size_t>(-1);
+
+        int i = 0;
+        while (i < p.maxSteps) {
+            float t = tEnter + i * p.stepSize;
+            if (t > tExit) {
+                break;
+            }
+
+            Vec3 pos = origin + dir * t;
+            int brick[3];
+            size_t brickIndex = BrickAt(s, pos, brick);
+            if (brickIndex != lastBrick) {
+                lastBrick = brickIndex;
+                out.bricks++;
+                float bound = (IsMax ? volume.BrickMax(brickIndex) : volume.BrickMin(brickIndex)) * (1.0f / 255.0f);
+                if (IsMax ? bound <= extreme : bound >= extreme) {
+                    out.skipped++;
+                    i = StepPastBrick(s, origin, dir, brick, tEnter, i);
+                    continue;
+                }
+            }
+
+            float density = FetchDensity<Filter>(s, pos);
+            out.samples++;
+            if (IsMax ? density > extreme : density < extreme) {
+                extreme = density;
+                extremeT = t;
+                if (IsMax ? extreme >= limit : extreme <= limit) {
+                    out.termination = RAY_EXTREME;
+                    break;
+                }
+            }
+            i++;
+        }
+        EndOfSpan(p, i, tEnter, tExit, out);
+
+        Color color = { 0.0f, 0.0f, 0.0f, 0.0f };
+        if (extreme < 0.0f || extreme > 1.0f) {
+            return color;
+        }
+
+        color = ClassifyOpaque(s, extreme);
+        if (ShowLabels) {
+            unsigned char label;
+            float tint = BlendLabel(s, origin + dir * extremeT, color, label);
+            out.AddLabel(label, tint);
+        }
+        out.depth = extremeT;
+        return color;
+    }
+
+    // Average intensity projection. Bricks whose range is a single value are
+    // accumulated without sampling, which covers air and uniform phases.
+    // The depth is the middle of the ray's span.
+    template <bool ShowLabels, int Filter>
+    Color MarchAverage(const RaySetup& s, Vec3 origin, Vec3 dir, float tEnter, float tExit, RayOutput& out)
+    {
+        const CpuRenderParams& p = *s.params;
+        const BrickedVolume& volume = *s.volume;
+        const int lastStep = min(p.maxSteps - 1, static_cast<int>((tExit - tEnter) / p.stepSize));
+
+        double sum = 0.0;
+        int count = 0;
+        size_t lastBrick = static_cast<size_t>(-1);
+
+        int i = 0;
+        while (i <= lastStep) {
+            Vec3 pos = origin + dir * (tEnter + i * p.stepSize);
+            int brick[3];
+            size_t brickIndex = BrickAt(s, pos, brick);
+            if (brickIndex != lastBrick) {
+                lastBrick = brickIndex;
+                out.bricks++;
+                unsigned char low = volume.BrickMin(brickIndex);
+                if (low == volume.BrickMax(brickIndex)) {
+                    out.skipped++;
+                    int next = min(lastStep + 1, StepPastBrick(s, origin, dir, brick, tEnter, i));
+                    sum += static_cast<double>(next - i) * low * (1.0f / 255.0f);
+                    count += next - i;
+                    i = next;
+                    continue;
+                }
+            }
+
+            sum += FetchDensity<Filter>(s, pos);
+            out.samples++;
+            count++;
+            i++;
+        }
+        EndOfSpan(p, i, tEnter, tExit, out);
+
+        Color color = { 0.0f, 0.0f, 0.0f, 0.0f };
+        if (count == 0) {
+            return color;
+        }
+
+        out.depth = 0.5f * (tEnter + tExit);
+        color = ClassifyOpaque(s, static_cast<float>(sum / count));
+        if (ShowLabels) {
+            unsigned char label;
+            float tint = BlendLabel(s, origin + dir * out.depth, color, label);
+            out.AddLabel(label, tint);
+        }
+        return color;
+    }
+
+    // First hit of density >= isoValue. A brick whose maximum is below the
+    // isovalue is widened to the coarsest hierarchy node that is still below
+    // it and the whole node is stepped over; the crossing found by the fixed
+    // step is then refined by bisection before shading.
+    template <bool ShowLabels, int Filter>
+    Color MarchIsosurface(const RaySetup& s, Vec3 origin, Vec3 dir, float tEnter, float tExit, RayOutput& out)
+    {
+        const CpuRenderParams& p = *s.params;
+        const BrickedVolume& volume = *s.volume;
+        const float iso = p.isoValue;
+        if (volume.MaxValue() * (1.0f / 255.0f) < iso) {
+            return { 0.0f, 0.0f, 0.0f, 0.0f };
+        }
+
+        size_t lastBrick = static_cast<size_t>(-1);
+        int i = 0;
+        while (i < p.maxSteps) {
+            float t = tEnter + i * p.stepSize;
+            if (t > tExit) {
+                break;
+            }
+
+            Vec3 pos = origin + dir * t;
+            int node[3];
+            size_t nodeIndex = BrickAt(s, pos, node);
+            if (nodeIndex != lastBrick) {
+                lastBrick = nodeIndex;
+                out.bricks++;
+            }
+            if (volume.BrickMax(nodeIndex) * (1.0f / 255.0f) < iso) {
+                int level = 0;
+                while (level + 1 < BrickedVolume::RANGE_LEVELS) {
+                    int parent[3] = { node[0] >> 1, node[1] >> 1, node[2] >> 1 };
+                    size_t parentIndex = volume.NodeIndex(level + 1, parent[0], parent[1], parent[2]);
+                    if (volume.NodeMax(level + 1, parentIndex) * (1.0f / 255.0f) >= iso) {
+                        break;
+                    }
+                    node[0] = parent[0];
+                    node[1] = parent[1];
+                    node[2] = parent[2];
+                    level++;
+                }
+                out.skipped++;
+                i = StepPastBrick(s, origin, dir, node, tEnter, i, level);
+                continue;
+            }
+
+            out.samples++;
+            if (FetchDensity<Filter>(s, pos) >= iso) {
+                // Everything before this sample was below the isovalue, either
+                // sampled or inside a skipped node
+                out.depth = t;
+                if (i > 0) {
+                    float lo = t - p.stepSize;
+                    float hi = t;
+                    out.samples += 6;
+                    for (int k = 0; k < 6; k++) {
+                        float mid = 0.5f * (lo + hi);
+                        if (FetchDensity<Filter>(s, origin + dir * mid) >= iso) {
+                            hi = mid;
+                        }
+                        else {
+                            lo = mid;
+                        }
+                    }
+                    pos = origin + dir * hi;
+                    out.depth = hi;
+                }
+                out.termination = RAY_SURFACE;
+                return ShadeSurface<ShowLabels, Filter>(s, pos, dir, out);
+            }
+            i++;
+        }
+        EndOfSpan(p, i, tEnter, tExit, out);
+        return { 0.0f, 0.0f, 0.0f, 0.0f };
+    }
+
+    // Bilinear lookup in the pre-integrated segment table
+    inline Color SegmentColor(const RaySetup& s, float front, float back)
+    {
+        const int size = TransferFunction::TABLE_SIZE;
+        float x = Saturate(front) * (size - 1);
+        float y = Saturate(back) * (size - 1);
+        int x0 = min(static_cast<int>(x), size - 2);
+        int y0 = min(static_cast<int>(y), size - 2);
+        float fx = x - x0;
+        float fy = y - y0;
+        const float* e00 = s.params->preIntegrated + (static_cast<size_t>(y0) * size + x0) * 4;
+        const float* e10 = e00 + 4;
+        const float* e01 = e00 + size * 4;
+        const float* e11 = e01 + 4;
+        float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy), w01 = (1.0f - fx) * fy, w11 = fx * fy;
+        return { e00[0] * w00 + e10[0] * w10 + e01[0] * w01 + e11[0] * w11,
+            e00[1] * w00 + e10[1] * w10 + e01[1] * w01 + e11[1] * w11,
+            e00[2] * w00 + e10[2] * w10 + e01[2] * w01 + e11[2] * w11,
+            e00[3] * w00 + e10[3] * w10 + e01[3] * w01 + e11[3] * w11 };
+    }
+
+    // Composites the segments between consecutive samples from the
+    // pre-integrated table, which captures transfer-function detail between
+    // samples and so tolerates larger steps. Labels tint the segment colour
+    // at its front sample.
+    template <bool ShowLabels, int Filter, bool Shaded>
+    Color MarchPreIntegrated(const RaySetup& s, Vec3 origin, Vec3 dir, float tEnter, float tExit, RayOutput& out)
+    {
+        const CpuRenderParams& p = *s.params;
+        const unsigned char visibleMask = ShowLabels ? BRICK_VISIBLE | BRICK_LABELLED : BRICK_VISIBLE;
+        Color color = { 0.0f, 0.0f, 0.0f, 0.0f };
+        size_t lastBrick = static_cast<size_t>(-1);
+
+        float front = FetchDensity<Filter>(s, origin + dir * tEnter);
+        out.samples++;
+        int i = 1;
+        while (i < p.maxSteps) {
+            float t = tEnter + i * p.stepSize;
+            if (t > tExit) {
+                break;
+            }
+
+            Vec3 pos = origin + dir * t;
+            if (p.brickFlags) {
+                int brick[3];
+                size_t brickIndex = BrickAt(s, pos, brick);
+                if (brickIndex != lastBrick) {
+                    lastBrick = brickIndex;
+                    out.bricks++;
+                    if (!(p.brickFlags[brickIndex] & visibleMask)) {
+                        // The segment leading out of the skipped brick starts
+                        // at its last sample
+                        out.skipped++;
+                        i = StepPastBrick(s, origin, dir, brick, tEnter, i);
+                        front = FetchDensity<Filter>(s, origin + dir * (tEnter + (i - 1) * p.stepSize));
+                        out.samples++;
+                        continue;
+                    }
+                }
+            }
+
+            float back = FetchDensity<Filter>(s, pos);
+            out.samples++;
+            Color segment = SegmentColor(s, front, back);
+            unsigned char label = 0;
+            float tint = 0.0f;
+            float lit = 1.0f;
+            if ((ShowLabels || Shaded) && segment.a > 0.0f) {
+                Vec3 frontPos = origin + dir * (t - p.stepSize);
+                Color straight = { segment.r / segment.a, segment.g / segment.a, segment.b / segment.a, segment.a };
+                if (ShowLabels) {
+                    tint = BlendLabel(s, frontPos, straight, label);
+                }
+                if (Shaded) {
+                    float gradient[4];
+                    FetchGradient<Filter>(s, frontPos, gradient);
+                    lit = ShadeSample(s, gradient, dir, straight);
+                }
+                segment = { straight.r * straight.a, straight.g * straight.a, straight.b * straight.a, straight.a };
+            }
+
+            float transmittance = 1.0f - color.a;
+            if (segment.a > 0.0f && color.a < HIT_OPACITY) {
+                out.depth = t;
+            }
+            if (ShowLabels) {
+                out.AddLabel(label, transmittance * segment.a * tint * lit);
+            }
+            color.r += transmittance * segment.r;
+            color.g += transmittance * segment.g;
+            color.b += transmittance * segment.b;
+            color.a += transmittance * segment.a;
+            if (color.a >= 0.95f) {
+                out.termination = RAY_OPAQUE;
+                break;
+            }
+
+            front = back;
+            i++;
+        }
+
+        EndOfSpan(p, i, tEnter, tExit, out);
+        return color;
+    }
+
+    // Internal variants of the volume mode
+    const int MODE_PRE_INTEGRATED = RENDER_MODE_COUNT;
+    const int MODE_SHADED = RENDER_MODE_COUNT + 1;
+    const int MODE_PRE_INTEGRATED_SHADED = RENDER_MODE_COUNT + 2;
+    const int MODE_2D = RENDER_MODE_COUNT + 3;
+    const int MODE_2D_SHADED = RENDER_MODE_COUNT + 4;
+
+    template <int Mode, bool ShowLabels, int Filter>
+    inline Color MarchRay(const RaySetup& s, Vec3 origin, Vec3 dir, float tEnter, float tExit, RayOutput& out)
+    {
+        switch (Mode) {
+        case RENDER_MODE_MIP: return MarchExtreme<true, ShowLabels, Filter>(s, origin, dir, tEnter, tExit, out);
+        case RENDER_MODE_MINIP: return MarchExtreme<false, ShowLabels, Filter>(s, origin, dir, tEnter, tExit, out);
+        case RENDER_MODE_AVERAGE: return MarchAverage<ShowLabels, Filter>(s, origin, dir, tEnter, tExit, out);
+        case RENDER_MODE_ISOSURFACE: return MarchIsosurface<ShowLabels, Filter>(s, origin, dir, tEnter, tExit, out);
+        case MODE_PRE_INTEGRATED: return MarchPreIntegrated<ShowLabels, Filter, false>(s, origin, dir, tEnter, tExit, out);
+        case MODE_PRE_INTEGRATED_SHADED: return MarchPreIntegrated<ShowLabels, Filter, true>(s, origin, dir, tEnter, tExit, out);
+        case MODE_SHADED: return MarchComposite<ShowLabels, Filter, true, false>(s, origin, dir, tEnter, tExit, out);
+        case MODE_2D: return MarchComposite<ShowLabels, Filter, false, true>(s, origin, dir, tEnter, tExit, out);
+        case MODE_2D_SHADED: return MarchComposite<ShowLabels, Filter, true, true>(s, origin, dir, tEnter, tExit, out);
+        default: return MarchComposite<ShowLabels, Filter, false, false>(s, origin, dir, tEnter, tExit, out);
+        }
+    }
+
+    // Ray interval inside the content box, optional circular footprint and
+    // clip planes, identical to IntersectBox/IntersectCircle/ClipSpan in
+    // PixelShader.hlsl
+    bool ClipRay(const RaySetup& s, Vec3 origin, Vec3 dir, float& tEnter, float& tExit)
+    {
+        const float o[3] = { origin.x, origin.y, origin.z };
+        const float d[3] = { dir.x, dir.y, dir.z };
+        tEnter = 0.0f;
+        tExit = 1e30f;
+        for (int axis = 0; axis < 3; axis++) {
+            float safe = fabsf(d[axis]) < 1e-6f ? 1e-6f : d[axis];
+            float t0 = (s.boxMin[axis] - o[axis]) / safe;
+            float t1 = (s.boxMax[axis] - o[axis]) / safe;
+            tEnter = max(tEnter, min(t0, t1));
+            tExit = min(tExit, max(t0, t1));
+        }
+
+        if (s.hasCircle) {
+            float ox = origin.x * s.dims[0] - s.circleX;
+            float oy = origin.y * s.dims[1] - s.circleY;
+            float dx = dir.x * s.dims[0];
+            float dy = dir.y * s.dims[1];
+            float a = dx * dx + dy * dy;
+            float c = ox * ox + oy * oy - s.radius * s.radius;
+            if (a < 1e-8f) {
+                if (c > 0.0f) {
+                    return false;
+                }
+            }
+            else {
+                float b = ox * dx + oy * dy;
+                float disc = b * b - a * c;
+                if (disc < 0.0f) {
+                    return false;
+                }
+                float root = sqrtf(disc);
+                tEnter = max(tEnter, (-b - root) / a);
+                tExit = min(tExit, (-b + root) / a);
+            }
+        }
+
+        // Each plane bounds the interval from one side
+        for (int i = 0; i < s.clipPlaneCount; i++) {
+            const float* plane = s.clipPlanes[i];
+            float distance = plane[0] * origin.x + plane[1] * origin.y + plane[2] * origin.z + plane[3];
+            float rate = plane[0] * dir.x + plane[1] * dir.y + plane[2] * dir.z;
+            if (fabsf(rate) < 1e-8f) {
+                if (distance < 0.0f) {
+                    return false;
+                }
+            }
+            else if (rate > 0.0f) {
+                tEnter = max(tEnter, -distance / rate);
+            }
+            else {
+                tExit = min(tExit, -distance / rate);
+            }
+        }
+
+        return tEnter < tExit;
+    }
+
+    inline unsigned char ToByte(float v)
+    {
+        return static_cast<unsigned char>(Saturate(v) * 255.0f + 0.5f);
+    }
+
+    // Splits a pixel's colour into its quantized material weights and the
+    // rest, so recompositing with unchanged materials gives the same colour
+    void StoreDeepPixel(const RaySetup& s, const RayOutput& out, Color color, DeepPixel& deep)
+    {
+        deep.rest[0] = color.r;
+        deep.rest[1] = color.g;
+        deep.rest[2] = color.b;
+        if (out.labelCount > DEEP_PIXEL_LABELS) {
+            deep.count = DEEP_PIXEL_OVERFLOW;
+            return;
+        }
+
+        deep.count = static_cast<unsigned char>(out.labelCount);
+        for (int i = 0; i < out.labelCount; i++) {
+            unsigned short weight = static_cast<unsigned short>(Saturate(out.weights[i]) * 65535.0f + 0.5f);
+            const float* mat = s.params->materials + 4 * out.labels[i];
+            float w = weight * (1.0f / 65535.0f);
+            deep.rest[0] -= w * mat[0];
+            deep.rest[1] -= w * mat[1];
+            deep.rest[2] -= w * mat[2];
+            deep.labels[i] = out.labels[i];
+            deep.weights[i] = weight;
+        }
+    }
+
+    template <int Mode, bool ShowLabels, int Filter>
+    void MarchRow(const RaySetup& s, int y, unsigned char* row)
+    {
+        const size_t rowStart = static_cast<size_t>(y) * s.width;
+        float ndcY = 1.0f - 2.0f * (y + 0.5f) / s.height;
+        for (int x = 0; x < s.width; x++) {
+            if (s.mask && !s.mask[rowStart + x]) {
+                continue;
+            }
+
+            float ndcX = 2.0f * (x + 0.5f) / s.width - 1.0f;
+            Vec3 dir = Normalize(s.forward + s.right * ndcX + s.up * ndcY);
+
+            Color color = { 0.0f, 0.0f, 0.0f, 0.0f };
+            RayOutput ray;
+            ray.depth = -1.0f;
+            ray.samples = 0;
+            ray.bricks = 0;
+            ray.skipped = 0;
+            ray.termination = RAY_MISSED;
+            ray.traceLabels = s.deep != nullptr;
+            ray.labelCount = 0;
+            float tEnter, tExit;
+            if (ClipRay(s, s.origin, dir, tEnter, tExit)) {
+                ray.termination = RAY_EXITED;
+                color = MarchRay<Mode, ShowLabels, Filter>(s, s.origin, dir, tEnter, tExit, ray);
+                if (color.a <= 0.0f) {
+                    ray.depth = tExit;
+                }
+            }
+            if (s.depth) {
+                s.depth[rowStart + x] = ray.depth;
+            }
+            if (s.deep) {
+                StoreDeepPixel(s, ray, color, s.deep[rowStart + x]);
+            }
+            if (s.costs) {
+                RayCost& cost = s.costs[rowStart + x];
+                cost.samples = ray.samples;
+                cost.bricks = ray.bricks;
+                cost.skipped = ray.skipped;
+                cost.termination = ray.termination;
+            }
+
+            unsigned char* out = row + 4 * x;
+            out[0] = ToByte(color.r);
+            out[1] = ToByte(color.g);
+            out[2] = ToByte(color.b);
+            out[3] = ToByte(color.a);
+        }
+    }
+
+    typedef void (*RowKernel)(const RaySetup& s, int y, unsigned char* row);
+
+#define ROW_KERNELS_FOR_MODE(mode) \
+    { { &MarchRow<mode, false, FILTER_NEAREST>, &MarchRow<mode, false, FILTER_LINEAR> }, \
+      { &MarchRow<mode, true, FILTER_NEAREST>, &MarchRow<mode, true, FILTER_LINEAR> } }
+
+    // Indexed by [renderMode][showLabels][filter]
+    const RowKernel s_rowKernels[RENDER_MODE_COUNT][2][FILTER_COUNT] =
+    {
+        ROW_KERNELS_FOR_MODE(RENDER_MODE_VOLUME),
+        ROW_KERNELS_FOR_MODE(RENDER_MODE_MIP),
+        ROW_KERNELS_FOR_MODE(RENDER_MODE_ISOSURFACE),
+        ROW_KERNELS_FOR_MODE(RENDER_MODE_MINIP),
+        ROW_KERNELS_FOR_MODE(RENDER_MODE_AVERAGE)
+    };
+
+    // Volume mode variants, indexed by [classification][shaded][showLabels][filter]
+    // where classification is 0 = 1D table, 1 = pre-integrated, 2 = 2D table
+    const RowKernel s_volumeKernels[3][2][2][FILTER_COUNT] =
+    {
+        { ROW_KERNELS_FOR_MODE(RENDER_MODE_VOLUME), ROW_KERNELS_FOR_MODE(MODE_SHADED) },
+        { ROW_KERNELS_FOR_MODE(MODE_PRE_INTEGRATED), ROW_KERNELS_FOR_MODE(MODE_PRE_INTEGRATED_SHADED) },
+        { ROW_KERNELS_FOR_MODE(MODE_2D), ROW_KERNELS_FOR_MODE(MODE_2D_SHADED) }
+    };
+
+#undef ROW_KERNELS_FOR_MODE
+
+    // s_volumeKernels classification and shading of each KernelVariant
+    const int VARIANT_CLASSIFICATION[KERNEL_VARIANT_COUNT] = { 0, 1, 0, 1, 2, 2 };
+    const int VARIANT_SHADED[KERNEL_VARIANT_COUNT] = { 0, 0, 1, 1, 0, 1 };
+
+    bool CanBlendLabels(const BrickedVolume& volume, const BrickedVolume* labels, const CpuRenderParams& params)
+    {
+        return labels && !labels->IsEmpty() && params.materials
+            && labels->Width() == volume.Width()
+            && labels->Height() == volume.Height()
+            && labels->Depth() == volume.Depth();
+    }
+
+    // Look-at basis matching XMMatrixLookAtLH / XMMatrixPerspectiveFovLH, with
+    // the origin in texture space and right/up scaled to the image plane
+    void CameraBasis(const CpuCamera& camera, int width, int height, Vec3& origin, Vec3& forward, Vec3& right, Vec3& up)
+    {
+        Vec3 position = { camera.position[0], camera.position[1], camera.position[2] };
+        Vec3 target = { camera.target[0], camera.target[1], camera.target[2] };
+        Vec3 upHint = { camera.up[0], camera.up[1], camera.up[2] };
+        forward = Normalize(target - position);
+        Vec3 unitRight = Normalize(Cross(upHint, forward));
+        Vec3 unitUp = Cross(forward, unitRight);
+        float tanHalfFov = tanf(0.5f * camera.fovY);
+        float aspect = static_cast<float>(width) / static_cast<float>(height);
+
+        origin = (position + Vec3{ 1.0f, 1.0f, 1.0f }) * 0.5f;
+        right = unitRight * (tanHalfFov * aspect);
+        up = unitUp * tanHalfFov;
+    }
+
+    void SetupFrame(RaySetup& s, const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera, int width, int height)
+    {
+        s.volume = &volume;
+        s.labels = labels;
+        s.params = &params;
+        s.gradients = (params.shading != SHADING_NONE || params.transfer2D) && params.gradients && !params.gradients->IsEmpty()
+            && params.gradients->Width() == volume.Width()
+            && params.gradients->Height() == volume.Height()
+            && params.gradients->Depth() == volume.Depth() ? params.gradients : nullptr;
+        s.phong = s.gradients && (params.shading & SHADING_PHONG) != 0;
+        s.gradientOpacity = s.gradients && (params.shading & SHADING_GRADIENT_OPACITY) != 0;
+        s.table2D = s.gradients ? params.transfer2D : nullptr;
+        if (params.transferFunction) {
+            memcpy(s.tableStorage, params.transferFunction, sizeof(s.tableStorage));
+        }
+        else {
+            TransferFunction window;
+            window.SetWindow(params.brightness, params.contrast, params.opacity);
+            memcpy(s.tableStorage, window.Table(), sizeof(s.tableStorage));
+        }
+        float stepScale = params.stepSize / BASE_STEP_SIZE;
+        if (stepScale != 1.0f) {
+            for (int i = 0; i < TransferFunction::TABLE_SIZE; i++) {
+                float& alpha = s.tableStorage[i * 4 + 3];
+                alpha = 1.0f - powf(1.0f - min(alpha, 1.0f), stepScale);
+            }
+        }
+        s.table = s.tableStorage;
+        s.dims[0] = static_cast<float>(volume.Width());
+        s.dims[1] = static_cast<float>(volume.Height());
+        s.dims[2] = static_cast<float>(volume.Depth());
+        s.maxIndex[0] = volume.Width() - 1;
+        s.maxIndex[1] = volume.Height() - 1;
+        s.maxIndex[2] = volume.Depth() - 1;
+        s.brickDims[0] = s.dims[0] / BrickedVolume::BRICK_SIZE;
+        s.brickDims[1] = s.dims[1] / BrickedVolume::BRICK_SIZE;
+        s.brickDims[2] = s.dims[2] / BrickedVolume::BRICK_SIZE;
+        s.maxBrick[0] = volume.BricksX() - 1;
+        s.maxBrick[1] = volume.BricksY() - 1;
+        s.maxBrick[2] = volume.BricksZ() - 1;
+        s.width = width;
+        s.height = height;
+        s.mask = nullptr;
+        s.depth = nullptr;
+        s.deep = nullptr;
+        s.costs = nullptr;
+        CameraBasis(camera, width, height, s.origin, s.forward, s.right, s.up);
+
+        const ContentBounds& b = params.bounds;
+        s.boxMin[0] = b.minX / s.dims[0];
+        s.boxMin[1] = b.minY / s.dims[1];
+        s.boxMin[2] = b.minZ / s.dims[2];
+        s.boxMax[0] = (b.maxX + 1) / s.dims[0];
+        s.boxMax[1] = (b.maxY + 1) / s.dims[1];
+        s.boxMax[2] = (b.maxZ + 1) / s.dims[2];
+        s.hasCircle = b.hasCircle;
+        s.circleX = b.centerX;
+        s.circleY = b.centerY;
+        s.radius = b.radius;
+
+        // Voxel-space planes scaled to texture coordinates (x = u * width)
+        s.clipPlaneCount = max(0, min(params.clipPlaneCount, MAX_CLIP_PLANES));
+        for (int i = 0; i < s.clipPlaneCount; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                s.clipPlanes[i][axis] = params.clipPlanes[i][axis] * s.dims[axis];
+            }
+            s.clipPlanes[i][3] = params.clipPlanes[i][3];
+        }
+    }
+
+    void RunKernel(const RaySetup& s, RowKernel kernel, unsigned char* rgba)
+    {
+        ParallelForEach(0, s.height, [&](int, int y) {
+            kernel(s, y, rgba + static_cast<size_t>(y) * s.width * 4);
+        });
+    }
+
+    // Kernel for the frame's settings, after SetupFrame
+    RowKernel SelectKernel(const RaySetup& s, const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params)
+    {
+        int mode = params.renderMode >= 0 && params.renderMode < RENDER_MODE_COUNT ? params.renderMode : RENDER_MODE_VOLUME;
+        int blend = params.showLabels && CanBlendLabels(volume, labels, params) ? 1 : 0;
+        int filter = params.filter == FILTER_NEAREST ? FILTER_NEAREST : FILTER_LINEAR;
+
+        if (mode == RENDER_MODE_VOLUME) {
+            int classification = s.table2D ? 2 : (params.preIntegrated ? 1 : 0);
+            int shaded = s.phong || s.gradientOpacity ? 1 : 0;
+            return s_volumeKernels[classification][shaded][blend][filter];
+        }
+        return s_rowKernels[mode][blend][filter];
+    }
+
+    bool SameBounds(const ContentBounds& a, const ContentBounds& b)
+    {
+        return a.minX == b.minX && a.minY == b.minY && a.minZ == b.minZ
+            && a.maxX == b.maxX && a.maxY == b.maxY && a.maxZ == b.maxZ
+            && a.hasCircle == b.hasCircle
+            && (!a.hasCircle || (a.centerX == b.centerX && a.centerY == b.centerY && a.radius == b.radius));
+    }
+}
+
+void CpuRayCaster::Render(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera& camera,
+    int width, int height, unsigned char* rgba)
+{
+    if (volume.IsEmpty() || params.bounds.IsEmpty()) {
+        memset(rgba, 0, static_cast<size_t>(width) * height * 4);
+        return;
+    }
+
+    RaySetup setup;
+    SetupFrame(setup, volume, labels, params, camera, width, height);
+    RunKernel(setup, SelectKernel(setup, volume, labels, params), rgba);
+}
+
+void CpuRayCaster::RenderMasked(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera& camera,
+    int width, int height, const unsigned char* mask, unsigned char* rgba, float* depth, DeepPixel* deep)
+{
+    if (volume.IsEmpty() || params.bounds.IsEmpty()) {
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            if (!mask || mask[i]) {
+                memset(rgba + i * 4, 0, 4);
+                if (depth) {
+                    depth[i] = -1.0f;
+                }
+                if (deep) {
+                    memset(&deep[i], 0, sizeof(DeepPixel));
+                }
+            }
+        }
+        return;
+    }
+
+    RaySetup setup;
+    SetupFrame(setup, volume, labels, params, camera, width, height);
+    setup.mask = mask;
+    setup.depth = depth;
+    setup.deep = deep;
+    RunKernel(setup, SelectKernel(setup, volume, labels, params), rgba);
+}
+
+CpuProjection CpuRayCaster::GetProjection(const CpuCamera& camera, int width, int height)
+{
+    Vec3 origin, forward, right, up;
+    CameraBasis(camera, width, height, origin, forward, right, up);
+
+    CpuProjection projection;
+    const Vec3* vectors[4] = { &origin, &forward, &right, &up };
+    float* outputs[4] = { projection.origin, projection.forward, projection.right, projection.up };
+    for (int i = 0; i < 4; i++) {
+        outputs[i][0] = vectors[i]->x;
+        outputs[i][1] = vectors[i]->y;
+        outputs[i][2] = vectors[i]->z;
+    }
+    return projection;
+}
+
+void CpuRayCaster::RenderCost(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera& camera,
+    int width, int height, RayCost* costs)
+{
+    if (volume.IsEmpty() || params.bounds.IsEmpty()) {
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            costs[i] = { 0, 0, 0, RAY_MISSED };
+        }
+        return;
+    }
+
+    RaySetup setup;
+    SetupFrame(setup, volume, labels, params, camera, width, height);
+    setup.costs = costs;
+    std::vector<unsigned char> image(static_cast<size_t>(width) * height * 4);
+    RunKernel(setup, SelectKernel(setup, volume, labels, params), image.data());
+}
+
+void CpuRayCaster::CostToColor(const RayCost* costs, int width, int height, int maxSteps, unsigned char* rgba)
+{
+    // Ramp stops from cheap to expensive
+    const float ramp[4][3] = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } };
+    const float scale = 1.0f / static_cast<float>(max(1, maxSteps));
+
+    ParallelForEach(0, height, [&](int, int y) {
+        for (int x = 0; x < width; x++) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            const RayCost& cost = costs[i];
+            unsigned char* out = rgba + i * 4;
+            float color[3] = { 0.0f, 0.0f, 0.0f };
+            if (cost.termination == RAY_STEP_LIMIT) {
+                color[0] = 1.0f;
+                color[2] = 1.0f;
+            }
+            else if (cost.termination != RAY_MISSED) {
+                // Square root spreads the cheap end, where most rays are
+                float position = sqrtf(Saturate(cost.samples * scale)) * 3.0f;
+                int stop = min(static_cast<int>(position), 2);
+                float f = position - stop;
+                for (int c = 0; c < 3; c++) {
+                    color[c] = ramp[stop][c] + (ramp[stop + 1][c] - ramp[stop][c]) * f;
+                }
+            }
+            out[0] = ToByte(color[0]);
+            out[1] = ToByte(color[1]);
+            out[2] = ToByte(color[2]);
+            out[3] = 255;
+        }
+    });
+}
+
+int CpuRayCaster::GetKernelCount()
+{
+    return (RENDER_MODE_COUNT + KERNEL_VARIANT_COUNT - 1) * 2 * FILTER_COUNT;
+}
+
+void CpuRayCaster::DescribeKernel(int index, int* renderMode, int* variant, bool* showLabels, int* filter)
+{
+    *filter = index % FILTER_COUNT;
+    *showLabels = (index / FILTER_COUNT) % 2 != 0;
+    int row = index / (FILTER_COUNT * 2);
+    *renderMode = row < RENDER_MODE_COUNT ? row : RENDER_MODE_VOLUME;
+    *variant = row < RENDER_MODE_COUNT ? KERNEL_BASE : row - RENDER_MODE_COUNT + 1;
+}
+
+int CpuRayCaster::Benchmark(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera& camera,
+    int width, int height, double* msPerFrame, int capacity)
+{
+    if (volume.IsEmpty() || params.bounds.IsEmpty()) {
+        return 0;
+    }
+
+    RaySetup setup;
+    SetupFrame(setup, volume, labels, params, camera, width, height);
+    bool canBlend = CanBlendLabels(volume, labels, params);
+
+    // Shaded variants light the samples even if the frame's shading is off
+    CpuRenderParams litParams = params;
+    if (litParams.shading == SHADING_NONE) {
+        litParams.shading = SHADING_PHONG;
+    }
+    RaySetup shaded;
+    SetupFrame(shaded, volume, labels, litParams, camera, width, height);
+
+    std::vector<unsigned char> image(static_cast<size_t>(width) * height * 4);
+    int count = min(capacity, GetKernelCount());
+    for (int i = 0; i < count; i++) {
+        int mode, variant, filter;
+        bool showLabels;
+        DescribeKernel(i, &mode, &variant, &showLabels, &filter);
+        int classification = VARIANT_CLASSIFICATION[variant];
+        bool lit = VARIANT_SHADED[variant] != 0;
+
+        // Label variants need a label volume to be meaningful, and the
+        // volume variants their gradients and tables
+        if ((showLabels && !canBlend) || (lit && !shaded.gradients)
+            || (classification == 1 && !params.preIntegrated) || (classification == 2 && !shaded.table2D)) {
+            msPerFrame[i] = -1.0;
+            continue;
+        }
+
+        RowKernel kernel = variant == KERNEL_BASE ? s_rowKernels[mode][showLabels ? 1 : 0][filter]
+            : s_volumeKernels[classification][lit ? 1 : 0][showLabels ? 1 : 0][filter];
+        auto start = std::chrono::steady_clock::now();
+        RunKernel(lit || classification == 2 ? shaded : setup, kernel, image.data());
+        msPerFrame[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return count;
+}
+
+bool SameRenderSettings(const CpuRenderParams& a, const CpuRenderParams& b)
+{
+    if (a.renderMode != b.renderMode || a.filter != b.filter || a.showLabels != b.showLabels
+        || a.opacity != b.opacity || a.brightness != b.brightness || a.contrast != b.contrast
+        || a.isoValue != b.isoValue || a.stepSize != b.stepSize || a.maxSteps != b.maxSteps
+        || !SameBounds(a.bounds, b.bounds)
+        || a.materials != b.materials || a.transferFunction != b.transferFunction
+        || a.brickFlags != b.brickFlags || a.preIntegrated != b.preIntegrated
+        || a.shading != b.shading || a.gradients != b.gradients || a.transfer2D != b.transfer2D
+        || a.clipPlaneCount != b.clipPlaneCount) {
+        return false;
+    }
+    for (int i = 0; i < a.clipPlaneCount && i < MAX_CLIP_PLANES; i++) {
+        for (int c = 0; c < 4; c++) {
+            if (a.clipPlanes[i][c] != b.clipPlanes[i][c]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SameCamera(const CpuCamera& a, const CpuCamera& b)
+{
+    for (int i = 0; i < 3; i++) {
+        if (a.position[i] != b.position[i] || a.target[i] != b.target[i] || a.up[i] != b.up[i]) {
+            return false;
+        }
+    }
+    return a.fovY == b.fovY;
+}
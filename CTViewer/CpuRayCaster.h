@@ -0,0 +1,205 @@
+// CpuRayCaster.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include "GradientVolume.h"
+#include "TransferFunction.h"
+#include "VolumeBounds.h"
+
+// Render modes shared with the pixel shader (RenderParams.renderMode)
+enum RenderMode
+{
+    RENDER_MODE_VOLUME = 0,
+    RENDER_MODE_MIP = 1,
+    RENDER_MODE_ISOSURFACE = 2,
+    RENDER_MODE_MINIP = 3,
+    RENDER_MODE_AVERAGE = 4,
+    RENDER_MODE_COUNT
+};
+
+// Sampling used by the shader; transfer-function alphas are defined per
+// BASE_STEP_SIZE and corrected for other step sizes
+const float BASE_STEP_SIZE = 0.005f;
+const int BASE_MAX_STEPS = 512;
+
+// Clip planes applied to every ray (the shader's cbuffer holds this many)
+const int MAX_CLIP_PLANES = 6;
+
+// Gradient-volume effects in the volume mode (bit flags)
+enum ShadingFlags
+{
+    SHADING_NONE = 0,
+    SHADING_PHONG = 1,              // headlight Phong lighting
+    SHADING_GRADIENT_OPACITY = 2    // opacity scaled by gradient magnitude
+};
+
+// Density reconstruction filter
+enum SampleFilter
+{
+    FILTER_NEAREST = 0,
+    FILTER_LINEAR = 1,
+    FILTER_COUNT
+};
+
+// Volume mode kernels besides the point-sampled 1D table, in the order
+// Benchmark measures them
+enum KernelVariant
+{
+    KERNEL_BASE = 0,
+    KERNEL_PRE_INTEGRATED = 1,
+    KERNEL_SHADED = 2,
+    KERNEL_PRE_INTEGRATED_SHADED = 3,
+    KERNEL_2D = 4,
+    KERNEL_2D_SHADED = 5,
+    KERNEL_VARIANT_COUNT
+};
+
+// Camera in the renderer's world space, where the volume fills [-1, 1]^3
+struct CpuCamera
+{
+    float position[3];
+    float target[3];
+    float up[3];
+    float fovY;
+};
+
+// Everything a frame needs besides the camera; mirrors RenderParams
+struct CpuRenderParams
+{
+    int renderMode;
+    int filter;
+    bool showLabels;
+    float opacity;
+    float brightness;
+    float contrast;
+    float isoValue;             // normalized density for RENDER_MODE_ISOSURFACE
+    float stepSize;             // texture-space step, BASE_STEP_SIZE * the renderer's step scale
+    int maxSteps;
+    ContentBounds bounds;       // rays are clipped to this box and circle
+    const float* materials;     // 256 RGBA entries, may be null without labels
+    const float* transferFunction;      // TransferFunction::Table(), null for the brightness/contrast window
+    const unsigned char* brickFlags;    // BrickVisibility per brick, null to sample every brick
+    const float* preIntegrated;         // segment table for stepSize (BuildPreIntegrated), null to composite point samples
+    int shading;                        // ShadingFlags, ignored without gradients
+    const GradientVolume* gradients;    // precomputed gradients, may be null
+    const float* transfer2D;            // density x magnitude table for stepSize (Build2D); replaces the
+                                        // 1D table and pre-integration in the volume mode when gradients are set
+    float clipPlanes[MAX_CLIP_PLANES][4];   // voxel space, a*x + b*y + c*z + d >= 0 is kept
+    int clipPlaneCount;
+};
+
+// Pinhole projection the rays are generated from, in the texture space they
+// march in ([0, 1]^3). The ray through pixel (x, y) leaves origin along
+// normalize(forward + right * ndcX + up * ndcY), where ndcX = 2 (x + 0.5) /
+// width - 1 and ndcY = 1 - 2 (y + 0.5) / height, and its hit distances are
+// measured along that unit direction.
+struct CpuProjection
+{
+    float origin[3];
+    float forward[3];
+    float right[3];     // scaled by tan(fovY / 2) * aspect
+    float up[3];        // scaled by tan(fovY / 2)
+};
+
+// Distinct labels a deep pixel records before it overflows
+const int DEEP_PIXEL_LABELS = 4;
+const unsigned char DEEP_PIXEL_OVERFLOW = 0xFF;
+
+// How label materials entered one pixel of a CPU frame. While material
+// alphas stay the same, the pixel's RGB is rest + sum(weights[i] / 65535 *
+// material[labels[i]].rgb), so new material colours can be recomposited
+// without ray casting. Labels reached with zero weight are listed too,
+// since changing their alpha does change the pixel.
+struct DeepPixel
+{
+    float rest[3];
+    unsigned short weights[DEEP_PIXEL_LABELS];
+    unsigned char labels[DEEP_PIXEL_LABELS];
+    unsigned char count;    // entries used, DEEP_PIXEL_OVERFLOW when more labels were reached
+};
+
+// Why a ray stopped marching (RayCost::termination)
+enum RayTermination
+{
+    RAY_MISSED = 0,         // the ray never entered the content box, circle or clip planes
+    RAY_EXITED = 1,         // marched to the end of its span
+    RAY_OPAQUE = 2,         // early termination on accumulated opacity
+    RAY_STEP_LIMIT = 3,     // maxSteps ran out before the end of the span
+    RAY_EXTREME = 4,        // MIP/MinIP reached the volume's global extreme
+    RAY_SURFACE = 5,        // isosurface found
+    RAY_TERMINATION_COUNT
+};
+
+// What one ray of a CPU frame cost
+struct RayCost
+{
+    int samples;        // density fetches, including isosurface refinement
+    int bricks;         // bricks (hierarchy nodes for isosurfaces) entered
+    int skipped;        // entered bricks stepped over without sampling
+    int termination;    // RayTermination
+};
+
+// Whether two frames' settings produce the same image from the same camera.
+// Tables are compared by pointer, not contents.
+bool SameRenderSettings(const CpuRenderParams& a, const CpuRenderParams& b);
+bool SameCamera(const CpuCamera& a, const CpuCamera& b);
+
+// Multithreaded CPU ray caster producing the same image as PixelShader.hlsl.
+// Every combination of render mode, label blending and filter is a separate
+// template instantiation picked from a dispatch table once per frame, so the
+// per-sample loop has no branches on those settings. Volume mode with a
+// pre-integrated table composites whole segments between samples instead.
+class CpuRayCaster
+{
+public:
+    // Writes width * height RGBA8 pixels, premultiplied over black
+    static void Render(const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera,
+        int width, int height, unsigned char* rgba);
+
+    // Render restricted to the pixels whose mask byte is non-zero (all when
+    // mask is null); other pixels of rgba are left untouched. Where depth is
+    // non-null each cast pixel also gets its ray's hit distance: the first
+    // isosurface crossing, the MIP/MinIP sample, the point where compositing
+    // passes half opacity or the span middle for averages. Rays that cross
+    // the content without a visible sample report where they leave it, and
+    // rays that miss it entirely report -1. Where deep is non-null each cast
+    // pixel also records its label materials.
+    static void RenderMasked(const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera,
+        int width, int height, const unsigned char* mask, unsigned char* rgba, float* depth,
+        DeepPixel* deep = nullptr);
+
+    static CpuProjection GetProjection(const CpuCamera& camera, int width, int height);
+
+    // Casts every pixel like Render but stores what each ray cost instead
+    // of its colour
+    static void RenderCost(const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera,
+        int width, int height, RayCost* costs);
+
+    // False-colour view of a cost map: samples relative to maxSteps on a
+    // blue-green-yellow-red ramp, rays stopped by the step limit in
+    // magenta and misses in black
+    static void CostToColor(const RayCost* costs, int width, int height, int maxSteps, unsigned char* rgba);
+
+    // Number of kernel instantiations: the base kernel of every mode, then
+    // the other volume mode variants, each with both label settings and
+    // filters
+    static int GetKernelCount();
+
+    // Describes the kernel measured at index i by Benchmark, which is
+    // (row * 2 + showLabels) * FILTER_COUNT + filter; rows 0 to
+    // RENDER_MODE_COUNT - 1 are the modes' base kernels and the rest the
+    // volume mode from KERNEL_PRE_INTEGRATED on
+    static void DescribeKernel(int index, int* renderMode, int* variant, bool* showLabels, int* filter);
+
+    // Renders one frame with every kernel and stores milliseconds per frame,
+    // -1 for kernels the inputs cannot drive (labels, the gradient volume,
+    // or the pre-integrated or 2D table missing). Shaded variants use the
+    // frame's shading, or Phong if it is off. Returns the number of values
+    // written.
+    static int Benchmark(const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera,
+        int width, int height, double* msPerFrame, int capacity);
+};
@@ -0,0 +1,220 @@
+// DistanceTransform.cpp
+#include "pch.h"
+#include "DistanceTransform.h"
+#include "Morphology.h"
+#include "ParallelFor.h"
+#include <climits>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const float INFINITE_DISTANCE = std::numeric_limits<float>::infinity();
+
+    // Lines gathered together by the strided passes: 16 floats fill a
+    // cache line
+    const int LINE_BLOCK = 16;
+
+    // Scratch for the lower envelope of one line
+    struct Envelope
+    {
+        std::vector<int> vertices;
+        std::vector<float> heights;
+        std::vector<float> bounds;
+        std::vector<float> line;
+        std::vector<float> result;
+
+        explicit Envelope(int length)
+            : vertices(length), heights(length), bounds(length + 1), line(length), result(length)
+        {
+        }
+    };
+
+    // result[q] = min over p of weight * (q - p)^2 + f[p], skipping
+    // infinite f; weight is the squared spacing along the line. Parabola
+    // p is kept as its height f[p] + weight * p^2, so each intersection is
+    // one subtraction and one division. Heights are exact in float only
+    // while f[p] + weight * p^2 stays below 2^24.
+    void LowerEnvelope(Envelope& e, int n, float weight)
+    {
+        const float* f = e.line.data();
+        float* result = e.result.data();
+        int* v = e.vertices.data();
+        float* h = e.heights.data();
+        float* z = e.bounds.data();
+        const float w = weight;
+        const float twoW = 2.0f * weight;
+
+        int k = -1;
+        for (int q = 0; q < n; q++) {
+            if (f[q] == INFINITE_DISTANCE) {
+                continue;
+            }
+            float height = f[q] + w * q * q;
+            float s = -INFINITE_DISTANCE;
+            while (k >= 0) {
+                s = (height - h[k]) / (twoW * (q - v[k]));
+                if (s > z[k]) {
+                    break;
+                }
+                k--;
+                s = -INFINITE_DISTANCE;
+            }
+            k++;
+            v[k] = q;
+            h[k] = height;
+            z[k] = s;
+        }
+
+        if (k < 0) {
+            for (int q = 0; q < n; q++) {
+                result[q] = INFINITE_DISTANCE;
+            }
+            return;
+        }
+
+        z[k + 1] = INFINITE_DISTANCE;
+        for (int q = 0, j = 0; q < n; q++) {
+            while (z[j + 1] < q) {
+                j++;
+            }
+            float d = static_cast<float>(q - v[j]);
+            result[q] = w * d * d + f[v[j]];
+        }
+    }
+
+    // Runs the envelope over lines of length n starting at base + i *
+    // lineStep (i < count), elements stride apart; blocks of LINE_BLOCK
+    // neighbouring lines are gathered and scattered together
+    void TransformLines(float* base, int count, size_t lineStep, int n, size_t stride, float weight,
+        std::vector<Envelope>& scratch)
+    {
+        for (int first = 0; first < count; first += LINE_BLOCK) {
+            int lines = min(LINE_BLOCK, count - first);
+            for (int q = 0; q < n; q++) {
+                const float* src = base + q * stride + first * lineStep;
+                for (int i = 0; i < lines; i++) {
+                    scratch[i].line[q] = src[i * lineStep];
+                }
+            }
+            for (int i = 0; i < lines; i++) {
+                LowerEnvelope(scratch[i], n, weight);
+            }
+            for (int q = 0; q < n; q++) {
+                float* dst = base + q * stride + first * lineStep;
+                for (int i = 0; i < lines; i++) {
+                    dst[i * lineStep] = scratch[i].result[q];
+                }
+            }
+        }
+    }
+
+    // fetch(y, z, row) sets row[x] nonzero for the voxels to measure
+    template <typename Fetch>
+    void Transform(int width, int height, int depth, const float* spacing, bool squared, void* out, Fetch fetch)
+    {
+        const size_t sliceSize = static_cast<size_t>(width) * height;
+
+        // Squared output is counted in units of the finest axis, so physical
+        // spacings below one voxel do not round every distance to 0
+        const float unit = squared ? min(spacing[0], min(spacing[1], spacing[2])) : 1.0f;
+        const float axis[3] = { spacing[0] / unit, spacing[1] / unit, spacing[2] / unit };
+        const float weight[3] = { axis[0] * axis[0], axis[1] * axis[1], axis[2] * axis[2] };
+        float* distance = static_cast<float*>(out);
+
+        // Along x: squared distance to the nearest unmeasured voxel in the row
+        ParallelForEach(0, depth, [&](int, int z) {
+            std::vector<unsigned char> row(width);
+            for (int y = 0; y < height; y++) {
+                fetch(y, z, row.data());
+
+                float* line = distance + sliceSize * z + static_cast<size_t>(width) * y;
+                int last = -1;
+                for (int x = 0; x < width; x++) {
+                    if (!row[x]) {
+                        last = x;
+                        line[x] = 0.0f;
+                    }
+                    else {
+                        line[x] = last < 0 ? INFINITE_DISTANCE : weight[0] * (x - last) * (x - last);
+                    }
+                }
+                last = -1;
+                for (int x = width - 1; x >= 0; x--) {
+                    if (!row[x]) {
+                        last = x;
+                    }
+                    else if (last >= 0) {
+                        line[x] = min(line[x], weight[0] * (last - x) * (last - x));
+                    }
+                }
+            }
+        });
+
+        // Along y within each slice, then along z within each row of slices
+        ParallelForRange(0, depth, [&](int, int zBegin, int zEnd) {
+            std::vector<Envelope> scratch(LINE_BLOCK, Envelope(height));
+            for (int z = zBegin; z < zEnd; z++) {
+                TransformLines(distance + sliceSize * z, width, 1, height, width, weight[1], scratch);
+            }
+        });
+        ParallelForRange(0, height, [&](int, int yBegin, int yEnd) {
+            std::vector<Envelope> scratch(LINE_BLOCK, Envelope(depth));
+            for (int y = yBegin; y < yEnd; y++) {
+                TransformLines(distance + static_cast<size_t>(width) * y, width, 1, depth, sliceSize, weight[2], scratch);
+            }
+        });
+
+        // Finish in place; float and unsigned int share a size
+        ParallelForEach(0, depth, [&](int, int z) {
+            float* slice = distance + sliceSize * z;
+            unsigned int* squaredSlice = static_cast<unsigned int*>(out) + sliceSize * z;
+            for (size_t i = 0; i < sliceSize; i++) {
+                float d = slice[i];
+                if (squared) {
+                    squaredSlice[i] = d == INFINITE_DISTANCE || d >= 4294967295.0f ? UINT_MAX
+                        : static_cast<unsigned int>(d + 0.5f);
+                }
+                else {
+                    slice[i] = sqrtf(d);
+                }
+            }
+        });
+    }
+}
+
+void DistanceTransform(const BrickedVolume& labels, unsigned char material, const float* spacing,
+    bool squared, void* out)
+{
+    if (labels.IsEmpty()) {
+        return;
+    }
+
+    const int width = labels.Width();
+    Transform(width, labels.Height(), labels.Depth(), spacing, squared, out,
+        [&](int y, int z, unsigned char* row) {
+            const unsigned char* src = labels.Data() + labels.OffsetsY()[y] + labels.OffsetsZ()[z];
+            for (int x = 0; x < width; x += BrickedVolume::BRICK_SIZE) {
+                memcpy(row + x, src + labels.OffsetsX()[x], min(BrickedVolume::BRICK_SIZE, width - x));
+            }
+            for (int x = 0; x < width; x++) {
+                row[x] = row[x] == material;
+            }
+        });
+}
+
+void DistanceTransform(const BitMask& mask, const float* spacing, bool squared, void* out)
+{
+    if (mask.IsEmpty()) {
+        return;
+    }
+
+    const int width = mask.Width();
+    Transform(width, mask.Height(), mask.Depth(), spacing, squared, out,
+        [&](int y, int z, unsigned char* row) {
+            const unsigned long long* bits = mask.Row(y, z);
+            for (int x = 0; x < width; x++) {
+                row[x] = static_cast<unsigned char>((bits[x >> 6] >> (x & 63)) & 1);
+            }
+        });
+}
@@ -0,0 +1,28 @@
+// DistanceTransform.h
+#pragma once
+
+#include "BrickedVolume.h"
+
+class BitMask;
+
+// Exact Euclidean distance from every voxel labelled material to the
+// nearest voxel with another label, 0 outside the material. spacing holds
+// the voxel size along x, y and z, so anisotropic scans measure true
+// distances. out holds width * height * depth values in z-major order:
+// floats with the distance, or with squared set unsigned ints with the
+// squared distance rounded, in units of the smallest spacing (voxels for
+// isotropic scans; exact when the spacings are integer multiples of it).
+// Material voxels with no other label anywhere get infinity (UINT_MAX when
+// squared). The lower envelope runs in float, so results are exact only
+// while the squared distance plus the squared line length (in those units)
+// stays below 2^24.
+//
+// Separable: a two-sided scan along x, then the lower envelope of
+// parabolas (Felzenszwalb and Huttenlocher) along y and z. Lines are spread
+// across the workers and gathered 16 at a time, so the strided y and z
+// passes read whole cache lines; out doubles as the working buffer.
+void DistanceTransform(const BrickedVolume& labels, unsigned char material, const float* spacing,
+    bool squared, void* out);
+
+// The same over the set voxels of a packed mask, measured to its clear voxels
+void DistanceTransform(const BitMask& mask, const float* spacing, bool squared, void* out);
@@ -0,0 +1,134 @@
+// DynamicResolution.cpp
+#include "pch.h"
+#include "DynamicResolution.h"
+#include "ParallelFor.h"
+#include <cmath>
+
+const float ResolutionController::MIN_SCALE = 0.25f;
+
+namespace
+{
+    // Relative cost error tolerated before the scale changes
+    const double DEAD_BAND = 0.1;
+
+    // Weight of a new measurement in the smoothed frame cost
+    const double SMOOTHING = 0.3;
+
+    // Largest relative increase per frame; decreases are not limited
+    const float MAX_GROWTH = 1.1f;
+
+    // Scales are kept on a 1/64 grid so tiny corrections do not reallocate
+    // or re-upscale every frame
+    const float SCALE_STEP = 1.0f / 64.0f;
+
+    // Colour distance falloff of the edge-aware filter (distance in 0-255
+    // units, squared and summed over RGBA)
+    const float EDGE_FALLOFF = 1.0f / 2048.0f;
+}
+
+ResolutionController::ResolutionController()
+    : m_targetMs(0.0), m_smoothedMs(0.0), m_scale(1.0f)
+{
+}
+
+void ResolutionController::SetTarget(double milliseconds)
+{
+    m_targetMs = milliseconds > 0.0 ? milliseconds : 0.0;
+    m_smoothedMs = 0.0;
+    m_scale = 1.0f;
+}
+
+float ResolutionController::Update(double frameMs)
+{
+    if (!IsEnabled() || frameMs <= 0.0) {
+        return Scale();
+    }
+
+    // A spike (e.g. a transfer-function rebuild) counts at once when it
+    // exceeds the target, so a slow frame is never followed by another
+    m_smoothedMs = m_smoothedMs <= 0.0 || frameMs > m_targetMs
+        ? max(frameMs, m_smoothedMs * (1.0 - SMOOTHING) + frameMs * SMOOTHING)
+        : m_smoothedMs * (1.0 - SMOOTHING) + frameMs * SMOOTHING;
+
+    double ratio = m_smoothedMs / m_targetMs;
+    if (ratio > 1.0 - DEAD_BAND && ratio < 1.0 + DEAD_BAND) {
+        return m_scale;
+    }
+
+    // Aim slightly under the target so the next frame lands inside the band
+    float wanted = m_scale * static_cast<float>(sqrt(0.95 / ratio));
+    wanted = min(wanted, m_scale * MAX_GROWTH);
+    wanted = max(MIN_SCALE, min(1.0f, floorf(wanted / SCALE_STEP + 0.5f) * SCALE_STEP));
+
+    if (wanted != m_scale) {
+        // The smoothed cost was measured at the old scale
+        m_smoothedMs *= (wanted * wanted) / (m_scale * m_scale);
+        m_scale = wanted;
+    }
+    return m_scale;
+}
+
+void ResolutionController::ScaledSize(int width, int height, int* scaledWidth, int* scaledHeight) const
+{
+    float scale = Scale();
+    *scaledWidth = max(1, static_cast<int>(width * scale + 0.5f));
+    *scaledHeight = max(1, static_cast<int>(height * scale + 0.5f));
+}
+
+void UpscaleImage(const unsigned char* source, int sourceWidth, int sourceHeight,
+    unsigned char* target, int targetWidth, int targetHeight, bool edgeAware)
+{
+    const float scaleX = static_cast<float>(sourceWidth) / targetWidth;
+    const float scaleY = static_cast<float>(sourceHeight) / targetHeight;
+
+    // Source column pairs and weights are the same for every row
+    std::vector<int> x0(targetWidth), x1(targetWidth);
+    std::vector<float> fx(targetWidth);
+    for (int x = 0; x < targetWidth; x++) {
+        float sx = max(0.0f, (x + 0.5f) * scaleX - 0.5f);
+        x0[x] = min(static_cast<int>(sx), sourceWidth - 1);
+        x1[x] = min(x0[x] + 1, sourceWidth - 1);
+        fx[x] = sx - x0[x];
+    }
+
+    ParallelForEach(0, targetHeight, [&](int, int y) {
+        float sy = max(0.0f, (y + 0.5f) * scaleY - 0.5f);
+        int y0 = min(static_cast<int>(sy), sourceHeight - 1);
+        int y1 = min(y0 + 1, sourceHeight - 1);
+        float fy = sy - y0;
+        const unsigned char* row0 = source + static_cast<size_t>(y0) * sourceWidth * 4;
+        const unsigned char* row1 = source + static_cast<size_t>(y1) * sourceWidth * 4;
+        unsigned char* out = target + static_cast<size_t>(y) * targetWidth * 4;
+
+        for (int x = 0; x < targetWidth; x++) {
+            const unsigned char* taps[4] = { row0 + x0[x] * 4, row0 + x1[x] * 4, row1 + x0[x] * 4, row1 + x1[x] * 4 };
+            float weights[4] = {
+                (1.0f - fx[x]) * (1.0f - fy), fx[x] * (1.0f - fy),
+                (1.0f - fx[x]) * fy, fx[x] * fy
+            };
+
+            if (edgeAware) {
+                int nearest = (fx[x] < 0.5f ? 0 : 1) + (fy < 0.5f ? 0 : 2);
+                float total = 0.0f;
+                for (int i = 0; i < 4; i++) {
+                    float distance = 0.0f;
+                    for (int c = 0; c < 4; c++) {
+                        float d = static_cast<float>(taps[i][c]) - taps[nearest][c];
+                        distance += d * d;
+                    }
+                    weights[i] /= 1.0f + distance * EDGE_FALLOFF;
+                    total += weights[i];
+                }
+                for (int i = 0; i < 4; i++) {
+                    weights[i] /= total;
+                }
+            }
+
+            for (int c = 0; c < 4; c++) {
+                float v = weights[0] * taps[0][c] + weights[1] * taps[1][c]
+                    + weights[2] * taps[2][c] + weights[3] * taps[3][c];
+                out[x * 4 + c] = static_cast<unsigned char>(min(255.0f, v + 0.5f));
+            }
+        }
+    });
+}
@@ -0,0 +1,38 @@
+// DynamicResolution.h
+#pragma once
+
+// Picks the internal render scale (fraction of the window size per axis)
+// that keeps measured frame cost near a target. Cost is modelled as
+// proportional to the ray count, i.e. to scale squared. Drops are applied
+// at once so interaction never stalls; increases are damped and a dead band
+// around the target keeps the scale from oscillating.
+class ResolutionController
+{
+public:
+    static const float MIN_SCALE;
+
+    ResolutionController();
+
+    // Target frame time in milliseconds; zero or less renders at full size
+    void SetTarget(double milliseconds);
+    bool IsEnabled() const { return m_targetMs > 0.0; }
+    float Scale() const { return IsEnabled() ? m_scale : 1.0f; }
+
+    // Feeds the cost of a frame rendered at Scale() and returns the scale
+    // for the next one
+    float Update(double frameMs);
+
+    // Internal size for a window, at least one pixel per axis
+    void ScaledSize(int width, int height, int* scaledWidth, int* scaledHeight) const;
+
+private:
+    double m_targetMs;
+    double m_smoothedMs;
+    float m_scale;
+};
+
+// Resamples an RGBA8 image to a larger size. The edge-aware filter scales
+// each bilinear tap by its similarity to the nearest source pixel, so
+// silhouettes stay sharp instead of bleeding into the background.
+void UpscaleImage(const unsigned char* source, int sourceWidth, int sourceHeight,
+    unsigned char* target, int targetWidth, int targetHeight, bool edgeAware);
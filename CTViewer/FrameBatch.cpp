@@ -0,0 +1,111 @@
+// FrameBatch.cpp
+#include "pch.h"
+#include "FrameBatch.h"
+#include "ParallelFor.h"
+#include <condition_variable>
+
+namespace
+{
+    // Bytes of frame buffers in flight, unless one frame per worker needs more
+    const size_t FRAME_BUDGET_BYTES = static_cast<size_t>(512) << 20;
+}
+
+int RenderFrameBatch(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera* cameras, int count,
+    int width, int height, const FrameSink& deliver)
+{
+    if (count <= 0 || width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    // With one worker the frame itself is split across the cores instead
+    const int workers = min(GetWorkerCount(), count);
+    const size_t frameBytes = static_cast<size_t>(width) * height * 4;
+    const int window = max(workers, static_cast<int>(min(static_cast<size_t>(workers) * 2, FRAME_BUDGET_BYTES / frameBytes)));
+
+    // Slots are allocated by the first frame rendered into them
+    std::vector<std::vector<unsigned char>> slots(window);
+    std::vector<int> ready(window, -1);     // frame held by each slot once rendered
+    int nextFrame = 0;
+    int delivered = 0;
+    bool stop = false;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    auto work = [&]() {
+        IsSerialWorker() = workers > 1;
+        for (;;) {
+            int frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return stop || nextFrame >= count || nextFrame < delivered + window; });
+                if (stop || nextFrame >= count) {
+                    return;
+                }
+                frame = nextFrame++;
+            }
+
+            try {
+                std::vector<unsigned char>& slot = slots[frame % window];
+                slot.resize(frameBytes);
+                CpuRayCaster::Render(volume, labels, params, cameras[frame], width, height, slot.data());
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                stop = true;
+                changed.notify_all();
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ready[frame % window] = frame;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (int t = 0; t < workers; t++) {
+        threads.emplace_back(work);
+    }
+
+    // Deliver in order; a throwing sink stops the workers before rethrowing
+    try {
+        for (int frame = 0; frame < count; frame++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return stop || ready[frame % window] == frame; });
+                if (stop) {
+                    break;
+                }
+            }
+
+            deliver(frame, slots[frame % window].data());
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ready[frame % window] = -1;
+            delivered = frame + 1;
+            changed.notify_all();
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+        stop = true;
+        changed.notify_all();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return delivered;
+}
@@ -0,0 +1,20 @@
+// FrameBatch.h
+#pragma once
+
+#include "CpuRayCaster.h"
+#include <functional>
+
+// Receives frame index and its width * height RGBA8 pixels; the buffer is
+// only valid during the call
+typedef std::function<void(int frame, const unsigned char* rgba)> FrameSink;
+
+// Renders one frame per camera with the CPU ray caster, a whole frame per
+// worker thread over the shared read-only volumes, and hands them to deliver
+// in order on the calling thread while later frames are still rendering. At
+// most twice the worker count of frames are in flight, fewer for large
+// frames (down to one per worker) so the buffers stay within 512 MB; each
+// buffer is allocated when first used. Returns the number of frames
+// delivered.
+int RenderFrameBatch(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera* cameras, int count,
+    int width, int height, const FrameSink& deliver);
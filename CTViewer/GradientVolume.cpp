@@ -0,0 +1,337 @@
+// GradientVolume.cpp
+#include "pch.h"
+#include "GradientVolume.h"
+#include "BrickedVolume.h"
+#include "ParallelFor.h"
+#include <emmintrin.h>
+#include <cstring>
+
+namespace
+{
+    // Rows are widened to 16 bits with one clamped voxel on each side, plus
+    // slack so 8-wide loops may run past the end
+    const int ROW_PAD = 8;
+
+    void WidenRow(const unsigned char* src, int width, short* dst)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 1 + x), _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 9 + x), _mm_unpackhi_epi8(v, zero));
+        }
+        for (; x < width; x++) {
+            dst[1 + x] = src[x];
+        }
+        dst[0] = src[0];
+        dst[width + 1] = src[width - 1];
+    }
+
+    // Per-row sums over z for one source row: smoothed (1 2 1) and
+    // differenced (-1 0 1)
+    struct RowSums
+    {
+        int row;
+        std::vector<short> smooth;
+        std::vector<short> diff;
+    };
+
+    inline __m128i Load8(const short* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void Store8(short* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+
+    // Sign-extends four int16 lanes to floats
+    inline __m128 ToFloatLo(__m128i v) { return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)); }
+    inline __m128 ToFloatHi(__m128i v) { return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)); }
+
+    // Packs four gradients (Sobel units, 32 per unit voxel step) into RGBA8
+    inline __m128i Encode(__m128 gx, __m128 gy, __m128 gz)
+    {
+        __m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)), _mm_mul_ps(gz, gz)));
+        __m128 scale = _mm_div_ps(_mm_set1_ps(127.5f), _mm_max_ps(mag, _mm_set1_ps(1e-6f)));
+        __m128 bias = _mm_set1_ps(127.5f);
+        __m128i r = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(gx, scale), bias));
+        __m128i g = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(gy, scale), bias));
+        __m128i b = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(gz, scale), bias));
+        __m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(mag, _mm_set1_ps(1.0f / 16.0f)), _mm_set1_ps(255.0f)));
+        return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+    }
+}
+
+GradientVolume::GradientVolume()
+    : m_width(0), m_height(0), m_depth(0), m_bricksX(0), m_bricksY(0), m_bricksZ(0)
+{
+}
+
+bool GradientVolume::Build(const unsigned char* data, int width, int height, int depth)
+{
+    Clear();
+    if (!data || width <= 0 || height <= 0 || depth <= 0) {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_depth = depth;
+
+    // Same brick addressing as BrickedVolume, in texels
+    const int shift = BrickedVolume::BRICK_SHIFT;
+    const int size = BrickedVolume::BRICK_SIZE;
+    const int bricksX = (width + size - 1) >> shift;
+    const int bricksY = (height + size - 1) >> shift;
+    const int bricksZ = (depth + size - 1) >> shift;
+    m_bricksX = bricksX;
+    m_bricksY = bricksY;
+    m_bricksZ = bricksZ;
+    const size_t brickRowStride = static_cast<size_t>(bricksX) * BrickedVolume::BRICK_VOXELS;
+    const size_t brickSliceStride = brickRowStride * bricksY;
+
+    m_offsetX.resize(width + 1);
+    m_offsetY.resize(height + 1);
+    m_offsetZ.resize(depth + 1);
+    for (int x = 0; x < width; x++) {
+        m_offsetX[x] = static_cast<size_t>(x >> shift) * BrickedVolume::BRICK_VOXELS + (x & (size - 1));
+    }
+    for (int y = 0; y < height; y++) {
+        m_offsetY[y] = (y >> shift) * brickRowStride + (y & (size - 1)) * size;
+    }
+    for (int z = 0; z < depth; z++) {
+        m_offsetZ[z] = (z >> shift) * brickSliceStride + (z & (size - 1)) * size * size;
+    }
+    m_offsetX[width] = m_offsetX[width - 1];
+    m_offsetY[height] = m_offsetY[height - 1];
+    m_offsetZ[depth] = m_offsetZ[depth - 1];
+
+    m_data.assign(brickSliceStride * bricksZ, 0);
+
+    // The 3x3x3 Sobel kernel is separable: each component is a central
+    // difference along its axis smoothed by (1 2 1) along the other two.
+    // Sums over z are formed once per source row and reused by the three
+    // output rows that need them.
+    const size_t sliceSize = static_cast<size_t>(width) * height;
+    const int padded = width + 2 + ROW_PAD;
+    const size_t histogramSize = static_cast<size_t>(HISTOGRAM_SIZE) * HISTOGRAM_SIZE;
+    std::vector<std::vector<unsigned int>> histograms(GetWorkerCount());
+    ParallelForRange(0, depth, [&](int threadIndex, int zBegin, int zEnd) {
+        std::vector<unsigned int>& histogram = histograms[threadIndex];
+        histogram.assign(histogramSize, 0);
+        std::vector<short> below(padded), centre(padded), above(padded);
+        std::vector<short> p(padded), q(padded), r(padded);
+        std::vector<short> gx(padded), gy(padded), gz(padded);
+        std::vector<unsigned int> texels(width + ROW_PAD);
+        RowSums cache[3];
+        for (RowSums& c : cache) {
+            c.smooth.resize(padded);
+            c.diff.resize(padded);
+        }
+
+        for (int z = zBegin; z < zEnd; z++) {
+            const unsigned char* sliceBelow = data + sliceSize * max(z - 1, 0);
+            const unsigned char* slice = data + sliceSize * z;
+            const unsigned char* sliceAbove = data + sliceSize * min(z + 1, depth - 1);
+            for (RowSums& c : cache) {
+                c.row = -1;
+            }
+
+            auto rowSums = [&](int y) -> const RowSums& {
+                RowSums& c = cache[y % 3];
+                if (c.row == y) {
+                    return c;
+                }
+                c.row = y;
+                WidenRow(sliceBelow + static_cast<size_t>(width) * y, width, below.data());
+                WidenRow(slice + static_cast<size_t>(width) * y, width, centre.data());
+                WidenRow(sliceAbove + static_cast<size_t>(width) * y, width, above.data());
+                for (int x = 0; x < width + 2; x += 8) {
+                    __m128i b = Load8(&below[x]), m = Load8(&centre[x]), a = Load8(&above[x]);
+                    Store8(&c.smooth[x], _mm_add_epi16(_mm_add_epi16(b, a), _mm_add_epi16(m, m)));
+                    Store8(&c.diff[x], _mm_sub_epi16(a, b));
+                }
+                return c;
+            };
+
+            for (int y = 0; y < height; y++) {
+                const RowSums& prev = rowSums(max(y - 1, 0));
+                const RowSums& cur = rowSums(y);
+                const RowSums& next = rowSums(min(y + 1, height - 1));
+
+                // Smooth or difference over y
+                for (int x = 0; x < width + 2; x += 8) {
+                    __m128i sp = Load8(&prev.smooth[x]), sc = Load8(&cur.smooth[x]), sn = Load8(&next.smooth[x]);
+                    __m128i dp = Load8(&prev.diff[x]), dc = Load8(&cur.diff[x]), dn = Load8(&next.diff[x]);
+                    Store8(&p[x], _mm_add_epi16(_mm_add_epi16(sp, sn), _mm_add_epi16(sc, sc)));
+                    Store8(&q[x], _mm_sub_epi16(sn, sp));
+                    Store8(&r[x], _mm_add_epi16(_mm_add_epi16(dp, dn), _mm_add_epi16(dc, dc)));
+                }
+
+                // Difference or smooth over x; output x reads padded x..x+2
+                for (int x = 0; x < width; x += 8) {
+                    __m128i p0 = Load8(&p[x]), p2 = Load8(&p[x + 2]);
+                    __m128i q0 = Load8(&q[x]), q1 = Load8(&q[x + 1]), q2 = Load8(&q[x + 2]);
+                    __m128i r0 = Load8(&r[x]), r1 = Load8(&r[x + 1]), r2 = Load8(&r[x + 2]);
+                    Store8(&gx[x], _mm_sub_epi16(p2, p0));
+                    Store8(&gy[x], _mm_add_epi16(_mm_add_epi16(q0, q2), _mm_add_epi16(q1, q1)));
+                    Store8(&gz[x], _mm_add_epi16(_mm_add_epi16(r0, r2), _mm_add_epi16(r1, r1)));
+                }
+
+                for (int x = 0; x < width; x += 8) {
+                    __m128i vx = Load8(&gx[x]), vy = Load8(&gy[x]), vz = Load8(&gz[x]);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[x]),
+                        Encode(ToFloatLo(vx), ToFloatLo(vy), ToFloatLo(vz)));
+                    if (x + 4 < width) {
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[x + 4]),
+                            Encode(ToFloatHi(vx), ToFloatHi(vy), ToFloatHi(vz)));
+                    }
+                }
+
+                const unsigned char* densities = slice + static_cast<size_t>(width) * y;
+                for (int x = 0; x < width; x++) {
+                    histogram[(texels[x] >> 24) * HISTOGRAM_SIZE + densities[x]]++;
+                }
+
+                unsigned int* dst = m_data.data() + m_offsetY[y] + m_offsetZ[z];
+                for (int x = 0; x < width; x += size) {
+                    memcpy(dst + m_offsetX[x], &texels[x], min(size, width - x) * sizeof(unsigned int));
+                }
+            }
+        }
+    });
+
+    m_histogram.assign(histogramSize, 0);
+    for (const std::vector<unsigned int>& histogram : histograms) {
+        for (size_t i = 0; i < histogram.size(); i++) {
+            m_histogram[i] += histogram[i];
+        }
+    }
+
+    BuildBrickRanges();
+    return true;
+}
+
+void GradientVolume::BuildBrickRanges()
+{
+    const size_t brickCount = static_cast<size_t>(m_bricksX) * m_bricksY * m_bricksZ;
+    std::vector<unsigned char> ownMin(brickCount);
+    std::vector<unsigned char> ownMax(brickCount);
+    auto brickIndex = [&](int bx, int by, int bz) {
+        return (static_cast<size_t>(bz) * m_bricksY + by) * m_bricksX + bx;
+    };
+
+    // Magnitude range of each brick's own voxels, skipping the padding of
+    // bricks cut by the volume edge
+    const int size = BrickedVolume::BRICK_SIZE;
+    ParallelForRange(0, m_bricksZ, [&](int, int bzBegin, int bzEnd) {
+        for (int bz = bzBegin; bz < bzEnd; bz++) {
+            for (int by = 0; by < m_bricksY; by++) {
+                for (int bx = 0; bx < m_bricksX; bx++) {
+                    int x0 = bx * size, y0 = by * size, z0 = bz * size;
+                    unsigned char mn = 255, mx = 0;
+                    for (int z = z0; z < min(z0 + size, m_depth); z++) {
+                        for (int y = y0; y < min(y0 + size, m_height); y++) {
+                            const unsigned int* row = m_data.data() + m_offsetY[y] + m_offsetZ[z] + m_offsetX[x0];
+                            for (int x = 0; x < min(size, m_width - x0); x++) {
+                                unsigned char magnitude = static_cast<unsigned char>(row[x] >> 24);
+                                mn = min(mn, magnitude);
+                                mx = max(mx, magnitude);
+                            }
+                        }
+                    }
+                    size_t brick = brickIndex(bx, by, bz);
+                    ownMin[brick] = mn;
+                    ownMax[brick] = mx;
+                }
+            }
+        }
+    });
+
+    // Widen by the 26 neighbours to cover the apron, as BrickedVolume does
+    m_brickMin.resize(brickCount);
+    m_brickMax.resize(brickCount);
+    ParallelForRange(0, m_bricksZ, [&](int, int bzBegin, int bzEnd) {
+        for (int bz = bzBegin; bz < bzEnd; bz++) {
+            for (int by = 0; by < m_bricksY; by++) {
+                for (int bx = 0; bx < m_bricksX; bx++) {
+                    unsigned char mn = 255, mx = 0;
+                    for (int nz = max(bz - 1, 0); nz <= min(bz + 1, m_bricksZ - 1); nz++) {
+                        for (int ny = max(by - 1, 0); ny <= min(by + 1, m_bricksY - 1); ny++) {
+                            for (int nx = max(bx - 1, 0); nx <= min(bx + 1, m_bricksX - 1); nx++) {
+                                size_t neighbour = brickIndex(nx, ny, nz);
+                                mn = min(mn, ownMin[neighbour]);
+                                mx = max(mx, ownMax[neighbour]);
+                            }
+                        }
+                    }
+                    size_t brick = brickIndex(bx, by, bz);
+                    m_brickMin[brick] = mn;
+                    m_brickMax[brick] = mx;
+                }
+            }
+        }
+    });
+}
+
+void GradientVolume::Clear()
+{
+    m_width = m_height = m_depth = 0;
+    m_bricksX = m_bricksY = m_bricksZ = 0;
+    std::vector<unsigned int>().swap(m_data);
+    std::vector<unsigned int>().swap(m_histogram);
+    m_brickMin.clear();
+    m_brickMax.clear();
+    m_offsetX.clear();
+    m_offsetY.clear();
+    m_offsetZ.clear();
+}
+
+void GradientVolume::SampleLinear(float x, float y, float z, float* rgba) const
+{
+    x = max(0.0f, min(static_cast<float>(m_width - 1), x));
+    y = max(0.0f, min(static_cast<float>(m_height - 1), y));
+    z = max(0.0f, min(static_cast<float>(m_depth - 1), z));
+
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int z0 = static_cast<int>(z);
+    float fx = x - x0;
+    float fy = y - y0;
+    float fz = z - z0;
+
+    const unsigned int* base = m_data.data();
+    size_t ox[2] = { m_offsetX[x0], m_offsetX[x0 + 1] };
+    size_t oy[2] = { m_offsetY[y0], m_offsetY[y0 + 1] };
+    size_t oz[2] = { m_offsetZ[z0], m_offsetZ[z0 + 1] };
+    float wx[2] = { 1.0f - fx, fx };
+    float wy[2] = { 1.0f - fy, fy };
+    float wz[2] = { 1.0f - fz, fz };
+
+    // All four channels of a texel are widened into one SSE register
+    const __m128i zero = _mm_setzero_si128();
+    __m128 sum = _mm_setzero_ps();
+    for (int k = 0; k < 2; k++) {
+        for (int j = 0; j < 2; j++) {
+            for (int i = 0; i < 2; i++) {
+                __m128i texel = _mm_cvtsi32_si128(static_cast<int>(base[ox[i] + oy[j] + oz[k]]));
+                texel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(texel, zero), zero);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(wx[i] * wy[j] * wz[k]), _mm_cvtepi32_ps(texel)));
+            }
+        }
+    }
+    _mm_storeu_ps(rgba, _mm_mul_ps(sum, _mm_set1_ps(1.0f / 255.0f)));
+}
+
+void GradientVolume::CopySlicesToLinear(int zBegin, int zEnd, unsigned int* out) const
+{
+    const size_t sliceSize = static_cast<size_t>(m_width) * m_height;
+    const int size = BrickedVolume::BRICK_SIZE;
+    ParallelForRange(zBegin, zEnd, [&](int, int zFirst, int zLast) {
+        for (int z = zFirst; z < zLast; z++) {
+            for (int y = 0; y < m_height; y++) {
+                unsigned int* dst = out + sliceSize * (z - zBegin) + static_cast<size_t>(m_width) * y;
+                const unsigned int* src = m_data.data() + m_offsetY[y] + m_offsetZ[z];
+                for (int x = 0; x < m_width; x += size) {
+                    memcpy(dst + x, src + m_offsetX[x], min(size, m_width - x) * sizeof(unsigned int));
+                }
+            }
+        }
+    });
+}
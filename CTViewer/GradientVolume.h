@@ -0,0 +1,72 @@
+// GradientVolume.h
+#pragma once
+
+#include <vector>
+
+// Quantized Sobel gradients of an 8-bit volume, one RGBA8 texel per voxel:
+// RGB is the unit gradient direction in voxel space biased to 0-255
+// (n * 127.5 + 127.5) and A is the magnitude, 255 for a full 0-255 step
+// between neighbours. Unlike octahedral normals the biased direction can be
+// trilinearly filtered, so the shader reads it with one filtered fetch.
+// Texels are stored in the same 8x8x8 brick order as BrickedVolume.
+class GradientVolume
+{
+public:
+    // Joint histogram bins per axis (8-bit density and magnitude)
+    static const int HISTOGRAM_SIZE = 256;
+
+    GradientVolume();
+
+    // Parallel SSE2 3x3x3 Sobel pass over a z-major array
+    bool Build(const unsigned char* data, int width, int height, int depth);
+    void Clear();
+
+    bool IsEmpty() const { return m_data.empty(); }
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    int Depth() const { return m_depth; }
+    size_t MemoryUsage() const { return m_data.size() * sizeof(unsigned int); }
+
+    // Packed texel (R in the low byte); x, y, z must lie inside the volume
+    unsigned int At(int x, int y, int z) const
+    {
+        return m_data[m_offsetX[x] + m_offsetY[y] + m_offsetZ[z]];
+    }
+
+    // Trilinear sample in voxel space of the four encoded channels (0-1)
+    void SampleLinear(float x, float y, float z, float* rgba) const;
+
+    // Writes slices [zBegin, zEnd) in z-major order, for texture upload
+    void CopySlicesToLinear(int zBegin, int zEnd, unsigned int* out) const;
+
+    // Voxel counts indexed by magnitude * HISTOGRAM_SIZE + density
+    const std::vector<unsigned int>& JointHistogram() const { return m_histogram; }
+
+    // Magnitude range of a brick including its one-voxel apron, so
+    // trilinear samples anywhere in the brick stay inside it
+    unsigned char BrickMinMagnitude(size_t brick) const { return m_brickMin[brick]; }
+    unsigned char BrickMaxMagnitude(size_t brick) const { return m_brickMax[brick]; }
+    int BricksX() const { return m_bricksX; }
+    int BricksY() const { return m_bricksY; }
+    int BricksZ() const { return m_bricksZ; }
+
+private:
+    void BuildBrickRanges();
+
+    int m_width;
+    int m_height;
+    int m_depth;
+    std::vector<unsigned int> m_data;
+    std::vector<unsigned int> m_histogram;
+
+    int m_bricksX;
+    int m_bricksY;
+    int m_bricksZ;
+    std::vector<unsigned char> m_brickMin;
+    std::vector<unsigned char> m_brickMax;
+
+    // Texel offsets per axis; one extra entry repeats the edge
+    std::vector<size_t> m_offsetX;
+    std::vector<size_t> m_offsetY;
+    std::vector<size_t> m_offsetZ;
+};
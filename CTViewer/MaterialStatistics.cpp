@@ -0,0 +1,221 @@
+// MaterialStatistics.cpp
+#include "pch.h"
+#include "MaterialStatistics.h"
+#include "ParallelFor.h"
+#include <climits>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace
+{
+    const int LABEL_COUNT = 256;
+
+    // Running sums for one label; bounds start inverted
+    struct Accumulator
+    {
+        unsigned long long count;
+        unsigned long long sum;
+        unsigned long long sumSquares;
+        unsigned long long position[3];
+        int minDensity;
+        int maxDensity;
+        int bounds[6];
+
+        void Reset()
+        {
+            count = sum = sumSquares = 0;
+            position[0] = position[1] = position[2] = 0;
+            minDensity = 255;
+            maxDensity = 0;
+            bounds[0] = bounds[1] = bounds[2] = INT_MAX;
+            bounds[3] = bounds[4] = bounds[5] = -1;
+        }
+
+        // Voxels x0 to x1 - 1 of row (y, z), all with this label
+        void AddRun(const unsigned char* density, int x0, int x1, int y, int z)
+        {
+            int length = x1 - x0;
+            unsigned int runSum = 0, runSquares = 0;
+            for (int i = 0; i < length; i++) {
+                int d = density[i];
+                runSum += d;
+                runSquares += d * d;
+                minDensity = min(minDensity, d);
+                maxDensity = max(maxDensity, d);
+            }
+
+            count += length;
+            sum += runSum;
+            sumSquares += runSquares;
+            position[0] += static_cast<unsigned long long>(x0 + x1 - 1) * length / 2;
+            position[1] += static_cast<unsigned long long>(y) * length;
+            position[2] += static_cast<unsigned long long>(z) * length;
+            bounds[0] = min(bounds[0], x0);
+            bounds[1] = min(bounds[1], y);
+            bounds[2] = min(bounds[2], z);
+            bounds[3] = max(bounds[3], x1 - 1);
+            bounds[4] = max(bounds[4], y);
+            bounds[5] = max(bounds[5], z);
+        }
+
+        void Merge(const Accumulator& other)
+        {
+            count += other.count;
+            sum += other.sum;
+            sumSquares += other.sumSquares;
+            for (int c = 0; c < 3; c++) {
+                position[c] += other.position[c];
+                bounds[c] = min(bounds[c], other.bounds[c]);
+                bounds[c + 3] = max(bounds[c + 3], other.bounds[c + 3]);
+            }
+            minDensity = min(minDensity, other.minDensity);
+            maxDensity = max(maxDensity, other.maxDensity);
+        }
+    };
+
+    int HorizontalSum32(__m128i v)
+    {
+        int lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), v);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    // True if all 512 labels of a brick equal the first
+    bool IsUniformBrick(const unsigned char* p)
+    {
+        const __m128i first = _mm_set1_epi8(static_cast<char>(p[0]));
+        __m128i equal = _mm_set1_epi8(static_cast<char>(0xFF));
+        for (int i = 0; i < BrickedVolume::BRICK_VOXELS; i += 16) {
+            equal = _mm_and_si128(equal, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), first));
+        }
+        return _mm_movemask_epi8(equal) == 0xFFFF;
+    }
+
+    // A full brick of one label: sums by SAD and multiply-add, range by
+    // byte min/max, positions from the brick's extent
+    void AddUniformBrick(Accumulator& acc, const unsigned char* p, int x0, int y0, int z0)
+    {
+        const int n = BrickedVolume::BRICK_SIZE;
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero, squares = zero;
+        __m128i lo = _mm_set1_epi8(static_cast<char>(0xFF)), hi = zero;
+        for (int i = 0; i < BrickedVolume::BRICK_VOXELS; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+            __m128i low = _mm_unpacklo_epi8(v, zero), high = _mm_unpackhi_epi8(v, zero);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+            lo = _mm_min_epu8(lo, v);
+            hi = _mm_max_epu8(hi, v);
+        }
+
+        unsigned char loBytes[16], hiBytes[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(loBytes), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hiBytes), hi);
+        for (int i = 0; i < 16; i++) {
+            acc.minDensity = min(acc.minDensity, static_cast<int>(loBytes[i]));
+            acc.maxDensity = max(acc.maxDensity, static_cast<int>(hiBytes[i]));
+        }
+
+        // Each coordinate value appears n * n times in the brick
+        const unsigned long long perCoordinate = n * n;
+        acc.count += BrickedVolume::BRICK_VOXELS;
+        acc.sum += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+        acc.sumSquares += HorizontalSum32(squares);
+        acc.position[0] += perCoordinate * (n * x0 + n * (n - 1) / 2);
+        acc.position[1] += perCoordinate * (n * y0 + n * (n - 1) / 2);
+        acc.position[2] += perCoordinate * (n * z0 + n * (n - 1) / 2);
+        acc.bounds[0] = min(acc.bounds[0], x0);
+        acc.bounds[1] = min(acc.bounds[1], y0);
+        acc.bounds[2] = min(acc.bounds[2], z0);
+        acc.bounds[3] = max(acc.bounds[3], x0 + n - 1);
+        acc.bounds[4] = max(acc.bounds[4], y0 + n - 1);
+        acc.bounds[5] = max(acc.bounds[5], z0 + n - 1);
+    }
+}
+
+bool ComputeMaterialStatistics(const BrickedVolume& volume, const BrickedVolume& labels, float voxelSize,
+    std::vector<MaterialStats>& stats)
+{
+    stats.assign(LABEL_COUNT, MaterialStats());
+    if (volume.IsEmpty() || labels.Width() != volume.Width() || labels.Height() != volume.Height()
+        || labels.Depth() != volume.Depth()) {
+        return false;
+    }
+
+    const int n = BrickedVolume::BRICK_SIZE;
+    const int shift = BrickedVolume::BRICK_SHIFT;
+    const int width = volume.Width(), height = volume.Height(), depth = volume.Depth();
+    std::vector<Accumulator> partials(static_cast<size_t>(GetWorkerCount()) * LABEL_COUNT);
+    for (Accumulator& acc : partials) {
+        acc.Reset();
+    }
+
+    // Both volumes share one brick layout, so a brick's bytes line up
+    ParallelForRange(0, volume.BricksZ(), [&](int thread, int bzBegin, int bzEnd) {
+        Accumulator* accumulators = partials.data() + static_cast<size_t>(thread) * LABEL_COUNT;
+        for (int bz = bzBegin; bz < bzEnd; bz++) {
+            for (int by = 0; by < volume.BricksY(); by++) {
+                for (int bx = 0; bx < volume.BricksX(); bx++) {
+                    const unsigned char* density = volume.Brick(bx, by, bz);
+                    const unsigned char* label = labels.Brick(bx, by, bz);
+                    int x0 = bx << shift, y0 = by << shift, z0 = bz << shift;
+                    int xEnd = min(x0 + n, width), yEnd = min(y0 + n, height), zEnd = min(z0 + n, depth);
+
+                    // The label range includes the apron, so equal bounds
+                    // settle it at once; bricks next to a boundary are
+                    // often still uniform themselves
+                    size_t brick = labels.BrickIndex(bx, by, bz);
+                    bool full = xEnd - x0 == n && yEnd - y0 == n && zEnd - z0 == n;
+                    if (full && (labels.BrickMin(brick) == labels.BrickMax(brick) || IsUniformBrick(label))) {
+                        AddUniformBrick(accumulators[label[0]], density, x0, y0, z0);
+                        continue;
+                    }
+
+                    // Mixed bricks are walked as runs of one label per row
+                    for (int z = z0; z < zEnd; z++) {
+                        for (int y = y0; y < yEnd; y++) {
+                            int row = ((z - z0) * n + (y - y0)) * n;
+                            const unsigned char* rowLabels = label + row - x0;
+                            for (int x = x0; x < xEnd;) {
+                                int runEnd = x + 1;
+                                while (runEnd < xEnd && rowLabels[runEnd] == rowLabels[x]) {
+                                    runEnd++;
+                                }
+                                accumulators[rowLabels[x]].AddRun(density + row + x - x0, x, runEnd, y, z);
+                                x = runEnd;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    const double voxelVolume = static_cast<double>(voxelSize) * voxelSize * voxelSize;
+    for (int l = 0; l < LABEL_COUNT; l++) {
+        Accumulator total;
+        total.Reset();
+        for (size_t t = 0; t < partials.size() / LABEL_COUNT; t++) {
+            total.Merge(partials[t * LABEL_COUNT + l]);
+        }
+        if (total.count == 0) {
+            continue;
+        }
+
+        MaterialStats& s = stats[l];
+        double count = static_cast<double>(total.count);
+        s.count = total.count;
+        s.volume = count * voxelVolume;
+        s.mean = total.sum / count;
+        s.stddev = sqrt(max(0.0, total.sumSquares / count - s.mean * s.mean));
+        s.minDensity = static_cast<unsigned char>(total.minDensity);
+        s.maxDensity = static_cast<unsigned char>(total.maxDensity);
+        for (int c = 0; c < 6; c++) {
+            s.bounds[c] = total.bounds[c];
+        }
+        for (int c = 0; c < 3; c++) {
+            s.centroid[c] = total.position[c] / count;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+// MaterialStatistics.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include <vector>
+
+// Statistics of the voxels carrying one label. Bounds are inclusive voxel
+// indices (minX, minY, minZ, maxX, maxY, maxZ) and the centroid is in voxel
+// coordinates; everything is 0 for labels with no voxels.
+struct MaterialStats
+{
+    unsigned long long count;
+    double volume;              // count * voxelSize^3
+    double mean;
+    double stddev;
+    unsigned char minDensity;
+    unsigned char maxDensity;
+    int bounds[6];
+    double centroid[3];
+};
+
+// Fills one entry per label (256) from a density volume and a label volume
+// of the same size in one pass over the bricks. Each worker accumulates
+// into its own 256 entries, merged at the end. Bricks whose range holds a
+// single label are reduced as a whole with SSE2 sums; mixed bricks are
+// walked voxel by voxel. Returns false if the volumes differ in size.
+bool ComputeMaterialStatistics(const BrickedVolume& volume, const BrickedVolume& labels, float voxelSize,
+    std::vector<MaterialStats>& stats);
@@ -0,0 +1,407 @@
+// Morphology.cpp
+#include "pch.h"
+#include "Morphology.h"
+#include "DistanceTransform.h"
+#include "ParallelFor.h"
+#include <emmintrin.h>
+
+namespace
+{
+    typedef unsigned long long Word;
+
+    // Balls up to this radius are dilated directly from the packed rows
+    const int BALL_DIRECT_RADIUS = 3;
+
+    int CountBits(Word w)
+    {
+        w = w - ((w >> 1) & 0x5555555555555555ULL);
+        w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+        w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<int>((w * 0x0101010101010101ULL) >> 56);
+    }
+
+    // row |= row shifted towards higher x by shift bits; descending, so
+    // every word is read before it is overwritten
+    void OrShiftedUp(Word* row, int words, int shift)
+    {
+        int q = shift >> 6, b = shift & 63;
+        for (int i = words - 1; i >= q; i--) {
+            Word v = row[i - q] << b;
+            if (b != 0 && i - q - 1 >= 0) {
+                v |= row[i - q - 1] >> (64 - b);
+            }
+            row[i] |= v;
+        }
+    }
+
+    // row |= row shifted towards lower x by shift bits
+    void OrShiftedDown(Word* row, int words, int shift)
+    {
+        int q = shift >> 6, b = shift & 63;
+        for (int i = 0; i + q < words; i++) {
+            Word v = row[i + q] >> b;
+            if (b != 0 && i + q + 1 < words) {
+                v |= row[i + q + 1] << (64 - b);
+            }
+            row[i] |= v;
+        }
+    }
+
+    // Dilates one row along x by radius: the reach in each direction
+    // doubles per step, so radius r costs about 2 log2(r) shifts
+    void DilateRow(Word* row, Word* scratch, int words, int radius, Word tailMask)
+    {
+        if (radius <= 0) {
+            return;
+        }
+        memcpy(scratch, row, words * sizeof(Word));
+        for (int covered = 1; covered <= radius;) {
+            int shift = min(covered, radius + 1 - covered);
+            OrShiftedUp(row, words, shift);
+            OrShiftedDown(scratch, words, shift);
+            covered += shift;
+        }
+        for (int i = 0; i < words; i++) {
+            row[i] |= scratch[i];
+        }
+        row[words - 1] &= tailMask;
+    }
+
+    // dst |= src, two words per step
+    void OrRow(Word* dst, const Word* src, int words)
+    {
+        int i = 0;
+        for (; i + 2 <= words; i += 2) {
+            __m128i* p = reinterpret_cast<__m128i*>(dst + i);
+            _mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+        }
+        for (; i < words; i++) {
+            dst[i] |= src[i];
+        }
+    }
+
+    // Dilates n rows of words, stride apart, by radius along the line. The
+    // line is padded with radius empty rows each side and cut into blocks of
+    // 2 * radius + 1: every window then spans the tail of one block and the
+    // head of the next, so it is the suffix OR of one plus the prefix OR of
+    // the other (van Herk / Gil-Werman).
+    void DilateLine(Word* base, int n, size_t stride, int words, int radius,
+        std::vector<Word>& prefix, std::vector<Word>& suffix)
+    {
+        if (radius <= 0) {
+            return;
+        }
+        const int window = 2 * radius + 1;
+        const int padded = n + 2 * radius;
+        prefix.resize(static_cast<size_t>(padded) * words);
+        suffix.resize(static_cast<size_t>(padded) * words);
+
+        for (int k = 0; k < padded; k++) {
+            Word* g = prefix.data() + static_cast<size_t>(k) * words;
+            int row = k - radius;
+            if (row >= 0 && row < n) {
+                memcpy(g, base + row * stride, words * sizeof(Word));
+            }
+            else {
+                memset(g, 0, words * sizeof(Word));
+            }
+            if (k % window != 0) {
+                OrRow(g, g - words, words);
+            }
+        }
+        for (int k = padded - 1; k >= 0; k--) {
+            Word* h = suffix.data() + static_cast<size_t>(k) * words;
+            int row = k - radius;
+            if (row >= 0 && row < n) {
+                memcpy(h, base + row * stride, words * sizeof(Word));
+            }
+            else {
+                memset(h, 0, words * sizeof(Word));
+            }
+            if (k % window != window - 1 && k != padded - 1) {
+                OrRow(h, h + words, words);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            Word* dst = base + i * stride;
+            const Word* h = suffix.data() + static_cast<size_t>(i) * words;
+            const Word* g = prefix.data() + static_cast<size_t>(i + 2 * radius) * words;
+            for (int w = 0; w < words; w++) {
+                dst[w] = h[w] | g[w];
+            }
+        }
+    }
+
+    void DilateBox(BitMask& mask, int radius)
+    {
+        const int width = mask.Width(), height = mask.Height(), depth = mask.Depth();
+        const int words = mask.WordsPerRow();
+
+        ParallelForEach(0, depth, [&](int, int z) {
+            std::vector<Word> scratch(words);
+            for (int y = 0; y < height; y++) {
+                DilateRow(mask.Row(y, z), scratch.data(), words, min(radius, width - 1), mask.TailMask());
+            }
+        });
+        ParallelForRange(0, depth, [&](int, int zBegin, int zEnd) {
+            std::vector<Word> prefix, suffix;
+            for (int z = zBegin; z < zEnd; z++) {
+                DilateLine(mask.Row(0, z), height, mask.RowPitch(), words, min(radius, height - 1), prefix, suffix);
+            }
+        });
+        ParallelForRange(0, height, [&](int, int yBegin, int yEnd) {
+            std::vector<Word> prefix, suffix;
+            for (int y = yBegin; y < yEnd; y++) {
+                DilateLine(mask.Row(y, 0), depth, mask.SlicePitch(), words, min(radius, depth - 1), prefix, suffix);
+            }
+        });
+    }
+
+    // Rows (dy, dz) of a ball that reach the same distance along x
+    struct DiscLayer
+    {
+        int halfWidth;
+        std::vector<int> dy;
+        std::vector<int> dz;
+    };
+
+    void DilateSmallBall(BitMask& mask, int radius)
+    {
+        const int height = mask.Height(), depth = mask.Depth();
+        const int words = mask.WordsPerRow();
+
+        std::vector<DiscLayer> layers(radius + 1);
+        for (int h = 0; h <= radius; h++) {
+            layers[h].halfWidth = h;
+        }
+        for (int dz = -radius; dz <= radius; dz++) {
+            for (int dy = -radius; dy <= radius; dy++) {
+                int remaining = radius * radius - dy * dy - dz * dz;
+                if (remaining < 0) {
+                    continue;
+                }
+                int h = 0;
+                while ((h + 1) * (h + 1) <= remaining) {
+                    h++;
+                }
+                layers[h].dy.push_back(dy);
+                layers[h].dz.push_back(dz);
+            }
+        }
+
+        BitMask result;
+        result.Resize(mask.Width(), height, depth);
+        ParallelForEach(0, depth, [&](int, int z) {
+            std::vector<Word> layer(words), scratch(words);
+            for (int y = 0; y < height; y++) {
+                Word* dst = result.Row(y, z);
+                for (const DiscLayer& l : layers) {
+                    bool any = false;
+                    for (size_t i = 0; i < l.dy.size(); i++) {
+                        int sy = y + l.dy[i], sz = z + l.dz[i];
+                        if (sy < 0 || sy >= height || sz < 0 || sz >= depth) {
+                            continue;
+                        }
+                        if (!any) {
+                            memcpy(layer.data(), mask.Row(sy, sz), words * sizeof(Word));
+                            any = true;
+                        }
+                        else {
+                            OrRow(layer.data(), mask.Row(sy, sz), words);
+                        }
+                    }
+                    if (any) {
+                        DilateRow(layer.data(), scratch.data(), words, l.halfWidth, mask.TailMask());
+                        OrRow(dst, layer.data(), words);
+                    }
+                }
+            }
+        });
+        mask.Swap(result);
+    }
+
+    // Keeps the voxels further than radius from every clear voxel
+    void ErodeLargeBall(BitMask& mask, int radius)
+    {
+        const int width = mask.Width(), height = mask.Height(), depth = mask.Depth();
+        const size_t sliceSize = static_cast<size_t>(width) * height;
+        const float spacing[3] = { 1.0f, 1.0f, 1.0f };
+        std::vector<unsigned int> distance(sliceSize * depth);
+        DistanceTransform(mask, spacing, true, distance.data());
+
+        const unsigned int limit = static_cast<unsigned int>(radius) * radius;
+        ParallelForEach(0, depth, [&](int, int z) {
+            for (int y = 0; y < height; y++) {
+                const unsigned int* src = distance.data() + sliceSize * z + static_cast<size_t>(width) * y;
+                Word* dst = mask.Row(y, z);
+                for (int x0 = 0; x0 < width; x0 += 64) {
+                    Word bits = 0;
+                    int n = min(64, width - x0);
+                    for (int i = 0; i < n; i++) {
+                        bits |= static_cast<Word>(src[x0 + i] > limit) << i;
+                    }
+                    dst[x0 >> 6] = bits;
+                }
+            }
+        });
+    }
+
+    void Dilate(BitMask& mask, int element, int radius)
+    {
+        if (radius == 0) {
+            return;
+        }
+        if (element == ELEMENT_BOX) {
+            DilateBox(mask, radius);
+        }
+        else if (radius <= BALL_DIRECT_RADIUS) {
+            DilateSmallBall(mask, radius);
+        }
+        else {
+            mask.Invert();
+            ErodeLargeBall(mask, radius);
+            mask.Invert();
+        }
+    }
+
+    void Erode(BitMask& mask, int element, int radius)
+    {
+        if (radius == 0) {
+            return;
+        }
+        if (element == ELEMENT_BALL && radius > BALL_DIRECT_RADIUS) {
+            ErodeLargeBall(mask, radius);
+            return;
+        }
+        mask.Invert();
+        Dilate(mask, element, radius);
+        mask.Invert();
+    }
+}
+
+BitMask::BitMask()
+    : m_width(0), m_height(0), m_depth(0), m_wordsPerRow(0), m_tailMask(0)
+{
+}
+
+void BitMask::Resize(int width, int height, int depth)
+{
+    m_width = width;
+    m_height = height;
+    m_depth = depth;
+    m_wordsPerRow = (width + 63) / 64;
+    m_tailMask = (width & 63) ? (1ULL << (width & 63)) - 1 : ~0ULL;
+    m_words.assign(SlicePitch() * depth, 0);
+}
+
+void BitMask::Build(const BrickedVolume& labels, unsigned char material)
+{
+    Resize(labels.Width(), labels.Height(), labels.Depth());
+    if (labels.IsEmpty()) {
+        return;
+    }
+
+    const __m128i target = _mm_set1_epi8(static_cast<char>(material));
+    ParallelForEach(0, m_depth, [&](int, int z) {
+        std::vector<unsigned char> row(m_wordsPerRow * 64);
+        for (int y = 0; y < m_height; y++) {
+            const unsigned char* src = labels.Data() + labels.OffsetsY()[y] + labels.OffsetsZ()[z];
+            for (int x = 0; x < m_width; x += BrickedVolume::BRICK_SIZE) {
+                memcpy(row.data() + x, src + labels.OffsetsX()[x], min(BrickedVolume::BRICK_SIZE, m_width - x));
+            }
+
+            Word* dst = Row(y, z);
+            for (int i = 0; i < m_wordsPerRow; i++) {
+                Word bits = 0;
+                for (int part = 0; part < 4; part++) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.data() + i * 64 + part * 16));
+                    bits |= static_cast<Word>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, target))) << (part * 16);
+                }
+                dst[i] = bits;
+            }
+            dst[m_wordsPerRow - 1] &= m_tailMask;
+        }
+    });
+}
+
+void BitMask::Invert()
+{
+    ParallelForEach(0, m_depth, [&](int, int z) {
+        for (int y = 0; y < m_height; y++) {
+            Word* row = Row(y, z);
+            for (int i = 0; i < m_wordsPerRow; i++) {
+                row[i] = ~row[i];
+            }
+            row[m_wordsPerRow - 1] &= m_tailMask;
+        }
+    });
+}
+
+unsigned long long BitMask::Count() const
+{
+    unsigned long long count = 0;
+    for (Word w : m_words) {
+        count += CountBits(w);
+    }
+    return count;
+}
+
+void BitMask::Swap(BitMask& other)
+{
+    std::swap(m_width, other.m_width);
+    std::swap(m_height, other.m_height);
+    std::swap(m_depth, other.m_depth);
+    std::swap(m_wordsPerRow, other.m_wordsPerRow);
+    std::swap(m_tailMask, other.m_tailMask);
+    m_words.swap(other.m_words);
+}
+
+bool ApplyMorphology(BitMask& mask, int operation, int element, int radius)
+{
+    if (operation < MORPH_ERODE || operation > MORPH_CLOSE || (element != ELEMENT_BOX && element != ELEMENT_BALL)
+        || radius < 0) {
+        return false;
+    }
+    if (mask.IsEmpty()) {
+        return true;
+    }
+
+    switch (operation) {
+    case MORPH_ERODE:
+        Erode(mask, element, radius);
+        break;
+    case MORPH_DILATE:
+        Dilate(mask, element, radius);
+        break;
+    case MORPH_OPEN:
+        Erode(mask, element, radius);
+        Dilate(mask, element, radius);
+        break;
+    case MORPH_CLOSE:
+        Dilate(mask, element, radius);
+        Erode(mask, element, radius);
+        break;
+    }
+    return true;
+}
+
+void WriteMaskChanges(const BitMask& before, const BitMask& after, unsigned char set, unsigned char cleared,
+    unsigned char* labels)
+{
+    const int width = after.Width(), height = after.Height();
+    ParallelForEach(0, after.Depth(), [&](int, int z) {
+        for (int y = 0; y < height; y++) {
+            const Word* was = before.Row(y, z);
+            const Word* now = after.Row(y, z);
+            unsigned char* row = labels + (static_cast<size_t>(z) * height + y) * width;
+            for (int i = 0; i < after.WordsPerRow(); i++) {
+                Word changed = was[i] ^ now[i];
+                for (int bit = 0; changed != 0; bit++, changed >>= 1) {
+                    if (changed & 1) {
+                        row[i * 64 + bit] = ((now[i] >> bit) & 1) ? set : cleared;
+                    }
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,82 @@
+// Morphology.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include <vector>
+
+enum MorphologyOperation
+{
+    MORPH_ERODE = 0,
+    MORPH_DILATE = 1,
+    MORPH_OPEN = 2,    // erode, then dilate: removes specks
+    MORPH_CLOSE = 3    // dilate, then erode: fills pinholes
+};
+
+enum StructuringElement
+{
+    ELEMENT_BOX = 0,   // cube of side 2 * radius + 1
+    ELEMENT_BALL = 1   // voxels within Euclidean distance radius
+};
+
+// Binary volume packed 64 voxels to a word: voxel x of a row is bit x % 64
+// of word x / 64. Rows of WordsPerRow() words are stored in z-major order,
+// and bits past the width are kept clear.
+class BitMask
+{
+public:
+    BitMask();
+
+    // Sets the size and clears every voxel
+    void Resize(int width, int height, int depth);
+
+    // Voxels of labels equal to material; labels are compared and packed 16
+    // at a time, slices spread across the workers
+    void Build(const BrickedVolume& labels, unsigned char material);
+
+    void Invert();
+    unsigned long long Count() const;
+
+    bool IsEmpty() const { return m_words.empty(); }
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    int Depth() const { return m_depth; }
+    int WordsPerRow() const { return m_wordsPerRow; }
+    size_t RowPitch() const { return m_wordsPerRow; }
+    size_t SlicePitch() const { return static_cast<size_t>(m_wordsPerRow) * m_height; }
+
+    // Valid bits of a row's last word
+    unsigned long long TailMask() const { return m_tailMask; }
+
+    unsigned long long* Row(int y, int z) { return m_words.data() + SlicePitch() * z + RowPitch() * y; }
+    const unsigned long long* Row(int y, int z) const { return m_words.data() + SlicePitch() * z + RowPitch() * y; }
+    bool Get(int x, int y, int z) const { return (Row(y, z)[x >> 6] >> (x & 63)) & 1; }
+
+    void Swap(BitMask& other);
+
+private:
+    int m_width;
+    int m_height;
+    int m_depth;
+    int m_wordsPerRow;
+    unsigned long long m_tailMask;
+    std::vector<unsigned long long> m_words;
+};
+
+// Erodes, dilates, opens or closes mask in place. Voxels outside the volume
+// are ignored, so erosion does not eat in from the volume faces.
+//
+// Box elements are separable: along x each row is shifted and ORed with
+// itself in doubling steps, and along y and z whole rows of words are
+// combined with the van Herk / Gil-Werman running maximum, three word
+// operations per voxel word whatever the radius. Balls up to radius 3 OR
+// the rows of the disc in y and z that share an x half-width, then dilate
+// that union along x once per half-width. Larger balls threshold a squared
+// distance transform instead, which needs four bytes per voxel of scratch.
+// Erosion is the complement of dilating the complement. Returns false for
+// an unknown operation or element, or a negative radius.
+bool ApplyMorphology(BitMask& mask, int operation, int element, int radius);
+
+// Rewrites the z-major labels where before and after differ: voxels set in
+// after take set, voxels cleared take cleared. Unchanged words are skipped.
+void WriteMaskChanges(const BitMask& before, const BitMask& after, unsigned char set, unsigned char cleared,
+    unsigned char* labels);
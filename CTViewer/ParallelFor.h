@@ -0,0 +1,89 @@
+// ParallelFor.h
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads used by the CPU kernels
+inline int GetWorkerCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? static_cast<int>(count) : 1;
+}
+
+// True on threads that already run one of several concurrent jobs (whole
+// frames of a batch), so the kernels they call run serially instead of
+// oversubscribing the cores
+inline bool& IsSerialWorker()
+{
+    thread_local bool serial = false;
+    return serial;
+}
+
+// Splits [begin, end) into one contiguous range per worker and calls
+// body(threadIndex, rangeBegin, rangeEnd). Thread indices are dense in
+// [0, GetWorkerCount()) so callers can keep per-thread accumulators.
+template <typename Body>
+void ParallelForRange(int begin, int end, Body body)
+{
+    int count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+
+    int workers = IsSerialWorker() ? 1 : GetWorkerCount();
+    if (workers > count) {
+        workers = count;
+    }
+
+    if (workers == 1) {
+        body(0, begin, end);
+        return;
+    }
+
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+
+    for (int t = 0; t < workers; t++) {
+        int rangeBegin = begin + static_cast<int>(static_cast<long long>(count) * t / workers);
+        int rangeEnd = begin + static_cast<int>(static_cast<long long>(count) * (t + 1) / workers);
+        threads.emplace_back([&, t, rangeBegin, rangeEnd]() {
+            try {
+                body(t, rangeBegin, rangeEnd);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Hands out indices in [begin, end) one at a time from a shared counter and
+// calls body(threadIndex, index). Used where per-item cost varies a lot
+// (image rows, bricks), so static ranges would leave threads idle.
+template <typename Body>
+void ParallelForEach(int begin, int end, Body body)
+{
+    std::atomic<int> next(begin);
+    ParallelForRange(0, GetWorkerCount(), [&](int threadIndex, int, int) {
+        for (int i = next.fetch_add(1); i < end; i = next.fetch_add(1)) {
+            body(threadIndex, i);
+        }
+    });
+}
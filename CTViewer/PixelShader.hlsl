@@ -3,6 +3,12 @@
 // Textures and samplers
 Texture3D<float4> volumeTexture : register(t0);
 Texture3D<float4> labelTexture : register(t1);
+Texture3D<float2> brickRangeTexture : register(t3);   // per-brick min/max, mips form the min-max hierarchy
+Texture1D<float4> transferTexture : register(t4);     // 256-entry transfer function
+Texture3D<uint> brickFlagsTexture : register(t5);     // BrickVisibility flags per brick
+Texture2D<float4> preIntegratedTexture : register(t6); // segment colours indexed by (front, back) density
+Texture3D<float4> gradientTexture : register(t7);      // biased unit gradient in rgb, magnitude in a
+Texture2D<float4> transfer2DTexture : register(t8);    // step-corrected colours indexed by (density, magnitude)
 SamplerState volumeSampler : register(s0);
 
 // Constant buffer for rendering parameters
@@ -14,7 +20,20 @@ cbuffer RenderParams : register(b1)
     int renderMode;
     float4 volumeScale;
     int showLabels;
-    float2 padding;
+    float isoValue;     // normalized density of the isosurface
+    float stepScale;    // sample distance relative to BASE_STEP_SIZE
+    int preIntegrated;  // composite segments from preIntegratedTexture
+    float4 boxMin;      // content bounds in texture space
+    float4 boxMax;
+    float4 volumeDims;  // width, height, depth in voxels
+    float4 cropCircle;  // centre x/y and radius in voxels, w > 0 when enabled
+    float4 brickInfo;   // brick count (rounded up), brick size in voxels
+    float4 valueRange;  // global min/max density
+    int shading;        // ShadingFlags, 0 without a gradient texture
+    int transfer2D;     // classify by density and gradient magnitude
+    int clipPlaneCount;
+    int brickSkip;      // brickFlagsTexture is bound; without it no brick is skipped
+    float4 clipPlanes[6]; // texture space, dot(xyz, p) + w >= 0 is kept
 }
 
 // Material buffer
@@ -42,59 +61,515 @@ cbuffer CameraBuffer : register(b0)
     float cameraPadding;
 }
 
-// Ray-casting volume rendering
-float4 main(PixelInput input) : SV_TARGET 
+// Ray parameter interval inside an axis-aligned box
+float2 IntersectBox(float3 origin, float3 dir, float3 bmin, float3 bmax)
+{
+    float3 safeDir = abs(dir) < 1e-6f ? 1e-6f : dir;
+    float3 t0 = (bmin - origin) / safeDir;
+    float3 t1 = (bmax - origin) / safeDir;
+    float3 tNear = min(t0, t1);
+    float3 tFar = max(t0, t1);
+    return float2(max(max(tNear.x, tNear.y), tNear.z), min(min(tFar.x, tFar.y), tFar.z));
+}
+
+// Ray parameter interval inside the circular footprint (a cylinder along Z),
+// solved in voxel units so non-square slices stay circular
+float2 IntersectCircle(float3 origin, float3 dir)
+{
+    float2 o = origin.xy * volumeDims.xy - cropCircle.xy;
+    float2 d = dir.xy * volumeDims.xy;
+    float a = dot(d, d);
+    float c = dot(o, o) - cropCircle.z * cropCircle.z;
+
+    // Ray parallel to the cylinder axis: all or nothing
+    if (a < 1e-8f)
+        return c <= 0.0f ? float2(-1e30f, 1e30f) : float2(1.0f, 0.0f);
+
+    float b = dot(o, d);
+    float disc = b * b - a * c;
+    if (disc < 0.0f)
+        return float2(1.0f, 0.0f);
+
+    float root = sqrt(disc);
+    return float2((-b - root) / a, (-b + root) / a);
+}
+
+// Narrows a ray interval to the kept side of each clip plane
+float2 ClipSpan(float3 origin, float3 dir, float2 span)
+{
+    [loop]
+    for (int i = 0; i < clipPlaneCount; i++)
+    {
+        float distance = dot(clipPlanes[i].xyz, origin) + clipPlanes[i].w;
+        float rate = dot(clipPlanes[i].xyz, dir);
+        if (abs(rate) < 1e-8f)
+        {
+            if (distance < 0.0f)
+                return float2(1.0f, 0.0f);
+        }
+        else if (rate > 0.0f)
+        {
+            span.x = max(span.x, -distance / rate);
+        }
+        else
+        {
+            span.y = min(span.y, -distance / rate);
+        }
+    }
+    return span;
+}
+
+// Ray casting parameters
+static const int BASE_MAX_STEPS = 512;
+static const float BASE_STEP_SIZE = 0.005f;
+#define STEP_SIZE (BASE_STEP_SIZE * stepScale)
+#define MAX_STEPS ((int)(BASE_MAX_STEPS / stepScale + 0.5f))
+static const int RANGE_LEVELS = 5;      // BrickedVolume::RANGE_LEVELS
+
+// Render modes (RENDER_MODE_* in CpuRayCaster.h)
+static const int MODE_VOLUME = 0;
+static const int MODE_MIP = 1;
+static const int MODE_ISOSURFACE = 2;
+static const int MODE_MINIP = 3;
+static const int MODE_AVERAGE = 4;
+
+// Brick flags (BrickVisibility in TransferFunction.h)
+static const uint BRICK_VISIBLE = 1;
+static const uint BRICK_LABELLED = 2;
+
+// Shading flags (ShadingFlags in CpuRayCaster.h) and headlight Phong terms
+static const int SHADING_PHONG = 1;
+static const int SHADING_GRADIENT_OPACITY = 2;
+static const float LIGHT_AMBIENT = 0.3f;
+static const float LIGHT_DIFFUSE = 0.7f;
+static const float LIGHT_SPECULAR = 0.3f;
+static const float LIGHT_SHININESS = 16.0f;
+
+float SampleDensity(float3 pos)
+{
+    return volumeTexture.SampleLevel(volumeSampler, pos, 0).r;
+}
+
+// Label ids must not be interpolated, so they are loaded from the nearest voxel
+uint LoadLabel(float3 pos)
+{
+    int3 voxel = clamp(int3(pos * volumeDims.xyz), 0, int3(volumeDims.xyz) - 1);
+    return (uint)(labelTexture.Load(int4(voxel, 0)).r * 255.0f + 0.5f);
+}
+
+// Transfer-function lookup; texel centres sit on the 8-bit density values
+float4 Classify(float density)
+{
+    return transferTexture.SampleLevel(volumeSampler, (saturate(density) * 255.0f + 0.5f) / 256.0f, 0);
+}
+
+// Classified sample with its opacity corrected for the step size
+float4 ClassifyStep(float density)
+{
+    float4 color = Classify(density);
+    color.a = 1.0f - pow(saturate(1.0f - color.a), stepScale);
+    return color;
+}
+
+// 2D lookup by density and gradient magnitude; the table's alphas are
+// already corrected for the step size
+float4 Classify2D(float density, float magnitude)
+{
+    float2 uv = (saturate(float2(density, magnitude)) * 255.0f + 0.5f) / 256.0f;
+    return transfer2DTexture.SampleLevel(volumeSampler, uv, 0);
+}
+
+// Projection modes show the classified colour fully opaque
+float4 ClassifyOpaque(float density)
+{
+    return float4(Classify(density).rgb, 1.0f);
+}
+
+float4 BlendLabel(float4 color, float3 pos)
+{
+    if (showLabels > 0)
+    {
+        uint labelId = LoadLabel(pos);
+        if (labelId > 0)
+        {
+            Material mat = materials[min(labelId, 255)];
+            color = lerp(color, mat.color, mat.color.a);
+        }
+    }
+    return color;
+}
+
+// Encoded gradient magnitudes below one step carry no direction; such
+// samples are left unlit, as on the CPU
+static const float FLAT_GRADIENT = 1.0f / 255.0f;
+
+// World-space unit normal from an encoded gradient; the volume is stretched
+// to the [-1, 1] cube, so each voxel axis scales by its size
+float3 DecodeNormal(float4 gradient)
+{
+    float3 n = (gradient.rgb * 2.0f - 1.0f) * volumeDims.xyz;
+    float len = length(n);
+    return len > 0.0f ? n / len : float3(0, 0, 0);
+}
+
+float4 FetchGradient(float3 pos)
+{
+    return gradientTexture.SampleLevel(volumeSampler, pos, 0);
+}
+
+// Lights a straight-alpha sample and/or scales its opacity by the gradient
+// magnitude, from an already fetched gradient
+float4 ShadeSample(float4 color, float4 gradient, float3 dir)
+{
+    if ((shading & SHADING_PHONG) && gradient.a >= FLAT_GRADIENT)
+    {
+        float nd = abs(dot(DecodeNormal(gradient), dir));
+        color.rgb = color.rgb * (LIGHT_AMBIENT + LIGHT_DIFFUSE * nd) + LIGHT_SPECULAR * pow(nd, LIGHT_SHININESS);
+    }
+    if (shading & SHADING_GRADIENT_OPACITY)
+        color.a *= gradient.a;
+    return color;
+}
+
+// Volume size in bricks, fractional when a dimension is not a multiple of
+// the brick size (as brickDims on the CPU); brickInfo.xyz is the rounded-up
+// brick count
+float3 BrickScale()
+{
+    return volumeDims.xyz / brickInfo.w;
+}
+
+int3 BrickAt(float3 pos)
+{
+    return clamp(int3(floor(pos * BrickScale())), 0, int3(brickInfo.xyz) - 1);
+}
+
+// Value range of a brick (including its one-voxel apron)
+float2 BrickRange(int3 brick)
+{
+    return brickRangeTexture.Load(int4(brick, 0));
+}
+
+// First sample index past a hierarchy node (a brick at level 0), keeping
+// the ray's sample spacing
+int StepPastBrick(float3 origin, float3 dir, int3 node, float tEnter, int i, int level)
+{
+    float3 safeDir = abs(dir) < 1e-6f ? 1e-6f : dir;
+    float3 face = (node + (safeDir > 0.0f ? 1.0f : 0.0f)) * (float)(1 << level) / BrickScale();
+    float3 tFace = (face - origin) / safeDir;
+    float tBrick = min(min(tFace.x, tFace.y), tFace.z);
+    return max(i + 1, (int)ceil((tBrick - tEnter) / STEP_SIZE));
+}
+
+// Front-to-back compositing through the transfer function; bricks that map
+// to zero opacity (and hold no visible labels) are stepped over
+float4 MarchComposite(float3 origin, float3 dir, float2 span)
 {
-    float3 rayStart = input.texCoord;
-    float3 rayDir = normalize(input.worldPos - cameraPosition);
-    
-    // Ray casting parameters
-    const int MAX_STEPS = 512;
-    const float STEP_SIZE = 0.005f;
-    
-    // Accumulate color along ray
     float4 color = float4(0, 0, 0, 0);
-    float3 pos = rayStart;
-    
+    uint visibleMask = showLabels > 0 ? BRICK_VISIBLE | BRICK_LABELLED : BRICK_VISIBLE;
+    int3 lastBrick = int3(-1, -1, -1);
+
     // Main ray-casting loop - tell compiler NOT to unroll
+    int i = 0;
     [loop]
-    for (int i = 0; i < MAX_STEPS; i++) 
+    while (i < MAX_STEPS)
     {
-        // Check if we're outside the volume
-        if (any(pos < 0.0f) || any(pos > 1.0f))
+        // Check if we've left the content interval
+        float t = span.x + i * STEP_SIZE;
+        if (t > span.y)
             break;
-            
-        // Sample density from volume
-        float density = volumeTexture.Sample(volumeSampler, pos).r;
-        
-        // Apply brightness and contrast
-        density = (density - 0.5f) * contrast + 0.5f + brightness;
-        density = saturate(density);
-        
-        float4 sampleColor = float4(density, density, density, density * opacity);
-        
-        // If showing labels, blend with material colors
-        if (showLabels > 0) 
+
+        float3 pos = origin + dir * t;
+        int3 brick = BrickAt(pos);
+        if (any(brick != lastBrick))
         {
-            uint labelId = (uint)labelTexture.Sample(volumeSampler, pos).r;
-            if (labelId > 0) 
+            lastBrick = brick;
+            if (brickSkip != 0 && (brickFlagsTexture.Load(int4(brick, 0)) & visibleMask) == 0)
             {
-                Material mat = materials[min(labelId, 255)];
-                sampleColor = lerp(sampleColor, mat.color, mat.color.a);
+                i = StepPastBrick(origin, dir, brick, span.x, i, 0);
+                continue;
             }
         }
-        
+
+        // One gradient fetch serves both the 2D lookup and the shading
+        float density = SampleDensity(pos);
+        float4 gradient = shading != 0 || transfer2D != 0 ? FetchGradient(pos) : float4(0, 0, 0, 0);
+        float4 sampleColor = transfer2D != 0 ? Classify2D(density, gradient.a) : ClassifyStep(density);
+        sampleColor = ShadeSample(BlendLabel(sampleColor, pos), gradient, dir);
+
         // Front-to-back compositing
         color.rgb += (1.0f - color.a) * sampleColor.a * sampleColor.rgb;
         color.a += (1.0f - color.a) * sampleColor.a;
-        
+
         // Early ray termination
         if (color.a >= 0.95f)
             break;
-            
+
         // Move along ray
-        pos += rayDir * STEP_SIZE;
+        i++;
     }
-    
+
     return color;
 }
+
+// Composites the segments between consecutive samples from the
+// pre-integrated table; labels tint each segment at its front sample
+float4 MarchPreIntegrated(float3 origin, float3 dir, float2 span)
+{
+    float4 color = float4(0, 0, 0, 0);
+    uint visibleMask = showLabels > 0 ? BRICK_VISIBLE | BRICK_LABELLED : BRICK_VISIBLE;
+    int3 lastBrick = int3(-1, -1, -1);
+
+    float front = SampleDensity(origin + dir * span.x);
+    int i = 1;
+    [loop]
+    while (i < MAX_STEPS)
+    {
+        float t = span.x + i * STEP_SIZE;
+        if (t > span.y)
+            break;
+
+        float3 pos = origin + dir * t;
+        int3 brick = BrickAt(pos);
+        if (any(brick != lastBrick))
+        {
+            lastBrick = brick;
+            if (brickSkip != 0 && (brickFlagsTexture.Load(int4(brick, 0)) & visibleMask) == 0)
+            {
+                // The segment leading out of the skipped brick starts at its last sample
+                i = StepPastBrick(origin, dir, brick, span.x, i, 0);
+                front = SampleDensity(origin + dir * (span.x + (i - 1) * STEP_SIZE));
+                continue;
+            }
+        }
+
+        float back = SampleDensity(pos);
+        float2 uv = (saturate(float2(front, back)) * 255.0f + 0.5f) / 256.0f;
+        float4 segment = preIntegratedTexture.SampleLevel(volumeSampler, uv, 0);
+        if ((showLabels > 0 || shading != 0) && segment.a > 0.0f)
+        {
+            float3 frontPos = pos - dir * STEP_SIZE;
+            float4 straight = BlendLabel(float4(segment.rgb / segment.a, segment.a), frontPos);
+            if (shading != 0)
+                straight = ShadeSample(straight, FetchGradient(frontPos), dir);
+            segment = float4(straight.rgb * straight.a, straight.a);
+        }
+
+        color += (1.0f - color.a) * segment;
+        if (color.a >= 0.95f)
+            break;
+
+        front = back;
+        i++;
+    }
+
+    return color;
+}
+
+// Maximum or minimum intensity projection. Bricks that cannot beat the
+// running value are stepped over and the march ends at the global extreme.
+float4 MarchExtreme(float3 origin, float3 dir, float2 span, bool isMax)
+{
+    float sign = isMax ? 1.0f : -1.0f;
+    float limit = sign * (isMax ? valueRange.y : valueRange.x);
+    float best = -2.0f;    // running extreme, negated for MinIP
+    float bestT = span.x;
+    int3 lastBrick = int3(-1, -1, -1);
+
+    int i = 0;
+    [loop]
+    while (i < MAX_STEPS)
+    {
+        float t = span.x + i * STEP_SIZE;
+        if (t > span.y)
+            break;
+
+        float3 pos = origin + dir * t;
+        int3 brick = BrickAt(pos);
+        if (any(brick != lastBrick))
+        {
+            lastBrick = brick;
+            float2 range = BrickRange(brick);
+            if (sign * (isMax ? range.y : range.x) <= best)
+            {
+                i = StepPastBrick(origin, dir, brick, span.x, i, 0);
+                continue;
+            }
+        }
+
+        float value = sign * SampleDensity(pos);
+        if (value > best)
+        {
+            best = value;
+            bestT = t;
+            if (best >= limit)
+                break;
+        }
+        i++;
+    }
+
+    if (best < -1.5f)
+        return float4(0, 0, 0, 0);
+
+    return BlendLabel(ClassifyOpaque(sign * best), origin + dir * bestT);
+}
+
+// Average intensity projection; uniform bricks are added without sampling
+float4 MarchAverage(float3 origin, float3 dir, float2 span)
+{
+    int lastStep = min(MAX_STEPS - 1, (int)((span.y - span.x) / STEP_SIZE));
+    float sum = 0.0f;
+    int count = 0;
+    int3 lastBrick = int3(-1, -1, -1);
+
+    int i = 0;
+    [loop]
+    while (i <= lastStep)
+    {
+        float3 pos = origin + dir * (span.x + i * STEP_SIZE);
+        int3 brick = BrickAt(pos);
+        if (any(brick != lastBrick))
+        {
+            lastBrick = brick;
+            float2 range = BrickRange(brick);
+            if (range.x == range.y)
+            {
+                int next = min(lastStep + 1, StepPastBrick(origin, dir, brick, span.x, i, 0));
+                sum += (next - i) * range.x;
+                count += next - i;
+                i = next;
+                continue;
+            }
+        }
+
+        sum += SampleDensity(pos);
+        count++;
+        i++;
+    }
+
+    if (count == 0)
+        return float4(0, 0, 0, 0);
+
+    return BlendLabel(ClassifyOpaque(sum / count), origin + dir * (0.5f * (span.x + span.y)));
+}
+
+// Headlight diffuse shading from the precomputed gradient, or from a
+// central difference when no gradient texture is bound
+float4 ShadeSurface(float3 pos, float3 dir)
+{
+    float3 normal;
+    if (shading != 0 || transfer2D != 0)
+    {
+        float4 gradient = FetchGradient(pos);
+        normal = gradient.a >= FLAT_GRADIENT ? DecodeNormal(gradient) : dir;
+    }
+    else
+    {
+        float3 h = 1.0f / volumeDims.xyz;
+        float3 gradient = float3(
+            SampleDensity(pos + float3(h.x, 0, 0)) - SampleDensity(pos - float3(h.x, 0, 0)),
+            SampleDensity(pos + float3(0, h.y, 0)) - SampleDensity(pos - float3(0, h.y, 0)),
+            SampleDensity(pos + float3(0, 0, h.z)) - SampleDensity(pos - float3(0, 0, h.z)));
+        float len = length(gradient);
+        normal = len > 0.0f ? gradient / len : float3(0, 0, 0);
+    }
+    float diffuse = abs(dot(normal, dir));
+    float shade = 0.15f + 0.85f * diffuse;
+
+    float4 color = BlendLabel(float4(1, 1, 1, 1), pos);
+    return float4(color.rgb * shade, 1.0f);
+}
+
+// First hit of density >= isoValue. Bricks below the isovalue are widened to
+// the coarsest node of the min-max hierarchy that is still below it and
+// skipped whole; the crossing is then refined by bisection.
+float4 MarchIsosurface(float3 origin, float3 dir, float2 span)
+{
+    if (valueRange.y < isoValue)
+        return float4(0, 0, 0, 0);
+
+    int i = 0;
+    [loop]
+    while (i < MAX_STEPS)
+    {
+        float t = span.x + i * STEP_SIZE;
+        if (t > span.y)
+            break;
+
+        float3 pos = origin + dir * t;
+        int3 node = BrickAt(pos);
+        if (BrickRange(node).y < isoValue)
+        {
+            int level = 0;
+            [loop]
+            while (level + 1 < RANGE_LEVELS && brickRangeTexture.Load(int4(node >> 1, level + 1)).y < isoValue)
+            {
+                node >>= 1;
+                level++;
+            }
+            i = StepPastBrick(origin, dir, node, span.x, i, level);
+            continue;
+        }
+
+        if (SampleDensity(pos) >= isoValue)
+        {
+            // Everything before this sample was below the isovalue
+            if (i > 0)
+            {
+                float lo = t - STEP_SIZE;
+                float hi = t;
+                [unroll]
+                for (int k = 0; k < 6; k++)
+                {
+                    float mid = 0.5f * (lo + hi);
+                    if (SampleDensity(origin + dir * mid) >= isoValue)
+                        hi = mid;
+                    else
+                        lo = mid;
+                }
+                pos = origin + dir * hi;
+            }
+            return ShadeSurface(pos, dir);
+        }
+        i++;
+    }
+
+    return float4(0, 0, 0, 0);
+}
+
+// Ray-casting volume rendering
+float4 main(PixelInput input) : SV_TARGET 
+{
+    float3 rayStart = input.texCoord;
+    float3 rayDir = normalize(input.worldPos - cameraPosition);
+    
+    // Restrict the ray to the content bounds (and region of interest) and
+    // to the clip planes, so cut-away parts are never sampled
+    float2 span = IntersectBox(rayStart, rayDir, boxMin.xyz, boxMax.xyz);
+    if (cropCircle.w > 0.0f)
+    {
+        float2 circleSpan = IntersectCircle(rayStart, rayDir);
+        span = float2(max(span.x, circleSpan.x), min(span.y, circleSpan.y));
+    }
+    span = ClipSpan(rayStart, rayDir, span);
+    span.x = max(span.x, 0.0f);
+    if (span.x > span.y)
+        return float4(0, 0, 0, 0);
+    
+    [branch]
+    switch (renderMode)
+    {
+    case MODE_MIP:
+        return MarchExtreme(rayStart, rayDir, span, true);
+    case MODE_MINIP:
+        return MarchExtreme(rayStart, rayDir, span, false);
+    case MODE_AVERAGE:
+        return MarchAverage(rayStart, rayDir, span);
+    case MODE_ISOSURFACE:
+        return MarchIsosurface(rayStart, rayDir, span);
+    default:
+        if (preIntegrated > 0)
+            return MarchPreIntegrated(rayStart, rayDir, span);
+        return MarchComposite(rayStart, rayDir, span);
+    }
+}
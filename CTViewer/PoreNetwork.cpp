@@ -0,0 +1,169 @@
+// PoreNetwork.cpp
+#include "pch.h"
+#include "PoreNetwork.h"
+#include "Watershed.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+    // Slices accumulated together
+    const int SLAB_DEPTH = 16;
+
+    // Centroid sums and exposed faces of the pores whose bounds reach into
+    // one slab, listed by ascending id, plus the faces between two pores as
+    // first << 32 | second
+    struct PoreSlab
+    {
+        std::vector<unsigned int> ids;
+        std::vector<double> sums;
+        std::vector<unsigned long long> faces;
+        std::vector<unsigned long long> shared;
+    };
+
+    // Faces are counted from both sides, but shared once from the lower one
+    inline void AddFace(PoreSlab& slab, size_t slot, unsigned int id, unsigned int other, bool lower)
+    {
+        if (other == id) {
+            return;
+        }
+        slab.faces[slot]++;
+        if (lower && other != 0) {
+            slab.shared.push_back(static_cast<unsigned long long>(min(id, other)) << 32 | max(id, other));
+        }
+    }
+}
+
+int ExtractPoreNetwork(const BrickedVolume& labels, unsigned char material, float h, float voxelSize,
+    unsigned int* ids, std::vector<ComponentInfo>& components, std::vector<PoreInfo>& pores,
+    std::vector<ThroatInfo>& throats)
+{
+    pores.clear();
+    throats.clear();
+    std::vector<float> peaks;
+    std::vector<GrainContact> contacts;
+    int count = SeparateGrains(labels, material, h, ids, components, &peaks, &contacts);
+    if (count <= 0) {
+        return count;
+    }
+
+    // Each slab lists the pores its slices can hold, from their bounds, so
+    // the sums take space per pore and slab rather than per pore and worker
+    const int width = labels.Width(), height = labels.Height(), depth = labels.Depth();
+    const size_t sliceSize = static_cast<size_t>(width) * height;
+    std::vector<PoreSlab> slabs((depth + SLAB_DEPTH - 1) / SLAB_DEPTH);
+    for (int i = 0; i < count; i++) {
+        for (int s = components[i].bounds[2] / SLAB_DEPTH; s <= components[i].bounds[5] / SLAB_DEPTH; s++) {
+            slabs[s].ids.push_back(static_cast<unsigned int>(i + 1));
+        }
+    }
+    ParallelForEach(0, static_cast<int>(slabs.size()), [&](int, int s) {
+        PoreSlab& slab = slabs[s];
+        slab.sums.assign(slab.ids.size() * 3, 0.0);
+        slab.faces.assign(slab.ids.size(), 0);
+        unsigned int last = 0;
+        size_t slot = 0;
+        const int zEnd = min(depth, (s + 1) * SLAB_DEPTH);
+        for (int z = s * SLAB_DEPTH; z < zEnd; z++) {
+            for (int y = 0; y < height; y++) {
+                const unsigned int* row = ids + sliceSize * z + static_cast<size_t>(width) * y;
+                for (int x = 0; x < width; x++) {
+                    unsigned int id = row[x];
+                    if (id == 0) {
+                        continue;
+                    }
+                    if (id != last) {
+                        last = id;
+                        slot = std::lower_bound(slab.ids.begin(), slab.ids.end(), id) - slab.ids.begin();
+                    }
+                    double* sum = slab.sums.data() + slot * 3;
+                    sum[0] += x;
+                    sum[1] += y;
+                    sum[2] += z;
+                    if (x > 0) {
+                        AddFace(slab, slot, id, row[x - 1], false);
+                    }
+                    if (x + 1 < width) {
+                        AddFace(slab, slot, id, row[x + 1], true);
+                    }
+                    if (y > 0) {
+                        AddFace(slab, slot, id, row[x - width], false);
+                    }
+                    if (y + 1 < height) {
+                        AddFace(slab, slot, id, row[x + width], true);
+                    }
+                    if (z > 0) {
+                        AddFace(slab, slot, id, row[x - static_cast<ptrdiff_t>(sliceSize)], false);
+                    }
+                    if (z + 1 < depth) {
+                        AddFace(slab, slot, id, row[x + sliceSize], true);
+                    }
+                }
+            }
+        }
+    });
+
+    // Slabs merged in order, so the sums do not depend on the workers
+    std::vector<double> sums(static_cast<size_t>(count) * 3, 0.0);
+    std::vector<unsigned long long> faces(count, 0);
+    std::vector<unsigned long long> shared;
+    for (PoreSlab& slab : slabs) {
+        for (size_t k = 0; k < slab.ids.size(); k++) {
+            const size_t i = slab.ids[k] - 1;
+            for (int c = 0; c < 3; c++) {
+                sums[i * 3 + c] += slab.sums[k * 3 + c];
+            }
+            faces[i] += slab.faces[k];
+        }
+        shared.insert(shared.end(), slab.shared.begin(), slab.shared.end());
+        slab = PoreSlab();
+    }
+
+    const double area = static_cast<double>(voxelSize) * voxelSize;
+    pores.resize(count);
+    for (int i = 0; i < count; i++) {
+        PoreInfo& pore = pores[i];
+        double size = static_cast<double>(components[i].size);
+        pore.volume = size * area * voxelSize;
+        pore.area = faces[i] * area;
+        pore.radius = peaks[i] * voxelSize;
+        for (int c = 0; c < 3; c++) {
+            pore.center[c] = (sums[static_cast<size_t>(i) * 3 + c] / size + 0.5) * voxelSize;
+        }
+        pore.coordination = 0;
+    }
+
+    // Contacts and shared faces are both sorted by pore pair
+    std::sort(shared.begin(), shared.end());
+
+    throats.resize(contacts.size());
+    size_t next = 0;
+    for (size_t i = 0; i < contacts.size(); i++) {
+        const GrainContact& contact = contacts[i];
+        const unsigned long long key = static_cast<unsigned long long>(contact.first) << 32 | contact.second;
+        while (next < shared.size() && shared[next] < key) {
+            next++;
+        }
+        unsigned long long faces = 0;
+        for (; next < shared.size() && shared[next] == key; next++) {
+            faces++;
+        }
+
+        PoreInfo& a = pores[contact.first - 1];
+        PoreInfo& b = pores[contact.second - 1];
+        double dx = a.center[0] - b.center[0], dy = a.center[1] - b.center[1], dz = a.center[2] - b.center[2];
+        ThroatInfo& throat = throats[i];
+        throat.pore1 = static_cast<int>(contact.first);
+        throat.pore2 = static_cast<int>(contact.second);
+        throat.radius = contact.radius * voxelSize;
+        throat.length = max(static_cast<double>(voxelSize), sqrt(dx * dx + dy * dy + dz * dz) - a.radius - b.radius);
+        throat.volume = PI * throat.radius * throat.radius * throat.length;
+        throat.area = faces * area;
+        a.coordination++;
+        b.coordination++;
+    }
+    return count;
+}
@@ -0,0 +1,41 @@
+// PoreNetwork.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include "ConnectedComponents.h"
+#include <vector>
+
+// One pore; lengths are in the units of the voxel size
+struct PoreInfo
+{
+    double volume;
+    double area;          // faces shared with other voxels
+    double radius;        // inscribed radius, the largest distance to the solid
+    double center[3];     // centroid, voxel centres at i + 0.5, times the voxel size
+    int coordination;     // number of throats
+};
+
+// Throat between two pores, ids 1 to N as in the pore id volume
+struct ThroatInfo
+{
+    int pore1;
+    int pore2;
+    double radius;        // inscribed radius of the narrowest cross-section
+    double length;        // centre distance less both pore radii, at least one voxel
+    double volume;        // cylinder of radius and length
+    double area;          // faces the two pores share
+};
+
+// Pore network of the voxels labelled material (the pore phase). Pores are
+// the grains of SeparateGrains with marker depth h, so ids receives the pore
+// ids as there and pores[id - 1] describes pore id. Throats are the pores
+// that share faces; the watershed's basin graph already holds the radius of
+// each pore (its highest distance) and of each throat (the saddle between
+// the pores), so one parallel pass over ids adds the centroids, surface
+// and throat areas. That pass runs over slabs of 16 slices, each summing
+// only the pores whose bounds reach into it, so its scratch grows with the
+// pore count rather than pores times workers. Throats are sorted by pore
+// pair. Returns N.
+int ExtractPoreNetwork(const BrickedVolume& labels, unsigned char material, float h, float voxelSize,
+    unsigned int* ids, std::vector<ComponentInfo>& components, std::vector<PoreInfo>& pores,
+    std::vector<ThroatInfo>& throats);
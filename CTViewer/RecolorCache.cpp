@@ -0,0 +1,112 @@
+// RecolorCache.cpp
+#include "pch.h"
+#include "RecolorCache.h"
+#include "ParallelFor.h"
+
+namespace
+{
+    inline unsigned char ToByte(float v)
+    {
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        return static_cast<unsigned char>(v * 255.0f + 0.5f);
+    }
+}
+
+RecolorCache::RecolorCache()
+    : m_valid(false), m_width(0), m_height(0), m_params(), m_camera()
+{
+    memset(m_materials, 0, sizeof(m_materials));
+}
+
+void RecolorCache::Invalidate()
+{
+    m_valid = false;
+}
+
+int RecolorCache::Render(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera& camera,
+    int width, int height, unsigned char* rgba)
+{
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    bool reuse = m_valid && params.materials && width == m_width && height == m_height
+        && SameRenderSettings(params, m_params) && SameCamera(camera, m_camera);
+
+    if (!reuse) {
+        m_color.resize(pixelCount * 4);
+        m_deep.resize(pixelCount);
+        CpuRayCaster::RenderMasked(volume, labels, params, camera, width, height,
+            nullptr, m_color.data(), nullptr, m_deep.data());
+        if (params.materials) {
+            memcpy(m_materials, params.materials, sizeof(m_materials));
+        }
+        m_params = params;
+        m_camera = camera;
+        m_width = width;
+        m_height = height;
+        m_valid = true;
+        memcpy(rgba, m_color.data(), pixelCount * 4);
+        return static_cast<int>(pixelCount);
+    }
+
+    // Which materials changed, and how (label 0 is never blended)
+    unsigned char colorChanged[256] = {};
+    unsigned char alphaChanged[256] = {};
+    bool anyChange = false;
+    for (int label = 1; label < 256; label++) {
+        const float* before = m_materials + label * 4;
+        const float* after = params.materials + label * 4;
+        colorChanged[label] = before[0] != after[0] || before[1] != after[1] || before[2] != after[2];
+        alphaChanged[label] = before[3] != after[3];
+        anyChange = anyChange || colorChanged[label] || alphaChanged[label];
+    }
+
+    int cast = 0;
+    if (anyChange) {
+        // Recomposite in place; pixels that cannot be are cast below
+        m_mask.assign(pixelCount, 0);
+        const float* materials = params.materials;
+        ParallelForRange(0, height, [&](int, int yBegin, int yEnd) {
+            for (size_t i = static_cast<size_t>(yBegin) * width; i < static_cast<size_t>(yEnd) * width; i++) {
+                const DeepPixel& deep = m_deep[i];
+                if (deep.count == DEEP_PIXEL_OVERFLOW) {
+                    m_mask[i] = 1;
+                    continue;
+                }
+
+                bool recolor = false;
+                for (int k = 0; k < deep.count; k++) {
+                    m_mask[i] |= alphaChanged[deep.labels[k]];
+                    recolor = recolor || colorChanged[deep.labels[k]];
+                }
+                if (m_mask[i] || !recolor) {
+                    continue;
+                }
+
+                float rgb[3] = { deep.rest[0], deep.rest[1], deep.rest[2] };
+                for (int k = 0; k < deep.count; k++) {
+                    const float* mat = materials + 4 * deep.labels[k];
+                    float w = deep.weights[k] * (1.0f / 65535.0f);
+                    rgb[0] += w * mat[0];
+                    rgb[1] += w * mat[1];
+                    rgb[2] += w * mat[2];
+                }
+                unsigned char* out = &m_color[i * 4];
+                out[0] = ToByte(rgb[0]);
+                out[1] = ToByte(rgb[1]);
+                out[2] = ToByte(rgb[2]);
+            }
+        });
+
+        for (size_t i = 0; i < pixelCount; i++) {
+            cast += m_mask[i];
+        }
+        if (cast > 0) {
+            CpuRayCaster::RenderMasked(volume, labels, params, camera, width, height,
+                m_mask.data(), m_color.data(), nullptr, m_deep.data());
+        }
+        memcpy(m_materials, params.materials, sizeof(m_materials));
+    }
+
+    memcpy(rgba, m_color.data(), pixelCount * 4);
+    return cast;
+}
@@ -0,0 +1,39 @@
+// RecolorCache.h
+#pragma once
+
+#include "CpuRayCaster.h"
+#include <vector>
+
+// Keeps the deep pixels of the last CPU frame so material edits do not need
+// a full ray cast. When only material colours change, every pixel is
+// recomposited from its recorded weights in one pass. When a material's
+// alpha changes, only pixels whose rays reached that label (and pixels
+// whose record overflowed) are cast again. Any other change - camera,
+// settings, size - casts the whole frame.
+class RecolorCache
+{
+public:
+    RecolorCache();
+
+    // Drops the cached frame; call when data behind the parameter pointers
+    // other than the materials changes (volumes, tables)
+    void Invalidate();
+
+    // Same image contract as CpuRayCaster::Render; returns the number of
+    // pixels ray cast
+    int Render(const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera,
+        int width, int height, unsigned char* rgba);
+
+private:
+    bool m_valid;
+    int m_width;
+    int m_height;
+    CpuRenderParams m_params;
+    CpuCamera m_camera;
+    float m_materials[256 * 4];     // materials the cached frame used
+
+    std::vector<unsigned char> m_color;
+    std::vector<DeepPixel> m_deep;
+    std::vector<unsigned char> m_mask;
+};
@@ -0,0 +1,139 @@
+// ReprojectionCache.cpp
+#include "pch.h"
+#include "ReprojectionCache.h"
+#include <cmath>
+
+namespace
+{
+    // Reuse limit of a pixel: MAX_AGE minus an ordered 0-3 offset
+    inline int AgeLimit(int x, int y)
+    {
+        return ReprojectionCache::MAX_AGE - (((x * 5 + y * 3) & 7) >> 1);
+    }
+}
+
+ReprojectionCache::ReprojectionCache()
+    : m_valid(false), m_width(0), m_height(0), m_params(), m_camera()
+{
+}
+
+void ReprojectionCache::Invalidate()
+{
+    m_valid = false;
+}
+
+void ReprojectionCache::Reproject(const CpuCamera& camera)
+{
+    const CpuProjection from = CpuRayCaster::GetProjection(m_camera, m_width, m_height);
+    const CpuProjection to = CpuRayCaster::GetProjection(camera, m_width, m_height);
+
+    // Screen position from a view-space offset: ndcX = (v . right) / (z * |right|^2)
+    const float rightScale = 1.0f / (to.right[0] * to.right[0] + to.right[1] * to.right[1] + to.right[2] * to.right[2]);
+    const float upScale = 1.0f / (to.up[0] * to.up[0] + to.up[1] * to.up[1] + to.up[2] * to.up[2]);
+
+    for (int y = 0; y < m_height; y++) {
+        float ndcY = 1.0f - 2.0f * (y + 0.5f) / m_height;
+        for (int x = 0; x < m_width; x++) {
+            size_t source = static_cast<size_t>(y) * m_width + x;
+            float t = m_depth[source];
+            if (t < 0.0f) {
+                continue;
+            }
+
+            // Hit point along the pixel's previous ray
+            float ndcX = 2.0f * (x + 0.5f) / m_width - 1.0f;
+            float dir[3];
+            float length = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                dir[c] = from.forward[c] + from.right[c] * ndcX + from.up[c] * ndcY;
+                length += dir[c] * dir[c];
+            }
+            float scale = t / sqrtf(length);
+            float v[3];
+            for (int c = 0; c < 3; c++) {
+                v[c] = from.origin[c] + dir[c] * scale - to.origin[c];
+            }
+
+            float z = v[0] * to.forward[0] + v[1] * to.forward[1] + v[2] * to.forward[2];
+            if (z <= 1e-6f) {
+                continue;
+            }
+            float nx = (v[0] * to.right[0] + v[1] * to.right[1] + v[2] * to.right[2]) * rightScale / z;
+            float ny = (v[0] * to.up[0] + v[1] * to.up[1] + v[2] * to.up[2]) * upScale / z;
+            int tx = static_cast<int>(floorf((nx + 1.0f) * 0.5f * m_width));
+            int ty = static_cast<int>(floorf((1.0f - ny) * 0.5f * m_height));
+            if (tx < 0 || tx >= m_width || ty < 0 || ty >= m_height) {
+                continue;
+            }
+
+            // Nearest surface wins where several points land on one pixel
+            size_t target = static_cast<size_t>(ty) * m_width + tx;
+            float distance = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            if (!m_mask[target] && distance >= m_nextDepth[target]) {
+                continue;
+            }
+            memcpy(&m_nextColor[target * 4], &m_color[source * 4], 4);
+            m_nextDepth[target] = distance;
+            m_nextAge[target] = static_cast<unsigned char>(m_age[source] + 1);
+            m_mask[target] = 0;
+        }
+    }
+}
+
+int ReprojectionCache::Render(const BrickedVolume& volume, const BrickedVolume* labels,
+    const CpuRenderParams& params, const CpuCamera& camera,
+    int width, int height, unsigned char* rgba)
+{
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    bool reuse = m_valid && width == m_width && height == m_height && SameRenderSettings(params, m_params);
+
+    m_nextColor.resize(pixelCount * 4);
+    m_nextDepth.resize(pixelCount);
+    m_nextAge.resize(pixelCount);
+    m_mask.assign(pixelCount, 1);
+
+    if (reuse && SameCamera(camera, m_camera)) {
+        // Static view: keep what was cast last frame and recast the rest
+        for (size_t i = 0; i < pixelCount; i++) {
+            if (m_age[i] == 0) {
+                m_mask[i] = 0;
+            }
+        }
+        m_nextColor.swap(m_color);
+        m_nextDepth.swap(m_depth);
+        m_nextAge.swap(m_age);
+    }
+    else if (reuse) {
+        Reproject(camera);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = static_cast<size_t>(y) * width + x;
+                if (!m_mask[i] && m_nextAge[i] >= AgeLimit(x, y)) {
+                    m_mask[i] = 1;
+                }
+            }
+        }
+    }
+
+    int cast = 0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        if (m_mask[i]) {
+            m_nextAge[i] = 0;
+            cast++;
+        }
+    }
+    CpuRayCaster::RenderMasked(volume, labels, params, camera, width, height,
+        m_mask.data(), m_nextColor.data(), m_nextDepth.data());
+
+    m_color.swap(m_nextColor);
+    m_depth.swap(m_nextDepth);
+    m_age.swap(m_nextAge);
+    m_params = params;
+    m_camera = camera;
+    m_width = width;
+    m_height = height;
+    m_valid = true;
+
+    memcpy(rgba, m_color.data(), pixelCount * 4);
+    return cast;
+}
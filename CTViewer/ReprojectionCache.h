@@ -0,0 +1,55 @@
+// ReprojectionCache.h
+#pragma once
+
+#include "CpuRayCaster.h"
+#include <vector>
+
+// Temporal reuse of CPU frames while the camera orbits. Each pixel keeps the
+// colour and hit distance of its last ray; the next frame forward-projects
+// those hit points into the new view (nearest point wins per pixel) and ray
+// casts only what nothing landed on - disocclusions, cracks and pixels
+// outside the content - plus pixels that have been carried over MAX_AGE
+// frames, so the error of reused colours stays bounded during motion. Empty
+// rays are carried as the point where they left the content, so any surface
+// landing on the same pixel wins the depth test over them. Once the camera
+// stops, every carried pixel is cast again and the image converges to the
+// exact frame.
+class ReprojectionCache
+{
+public:
+    // Frames a pixel may be carried over before it is cast again; pixels
+    // are staggered over the last quarter of the range so refreshes spread
+    static const int MAX_AGE = 8;
+
+    ReprojectionCache();
+
+    // Drops the cached frame so the next one is cast in full. Render detects
+    // setting and size changes itself; call this when data behind the
+    // parameter pointers changes (volumes, tables, materials).
+    void Invalidate();
+
+    // Same image contract as CpuRayCaster::Render; returns the number of
+    // pixels ray cast
+    int Render(const BrickedVolume& volume, const BrickedVolume* labels,
+        const CpuRenderParams& params, const CpuCamera& camera,
+        int width, int height, unsigned char* rgba);
+
+private:
+    // Moves the cached hit points into the next frame's buffers for camera
+    void Reproject(const CpuCamera& camera);
+
+    bool m_valid;
+    int m_width;
+    int m_height;
+    CpuRenderParams m_params;
+    CpuCamera m_camera;
+
+    std::vector<unsigned char> m_color;     // RGBA8 per pixel
+    std::vector<float> m_depth;             // hit distance, < 0 outside the content
+    std::vector<unsigned char> m_age;       // frames carried since cast
+
+    std::vector<unsigned char> m_nextColor;
+    std::vector<float> m_nextDepth;
+    std::vector<unsigned char> m_nextAge;
+    std::vector<unsigned char> m_mask;      // pixels to cast this frame
+};
@@ -0,0 +1,450 @@
+// Reslice.cpp
+#include "pch.h"
+#include "Reslice.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace
+{
+    // Axis and direction of a unit voxel axis vector, or -1
+    int UnitAxis(const float* d, int& step)
+    {
+        int axis = -1;
+        for (int c = 0; c < 3; c++) {
+            if (d[c] == 0.0f) {
+                continue;
+            }
+            if (axis >= 0 || (d[c] != 1.0f && d[c] != -1.0f)) {
+                return -1;
+            }
+            axis = c;
+            step = d[c] > 0.0f ? 1 : -1;
+        }
+        return axis;
+    }
+
+    bool IsIntegral(const float* p)
+    {
+        return p[0] == floorf(p[0]) && p[1] == floorf(p[1]) && p[2] == floorf(p[2]);
+    }
+
+    // A row from an integral start along a unit axis lands on voxel
+    // centres, where every interpolation returns the voxel itself
+    void CopyAlignedRow(const BrickedVolume& volume, const int* start, int uAxis, int uStep, int width,
+        unsigned char* out, unsigned char* inside)
+    {
+        const int size[3] = { volume.Width(), volume.Height(), volume.Depth() };
+        const size_t* offsets[3] = { volume.OffsetsX(), volume.OffsetsY(), volume.OffsetsZ() };
+        const int a = (uAxis + 1) % 3, b = (uAxis + 2) % 3;
+
+        // Pixels inside [iBegin, iEnd) hit the volume along u
+        int iBegin = 0, iEnd = 0;
+        if (start[a] >= 0 && start[a] < size[a] && start[b] >= 0 && start[b] < size[b]) {
+            int first = start[uAxis];
+            iBegin = uStep > 0 ? max(0, -first) : max(0, first - (size[uAxis] - 1));
+            iEnd = uStep > 0 ? min(width, size[uAxis] - first) : min(width, first + 1);
+            iBegin = min(iBegin, width);
+            iEnd = max(iEnd, iBegin);
+
+            const unsigned char* base = volume.Data() + offsets[a][start[a]] + offsets[b][start[b]];
+            const size_t* along = offsets[uAxis];
+            for (int i = iBegin, c = first + iBegin * uStep; i < iEnd; i++, c += uStep) {
+                out[i] = base[along[c]];
+            }
+        }
+
+        memset(out, 0, iBegin);
+        memset(out + iEnd, 0, width - iEnd);
+        if (inside) {
+            memset(inside, 0, iBegin);
+            memset(inside + iBegin, 1, iEnd - iBegin);
+            memset(inside + iEnd, 0, width - iEnd);
+        }
+    }
+
+    // Catmull-Rom weights for the taps at -1, 0, 1, 2 around t in [0, 1)
+    void CubicWeights(float t, float* w)
+    {
+        float t2 = t * t, t3 = t2 * t;
+        w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+        w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+        w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+        w[3] = 0.5f * (t3 - t2);
+    }
+
+    // Four taps per axis around a clamped coordinate, repeating the edge
+    float CubicTaps(float x, int size, const size_t* offsets, size_t* taps)
+    {
+        x = max(0.0f, min(static_cast<float>(size - 1), x));
+        int x0 = static_cast<int>(x);
+        for (int k = 0; k < 4; k++) {
+            taps[k] = offsets[max(0, min(size - 1, x0 - 1 + k))];
+        }
+        return x - x0;
+    }
+
+    // 64-tap tricubic sample; the four taps along x are weighted as one
+    // vector, so each (y, z) pair costs a gather and a multiply-add
+    float SampleCubic(const BrickedVolume& volume, float x, float y, float z)
+    {
+        size_t ox[4], oy[4], oz[4];
+        float wx[4], wy[4], wz[4];
+        CubicWeights(CubicTaps(x, volume.Width(), volume.OffsetsX(), ox), wx);
+        CubicWeights(CubicTaps(y, volume.Height(), volume.OffsetsY(), oy), wy);
+        CubicWeights(CubicTaps(z, volume.Depth(), volume.OffsetsZ(), oz), wz);
+
+        const unsigned char* data = volume.Data();
+        __m128 weightX = _mm_loadu_ps(wx);
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < 4; k++) {
+            for (int j = 0; j < 4; j++) {
+                const unsigned char* p = data + oy[j] + oz[k];
+                __m128 taps = _mm_setr_ps(p[ox[0]], p[ox[1]], p[ox[2]], p[ox[3]]);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(taps, weightX), _mm_set1_ps(wy[j] * wz[k])));
+            }
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, sum);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    // Shape of an axis slice inside the bricks: the volume axes along its
+    // rows (a) and columns (b) and the voxel stride of each within a brick
+    struct AxisPlane
+    {
+        int a;
+        int b;
+        int strideA;
+        int strideB;
+    };
+
+    AxisPlane GetAxisPlane(int axis)
+    {
+        const int stride[3] = { 1, BrickedVolume::BRICK_SIZE, BrickedVolume::BRICK_SIZE * BrickedVolume::BRICK_SIZE };
+        AxisPlane plane;
+        plane.a = axis == 0 ? 1 : 0;
+        plane.b = axis == 2 ? 1 : 2;
+        plane.strideA = stride[plane.a];
+        plane.strideB = stride[plane.b];
+        return plane;
+    }
+
+    // Full-resolution slice, one 8x8 tile per brick
+    void CopyAxisSlice(const BrickedVolume& volume, int axis, int index, unsigned char* out)
+    {
+        const int size[3] = { volume.Width(), volume.Height(), volume.Depth() };
+        const int bricks[3] = { volume.BricksX(), volume.BricksY(), volume.BricksZ() };
+        const int shift = BrickedVolume::BRICK_SHIFT;
+        const int brickSize = BrickedVolume::BRICK_SIZE;
+        const AxisPlane plane = GetAxisPlane(axis);
+        const int stride[3] = { 1, brickSize, brickSize * brickSize };
+        const int width = size[plane.a];
+
+        ParallelForEach(0, bricks[plane.b], [&](int, int tileB) {
+            int coords[3];
+            coords[axis] = index >> shift;
+            coords[plane.b] = tileB;
+            int rows = min(brickSize, size[plane.b] - (tileB << shift));
+            size_t inBrick = static_cast<size_t>(index & (brickSize - 1)) * stride[axis];
+
+            for (int tileA = 0; tileA < bricks[plane.a]; tileA++) {
+                coords[plane.a] = tileA;
+                const unsigned char* brick = volume.Brick(coords[0], coords[1], coords[2]) + inBrick;
+
+                // Neighbouring bricks along a row are far apart in memory for
+                // YZ and XZ slices, so start loading the next tile's lines now
+                if (tileA + 1 < bricks[plane.a]) {
+                    coords[plane.a] = tileA + 1;
+                    const unsigned char* next = volume.Brick(coords[0], coords[1], coords[2]) + inBrick;
+                    for (int k = 0; k < rows; k++) {
+                        _mm_prefetch(reinterpret_cast<const char*>(next + k * plane.strideB), _MM_HINT_T0);
+                    }
+                }
+
+                int columns = min(brickSize, width - (tileA << shift));
+                for (int k = 0; k < rows; k++) {
+                    const unsigned char* src = brick + k * plane.strideB;
+                    unsigned char* dst = out + static_cast<size_t>((tileB << shift) + k) * width + (tileA << shift);
+                    if (plane.strideA == 1) {
+                        memcpy(dst, src, columns);
+                    }
+                    else {
+                        for (int i = 0; i < columns; i++) {
+                            dst[i] = src[i * plane.strideA];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Samples width pixels starting at position p and stepping by u, four
+    // at a time: coordinates, clamping and weights are computed in SSE2,
+    // the eight corner voxels of each pixel are gathered scalar
+    void SampleRow(const BrickedVolume& volume, const float* p, const float* u, int width,
+        int interpolation, unsigned char* out, unsigned char* inside)
+    {
+        const float maxX = static_cast<float>(volume.Width() - 1);
+        const float maxY = static_cast<float>(volume.Height() - 1);
+        const float maxZ = static_cast<float>(volume.Depth() - 1);
+        const size_t* offX = volume.OffsetsX();
+        const size_t* offY = volume.OffsetsY();
+        const size_t* offZ = volume.OffsetsZ();
+        const unsigned char* data = volume.Data();
+
+        const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 upperX = _mm_set1_ps(maxX), upperY = _mm_set1_ps(maxY), upperZ = _mm_set1_ps(maxZ);
+
+        for (int i = 0; i < width; i += 4) {
+            __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lane);
+            __m128 x = _mm_add_ps(_mm_set1_ps(p[0]), _mm_mul_ps(index, _mm_set1_ps(u[0])));
+            __m128 y = _mm_add_ps(_mm_set1_ps(p[1]), _mm_mul_ps(index, _mm_set1_ps(u[1])));
+            __m128 z = _mm_add_ps(_mm_set1_ps(p[2]), _mm_mul_ps(index, _mm_set1_ps(u[2])));
+
+            // Inside the voxel extents [-0.5, size - 0.5] on every axis
+            __m128 inVolume = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(x, half), zero), _mm_cmple_ps(_mm_sub_ps(x, half), upperX)),
+                _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(y, half), zero), _mm_cmple_ps(_mm_sub_ps(y, half), upperY)),
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(z, half), zero), _mm_cmple_ps(_mm_sub_ps(z, half), upperZ))));
+
+            __m128 value;
+            if (_mm_movemask_ps(inVolume) == 0) {
+                value = zero;
+            }
+            else if (interpolation == SLICE_CUBIC) {
+                float xs[4], ys[4], zs[4], values[4];
+                _mm_storeu_ps(xs, x);
+                _mm_storeu_ps(ys, y);
+                _mm_storeu_ps(zs, z);
+                int mask = _mm_movemask_ps(inVolume);
+                for (int k = 0; k < 4; k++) {
+                    values[k] = (mask & (1 << k)) ? SampleCubic(volume, xs[k], ys[k], zs[k]) : 0.0f;
+                }
+                value = _mm_loadu_ps(values);
+            }
+            else {
+                x = _mm_max_ps(zero, _mm_min_ps(upperX, x));
+                y = _mm_max_ps(zero, _mm_min_ps(upperY, y));
+                z = _mm_max_ps(zero, _mm_min_ps(upperZ, z));
+                if (interpolation == SLICE_NEAREST) {
+                    x = _mm_add_ps(x, half);
+                    y = _mm_add_ps(y, half);
+                    z = _mm_add_ps(z, half);
+                }
+
+                // Truncation is floor for the clamped, non-negative coordinates
+                __m128i xi = _mm_cvttps_epi32(x), yi = _mm_cvttps_epi32(y), zi = _mm_cvttps_epi32(z);
+                int ix[4], iy[4], iz[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(ix), xi);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(iy), yi);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(iz), zi);
+
+                if (interpolation == SLICE_NEAREST) {
+                    float values[4];
+                    for (int k = 0; k < 4; k++) {
+                        values[k] = data[offX[ix[k]] + offY[iy[k]] + offZ[iz[k]]];
+                    }
+                    value = _mm_loadu_ps(values);
+                }
+                else {
+                    float c[8][4];
+                    for (int k = 0; k < 4; k++) {
+                        size_t ox0 = offX[ix[k]], ox1 = offX[ix[k] + 1];
+                        size_t oy0 = offY[iy[k]], oy1 = offY[iy[k] + 1];
+                        size_t oz0 = offZ[iz[k]], oz1 = offZ[iz[k] + 1];
+                        c[0][k] = data[ox0 + oy0 + oz0];
+                        c[1][k] = data[ox1 + oy0 + oz0];
+                        c[2][k] = data[ox0 + oy1 + oz0];
+                        c[3][k] = data[ox1 + oy1 + oz0];
+                        c[4][k] = data[ox0 + oy0 + oz1];
+                        c[5][k] = data[ox1 + oy0 + oz1];
+                        c[6][k] = data[ox0 + oy1 + oz1];
+                        c[7][k] = data[ox1 + oy1 + oz1];
+                    }
+
+                    __m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(xi));
+                    __m128 fy = _mm_sub_ps(y, _mm_cvtepi32_ps(yi));
+                    __m128 fz = _mm_sub_ps(z, _mm_cvtepi32_ps(zi));
+                    auto lerp = [](__m128 a, __m128 b, __m128 f) {
+                        return _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(b, a)));
+                    };
+                    __m128 c00 = lerp(_mm_loadu_ps(c[0]), _mm_loadu_ps(c[1]), fx);
+                    __m128 c10 = lerp(_mm_loadu_ps(c[2]), _mm_loadu_ps(c[3]), fx);
+                    __m128 c01 = lerp(_mm_loadu_ps(c[4]), _mm_loadu_ps(c[5]), fx);
+                    __m128 c11 = lerp(_mm_loadu_ps(c[6]), _mm_loadu_ps(c[7]), fx);
+                    value = lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+                }
+                value = _mm_and_ps(value, inVolume);
+            }
+
+            // Round, saturate to 0-255 (cubic overshoots) and store up to four bytes
+            __m128i bytes = _mm_cvtps_epi32(value);
+            bytes = _mm_packs_epi32(bytes, bytes);
+            bytes = _mm_packus_epi16(bytes, bytes);
+            int packed = _mm_cvtsi128_si32(bytes);
+            int count = min(4, width - i);
+            memcpy(out + i, &packed, count);
+            if (inside) {
+                int mask = _mm_movemask_ps(inVolume);
+                for (int k = 0; k < count; k++) {
+                    inside[i + k] = static_cast<unsigned char>((mask >> k) & 1);
+                }
+            }
+        }
+    }
+}
+
+void ExtractSlice(const BrickedVolume& volume, const float* origin, const float* u, const float* v,
+    int width, int height, int interpolation, unsigned char* out)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if (volume.IsEmpty()) {
+        memset(out, 0, static_cast<size_t>(width) * height);
+        return;
+    }
+
+    // Planes spanned by unit axes through voxel centres copy every row
+    int uStep = 0, vStep = 0;
+    int uAxis = UnitAxis(u, uStep);
+    int vAxis = UnitAxis(v, vStep);
+    if (uAxis >= 0 && vAxis >= 0 && uAxis != vAxis && IsIntegral(origin)) {
+        ParallelForEach(0, height, [&](int, int j) {
+            int start[3] = { static_cast<int>(origin[0]), static_cast<int>(origin[1]), static_cast<int>(origin[2]) };
+            start[vAxis] += j * vStep;
+            CopyAlignedRow(volume, start, uAxis, uStep, width, out + static_cast<size_t>(j) * width, nullptr);
+        });
+        return;
+    }
+
+    ParallelForEach(0, height, [&](int, int j) {
+        float p[3];
+        for (int c = 0; c < 3; c++) {
+            p[c] = origin[c] + j * v[c];
+        }
+        SampleRow(volume, p, u, width, interpolation, out + static_cast<size_t>(j) * width, nullptr);
+    });
+}
+
+void SampleSliceRow(const BrickedVolume& volume, const float* p, const float* u, int width,
+    int interpolation, unsigned char* out, unsigned char* inside)
+{
+    int uStep = 0;
+    int uAxis = UnitAxis(u, uStep);
+    if (uAxis >= 0 && IsIntegral(p)) {
+        int start[3] = { static_cast<int>(p[0]), static_cast<int>(p[1]), static_cast<int>(p[2]) };
+        CopyAlignedRow(volume, start, uAxis, uStep, width, out, inside);
+        return;
+    }
+    SampleRow(volume, p, u, width, interpolation, out, inside);
+}
+
+bool AxisSliceSize(const BrickedVolume& volume, int axis, int lod, int& width, int& height)
+{
+    if (axis < 0 || axis > 2 || lod < 0 || lod > 15) {
+        return false;
+    }
+
+    const int size[3] = { volume.Width(), volume.Height(), volume.Depth() };
+    const AxisPlane plane = GetAxisPlane(axis);
+    width = (size[plane.a] + (1 << lod) - 1) >> lod;
+    height = (size[plane.b] + (1 << lod) - 1) >> lod;
+    return true;
+}
+
+void ExtractAxisSlice(const BrickedVolume& volume, int axis, int index, int lod, unsigned char* out)
+{
+    if (lod == 0) {
+        CopyAxisSlice(volume, axis, index, out);
+        return;
+    }
+
+    int fullWidth, fullHeight, width, height;
+    AxisSliceSize(volume, axis, 0, fullWidth, fullHeight);
+    AxisSliceSize(volume, axis, lod, width, height);
+    std::vector<unsigned char> full(static_cast<size_t>(fullWidth) * fullHeight);
+    CopyAxisSlice(volume, axis, index, full.data());
+
+    // Box filter over the 2^lod square, clipped at the far edges: the
+    // block's rows are summed into column totals, then reduced per pixel.
+    // Column totals fit 32 bits (2^15 rows of 255); block sums need 64.
+    const int block = 1 << lod;
+    ParallelForRange(0, height, [&](int, int jBegin, int jEnd) {
+        std::vector<unsigned int> columns(fullWidth);
+        for (int j = jBegin; j < jEnd; j++) {
+            int y0 = j << lod, y1 = min(fullHeight, y0 + block);
+            std::fill(columns.begin(), columns.end(), 0u);
+            for (int y = y0; y < y1; y++) {
+                const unsigned char* row = full.data() + static_cast<size_t>(y) * fullWidth;
+                for (int x = 0; x < fullWidth; x++) {
+                    columns[x] += row[x];
+                }
+            }
+
+            for (int i = 0; i < width; i++) {
+                int x0 = i << lod, x1 = min(fullWidth, x0 + block);
+                unsigned long long sum = 0;
+                for (int x = x0; x < x1; x++) {
+                    sum += columns[x];
+                }
+                unsigned long long count = static_cast<unsigned long long>(x1 - x0) * (y1 - y0);
+                out[static_cast<size_t>(j) * width + i] = static_cast<unsigned char>((sum + count / 2) / count);
+            }
+        }
+    });
+}
+
+SliceCache::SliceCache()
+    : m_useCount(0)
+{
+}
+
+void SliceCache::Invalidate()
+{
+    m_entries.clear();
+}
+
+bool SliceCache::Get(const BrickedVolume& volume, int axis, int index, int lod, unsigned char* out)
+{
+    int width, height;
+    AxisSliceSize(volume, axis, lod, width, height);
+    size_t pixels = static_cast<size_t>(width) * height;
+
+    for (Entry& entry : m_entries) {
+        if (entry.axis == axis && entry.index == index && entry.lod == lod) {
+            entry.lastUse = ++m_useCount;
+            memcpy(out, entry.pixels.data(), pixels);
+            return true;
+        }
+    }
+
+    Entry* slot = nullptr;
+    if (m_entries.size() < CAPACITY) {
+        m_entries.push_back(Entry());
+        slot = &m_entries.back();
+    }
+    else {
+        slot = &m_entries[0];
+        for (Entry& entry : m_entries) {
+            if (entry.lastUse < slot->lastUse) {
+                slot = &entry;
+            }
+        }
+    }
+
+    slot->axis = axis;
+    slot->index = index;
+    slot->lod = lod;
+    slot->lastUse = ++m_useCount;
+    slot->pixels.resize(pixels);
+    ExtractAxisSlice(volume, axis, index, lod, slot->pixels.data());
+    memcpy(out, slot->pixels.data(), pixels);
+    return false;
+}
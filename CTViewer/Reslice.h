@@ -0,0 +1,71 @@
+// Reslice.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include <vector>
+
+// Sampling used by ExtractSlice
+enum SliceInterpolation
+{
+    SLICE_NEAREST = 0,
+    SLICE_LINEAR = 1,   // trilinear
+    SLICE_CUBIC = 2     // tricubic Catmull-Rom, passes through the voxel values
+};
+
+// Multi-planar reformatting at any orientation. Pixel (i, j) of the
+// width x height slice samples origin + i * u + j * v in voxel space
+// (sample centres on integers), so u and v set both the orientation and
+// the pixel spacing. Samples outside the volume are 0. Rows are spread
+// across the workers and four pixels are interpolated per SSE2 step;
+// planes spanned by unit voxel axes through voxel centres copy voxels
+// directly whatever the interpolation.
+void ExtractSlice(const BrickedVolume& volume, const float* origin, const float* u, const float* v,
+    int width, int height, int interpolation, unsigned char* out);
+
+// One row of ExtractSlice: width samples from p stepping by u, for kernels
+// that reduce many planes. inside (may be null) receives 1 where the
+// sample lies in the volume and 0 where it was set to 0 for lying outside.
+void SampleSliceRow(const BrickedVolume& volume, const float* p, const float* u, int width,
+    int interpolation, unsigned char* out, unsigned char* inside = nullptr);
+
+// Orthogonal slices: axis 0 is the YZ plane at x = index (Height() x
+// Depth(), y fastest), 1 the XZ plane at y = index (Width() x Depth())
+// and 2 the XY plane at z = index (Width() x Height()). At level of detail
+// lod each pixel averages a 2^lod square of voxels, so both sides shrink
+// to ceil(size / 2^lod). Returns false for an invalid axis or lod.
+bool AxisSliceSize(const BrickedVolume& volume, int axis, int lod, int& width, int& height);
+
+// Copies the slice brick by brick: each 8x8 tile is read from one brick
+// (eight cache lines at most, whatever the axis) while the next brick is
+// prefetched, with rows of tiles spread across the workers. index must lie
+// inside the volume along axis.
+void ExtractAxisSlice(const BrickedVolume& volume, int axis, int index, int lod, unsigned char* out);
+
+// Recently extracted axis slices keyed by (axis, index, lod), so scrolling
+// back and forth through a view re-reads no voxels. Holds up to CAPACITY
+// slices and evicts the least recently used.
+class SliceCache
+{
+public:
+    static const int CAPACITY = 16;
+
+    SliceCache();
+
+    void Invalidate();
+
+    // Copies the slice to out, extracting it on a miss; true on a hit
+    bool Get(const BrickedVolume& volume, int axis, int index, int lod, unsigned char* out);
+
+private:
+    struct Entry
+    {
+        int axis;
+        int index;
+        int lod;
+        unsigned long long lastUse;
+        std::vector<unsigned char> pixels;
+    };
+
+    std::vector<Entry> m_entries;
+    unsigned long long m_useCount;
+};
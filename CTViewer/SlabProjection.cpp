@@ -0,0 +1,282 @@
+// SlabProjection.cpp
+#include "pch.h"
+#include "SlabProjection.h"
+#include "Reslice.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace
+{
+    const size_t SLICE_CHUNK = 64 * 1024;
+
+    // acc = max(acc, src) or min(acc, src), 16 bytes per step
+    void CombineBytes(unsigned char* acc, const unsigned char* src, size_t n, bool maximum)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), maximum ? _mm_max_epu8(a, b) : _mm_min_epu8(a, b));
+        }
+        for (; i < n; i++) {
+            acc[i] = maximum ? max(acc[i], src[i]) : min(acc[i], src[i]);
+        }
+    }
+
+    // sum += src (or -= src), widening 16 bytes to four sets of 32-bit lanes
+    void AddBytes(unsigned int* sum, const unsigned char* src, size_t n, bool subtract)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i words[2] = { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+            for (int h = 0; h < 2; h++) {
+                __m128i parts[2] = { _mm_unpacklo_epi16(words[h], zero), _mm_unpackhi_epi16(words[h], zero) };
+                for (int q = 0; q < 2; q++) {
+                    __m128i* p = reinterpret_cast<__m128i*>(sum + i + h * 8 + q * 4);
+                    __m128i s = _mm_loadu_si128(p);
+                    _mm_storeu_si128(p, subtract ? _mm_sub_epi32(s, parts[q]) : _mm_add_epi32(s, parts[q]));
+                }
+            }
+        }
+        for (; i < n; i++) {
+            sum[i] = subtract ? sum[i] - src[i] : sum[i] + src[i];
+        }
+    }
+
+    // Whole-slice versions, split into chunks across the workers
+    template <typename Body>
+    void ForEachChunk(size_t n, Body body)
+    {
+        int chunks = static_cast<int>((n + SLICE_CHUNK - 1) / SLICE_CHUNK);
+        ParallelForRange(0, chunks, [&](int, int begin, int end) {
+            size_t first = begin * SLICE_CHUNK;
+            body(first, min(n, end * SLICE_CHUNK) - first);
+        });
+    }
+
+    void CombineSlices(unsigned char* acc, const unsigned char* src, size_t n, bool maximum)
+    {
+        ForEachChunk(n, [&](size_t first, size_t count) {
+            CombineBytes(acc + first, src + first, count, maximum);
+        });
+    }
+
+    void AddSlices(unsigned int* sum, const unsigned char* src, size_t n, bool subtract)
+    {
+        ForEachChunk(n, [&](size_t first, size_t count) {
+            AddBytes(sum + first, src + first, count, subtract);
+        });
+    }
+}
+
+void ProjectSlab(const BrickedVolume& volume, const float* origin, const float* u, const float* v,
+    const float* w, int thickness, int width, int height, int interpolation, int mode, unsigned char* out)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if (volume.IsEmpty() || thickness <= 0) {
+        memset(out, 0, static_cast<size_t>(width) * height);
+        return;
+    }
+
+    const bool maximum = mode == SLAB_MAX;
+    ParallelForRange(0, height, [&](int, int jBegin, int jEnd) {
+        std::vector<unsigned char> row(width), inside(width), acc(width), any(width);
+        std::vector<unsigned int> sum, count;
+        if (mode == SLAB_MEAN) {
+            sum.resize(width);
+            count.resize(width);
+        }
+
+        for (int j = jBegin; j < jEnd; j++) {
+            std::fill(acc.begin(), acc.end(), static_cast<unsigned char>(mode == SLAB_MIN ? 255 : 0));
+            std::fill(any.begin(), any.end(), static_cast<unsigned char>(0));
+            std::fill(sum.begin(), sum.end(), 0u);
+            std::fill(count.begin(), count.end(), 0u);
+
+            for (int k = 0; k < thickness; k++) {
+                float p[3];
+                for (int c = 0; c < 3; c++) {
+                    p[c] = origin[c] + k * w[c] + j * v[c];
+                }
+                SampleSliceRow(volume, p, u, width, interpolation, row.data(), inside.data());
+
+                if (mode == SLAB_MEAN) {
+                    AddBytes(sum.data(), row.data(), width, false);
+                    AddBytes(count.data(), inside.data(), width, false);
+                    continue;
+                }
+
+                // Outside samples read 0, so a minimum must not see them
+                if (mode == SLAB_MIN) {
+                    for (int i = 0; i < width; i++) {
+                        row[i] |= static_cast<unsigned char>(inside[i] - 1);
+                    }
+                }
+                CombineBytes(acc.data(), row.data(), width, maximum);
+                CombineBytes(any.data(), inside.data(), width, true);
+            }
+
+            unsigned char* dst = out + static_cast<size_t>(j) * width;
+            for (int i = 0; i < width; i++) {
+                if (mode == SLAB_MEAN) {
+                    dst[i] = count[i] > 0 ? static_cast<unsigned char>((sum[i] + count[i] / 2) / count[i]) : 0;
+                }
+                else {
+                    dst[i] = any[i] ? acc[i] : 0;
+                }
+            }
+        }
+    });
+}
+
+SlabWindow::SlabWindow()
+    : m_axis(-1), m_first(0), m_thickness(0), m_mode(SLAB_MAX), m_direction(1), m_pixels(0)
+{
+}
+
+void SlabWindow::Invalidate()
+{
+    m_slices.clear();
+    m_front.clear();
+    m_back.clear();
+    m_sum.clear();
+    m_axis = -1;
+}
+
+bool SlabWindow::Render(const BrickedVolume& volume, int axis, int first, int thickness, int mode, unsigned char* out)
+{
+    int width, height;
+    AxisSliceSize(volume, axis, 0, width, height);
+    size_t pixels = static_cast<size_t>(width) * height;
+
+    bool reuse = !m_slices.empty() && axis == m_axis && thickness == m_thickness && mode == m_mode
+        && pixels == m_pixels && abs(first - m_first) <= 1;
+    if (!reuse) {
+        m_axis = axis;
+        m_first = first;
+        m_thickness = thickness;
+        m_mode = mode;
+        m_pixels = pixels;
+        Rebuild(volume);
+        Resolve(out);
+        return false;
+    }
+
+    int direction = first - m_first;
+    if (direction != 0) {
+        if (direction != m_direction) {
+            Reverse();
+        }
+
+        // The slice leaving the window is recycled for the one entering
+        std::vector<unsigned char> slice;
+        Pop(slice);
+        Push(volume, direction > 0 ? m_first + m_thickness : m_first - 1, slice);
+        m_first = first;
+    }
+
+    Resolve(out);
+    return true;
+}
+
+void SlabWindow::Rebuild(const BrickedVolume& volume)
+{
+    m_slices.clear();
+    m_front.clear();
+    m_back.clear();
+    m_direction = 1;
+    if (m_mode == SLAB_MEAN) {
+        m_sum.assign(m_pixels, 0u);
+    }
+    else {
+        m_sum.clear();
+    }
+
+    for (int index = m_first; index < m_first + m_thickness; index++) {
+        std::vector<unsigned char> slice;
+        Push(volume, index, slice);
+    }
+}
+
+void SlabWindow::Push(const BrickedVolume& volume, int index, std::vector<unsigned char>& slice)
+{
+    slice.resize(m_pixels);
+    ExtractAxisSlice(volume, m_axis, index, 0, slice.data());
+
+    if (m_mode == SLAB_MEAN) {
+        AddSlices(m_sum.data(), slice.data(), m_pixels, false);
+    }
+    else if (m_slices.size() == m_front.size()) {
+        m_back = slice;
+    }
+    else {
+        CombineSlices(m_back.data(), slice.data(), m_pixels, m_mode == SLAB_MAX);
+    }
+    m_slices.push_back(std::move(slice));
+}
+
+void SlabWindow::Pop(std::vector<unsigned char>& slice)
+{
+    if (m_mode == SLAB_MEAN) {
+        AddSlices(m_sum.data(), m_slices.front().data(), m_pixels, true);
+    }
+    else {
+        // An empty front stack takes every slice, as suffix extremes
+        if (m_front.empty()) {
+            size_t count = m_slices.size();
+            m_front.resize(count);
+            m_front[count - 1] = m_slices[count - 1];
+            for (size_t i = count - 1; i-- > 0;) {
+                m_front[i] = m_slices[i];
+                CombineSlices(m_front[i].data(), m_front[i + 1].data(), m_pixels, m_mode == SLAB_MAX);
+            }
+        }
+        m_front.pop_front();
+    }
+
+    slice = std::move(m_slices.front());
+    m_slices.pop_front();
+}
+
+void SlabWindow::Reverse()
+{
+    // Every slice moves to the back stack, whose extreme is the whole window
+    if (m_mode != SLAB_MEAN && !m_front.empty()) {
+        if (m_slices.size() > m_front.size()) {
+            CombineSlices(m_front[0].data(), m_back.data(), m_pixels, m_mode == SLAB_MAX);
+        }
+        m_back.swap(m_front[0]);
+        m_front.clear();
+    }
+
+    std::reverse(m_slices.begin(), m_slices.end());
+    m_direction = -m_direction;
+}
+
+void SlabWindow::Resolve(unsigned char* out) const
+{
+    if (m_mode == SLAB_MEAN) {
+        const unsigned int count = static_cast<unsigned int>(m_thickness);
+        ForEachChunk(m_pixels, [&](size_t first, size_t n) {
+            for (size_t i = first; i < first + n; i++) {
+                out[i] = static_cast<unsigned char>((m_sum[i] + count / 2) / count);
+            }
+        });
+        return;
+    }
+
+    if (m_front.empty()) {
+        memcpy(out, m_back.data(), m_pixels);
+        return;
+    }
+
+    memcpy(out, m_front[0].data(), m_pixels);
+    if (m_slices.size() > m_front.size()) {
+        CombineSlices(out, m_back.data(), m_pixels, m_mode == SLAB_MAX);
+    }
+}
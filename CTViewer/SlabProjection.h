@@ -0,0 +1,62 @@
+// SlabProjection.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include <deque>
+#include <vector>
+
+// Reduction across the layers of a slab
+enum SlabMode
+{
+    SLAB_MAX = 0,   // maximum intensity projection
+    SLAB_MIN = 1,   // minimum intensity projection
+    SLAB_MEAN = 2   // average, rounded
+};
+
+// Thick-slab projection at any orientation. Layer k (0 to thickness - 1)
+// is the ExtractSlice plane origin + k * w, and each pixel reduces the
+// layers that lie inside the volume (0 where none do). Layers are sampled
+// a row at a time with SSE2 max/min/sum reductions, rows spread across
+// the workers.
+void ProjectSlab(const BrickedVolume& volume, const float* origin, const float* u, const float* v,
+    const float* w, int thickness, int width, int height, int interpolation, int mode, unsigned char* out);
+
+// Slab of axis slices [first, first + thickness) along axis, laid out like
+// the ExtractAxisSlice slice at lod 0. Moving the slab by one slice reuses
+// the previous window: mean slabs add one slice and subtract another, and
+// max/min slabs keep the window as a two-stack queue (one stack of suffix
+// extremes, one running extreme of newer slices), so each move costs one
+// slice read and an amortised two reductions however thick the slab.
+// Keeps up to twice thickness slices while max/min windows are active.
+class SlabWindow
+{
+public:
+    SlabWindow();
+
+    void Invalidate();
+
+    // Returns true when the result was updated from the previous window
+    bool Render(const BrickedVolume& volume, int axis, int first, int thickness, int mode, unsigned char* out);
+
+private:
+    void Rebuild(const BrickedVolume& volume);
+    void Push(const BrickedVolume& volume, int index, std::vector<unsigned char>& slice);
+    void Pop(std::vector<unsigned char>& slice);
+    void Reverse();
+    void Resolve(unsigned char* out) const;
+
+    int m_axis;
+    int m_first;
+    int m_thickness;
+    int m_mode;
+    int m_direction;
+    size_t m_pixels;
+
+    // Slices in queue order, oldest first for the current direction. The
+    // first m_front.size() form the front stack, m_front[i] reducing
+    // slices [i, m_front.size()); m_back reduces the remaining slices.
+    std::deque<std::vector<unsigned char>> m_slices;
+    std::deque<std::vector<unsigned char>> m_front;
+    std::vector<unsigned char> m_back;
+    std::vector<unsigned int> m_sum;
+};
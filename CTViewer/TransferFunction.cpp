@@ -0,0 +1,211 @@
+// TransferFunction.cpp
+#include "pch.h"
+#include "TransferFunction.h"
+#include "ParallelFor.h"
+#include <cmath>
+
+TransferFunction::TransferFunction()
+    : m_table(TABLE_SIZE * 4, 0.0f), m_custom(false)
+{
+    SetWindow(0.0f, 1.0f, 0.05f);
+}
+
+bool TransferFunction::Set(const float* rgba, int entries)
+{
+    if (!rgba || entries < 1) {
+        m_custom = false;
+        return false;
+    }
+
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        float position = entries > 1 ? i * (entries - 1) / static_cast<float>(TABLE_SIZE - 1) : 0.0f;
+        int index = min(static_cast<int>(position), entries - 1);
+        int next = min(index + 1, entries - 1);
+        float f = position - index;
+        for (int c = 0; c < 4; c++) {
+            float v = rgba[index * 4 + c] + (rgba[next * 4 + c] - rgba[index * 4 + c]) * f;
+            m_table[i * 4 + c] = max(0.0f, min(1.0f, v));
+        }
+    }
+
+    m_custom = true;
+    return true;
+}
+
+void TransferFunction::SetWindow(float brightness, float contrast, float opacity)
+{
+    if (m_custom) {
+        return;
+    }
+
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        float density = i / static_cast<float>(TABLE_SIZE - 1);
+        float value = max(0.0f, min(1.0f, (density - 0.5f) * contrast + 0.5f + brightness));
+        m_table[i * 4] = value;
+        m_table[i * 4 + 1] = value;
+        m_table[i * 4 + 2] = value;
+        m_table[i * 4 + 3] = value * opacity;
+    }
+}
+
+bool TransferFunction::Set2D(const float* rgba, int densityEntries, int magnitudeEntries)
+{
+    if (!rgba || densityEntries < 1 || magnitudeEntries < 1) {
+        m_table2D.clear();
+        return false;
+    }
+
+    // Bilinear resampling onto the TABLE_SIZE x TABLE_SIZE grid
+    auto axis = [](int i, int entries, int& index, int& next, float& f) {
+        float position = entries > 1 ? i * (entries - 1) / static_cast<float>(TABLE_SIZE - 1) : 0.0f;
+        index = min(static_cast<int>(position), entries - 1);
+        next = min(index + 1, entries - 1);
+        f = position - index;
+    };
+
+    m_table2D.resize(static_cast<size_t>(TABLE_SIZE) * TABLE_SIZE * 4);
+    for (int j = 0; j < TABLE_SIZE; j++) {
+        int m0, m1;
+        float fm;
+        axis(j, magnitudeEntries, m0, m1, fm);
+        const float* row0 = rgba + static_cast<size_t>(m0) * densityEntries * 4;
+        const float* row1 = rgba + static_cast<size_t>(m1) * densityEntries * 4;
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            int d0, d1;
+            float fd;
+            axis(i, densityEntries, d0, d1, fd);
+            for (int c = 0; c < 4; c++) {
+                float top = row0[d0 * 4 + c] + (row0[d1 * 4 + c] - row0[d0 * 4 + c]) * fd;
+                float bottom = row1[d0 * 4 + c] + (row1[d1 * 4 + c] - row1[d0 * 4 + c]) * fd;
+                m_table2D[(static_cast<size_t>(j) * TABLE_SIZE + i) * 4 + c] = max(0.0f, min(1.0f, top + (bottom - top) * fm));
+            }
+        }
+    }
+    return true;
+}
+
+void TransferFunction::Build2D(float stepScale, std::vector<float>& table) const
+{
+    table = m_table2D;
+    if (stepScale == 1.0f) {
+        return;
+    }
+    for (size_t i = 3; i < table.size(); i += 4) {
+        table[i] = 1.0f - powf(1.0f - table[i], stepScale);
+    }
+}
+
+void TransferFunction::BuildPreIntegrated(float stepScale, std::vector<float>& table) const
+{
+    table.resize(static_cast<size_t>(TABLE_SIZE) * TABLE_SIZE * 4);
+
+    // Extinction per reference step, so opacity composes correctly over
+    // any sub-step length
+    float extinction[TABLE_SIZE];
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        extinction[i] = -logf(max(1e-6f, 1.0f - min(m_table[i * 4 + 3], 0.9999f)));
+    }
+
+    // A segment from front to back is composited from one sub-sample per
+    // table entry it crosses, so narrow features are never stepped over.
+    // Segments with the same |back - front| share a sub-step length, so
+    // each diagonal needs only one set of sub-sample opacities.
+    ParallelForEach(0, TABLE_SIZE, [&](int, int distance) {
+        int subSteps = distance + 1;
+        float alpha[TABLE_SIZE];
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            alpha[i] = 1.0f - expf(-extinction[i] * stepScale / subSteps);
+        }
+
+        for (int front = 0; front < TABLE_SIZE; front++) {
+            for (int direction = -1; direction <= 1; direction += 2) {
+                int back = front + direction * distance;
+                if (back < 0 || back >= TABLE_SIZE || (distance == 0 && direction > 0)) {
+                    continue;
+                }
+
+                float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+                for (int j = 0, i = front; j < subSteps && a < 0.999f; j++, i += direction) {
+                    float weight = (1.0f - a) * alpha[i];
+                    r += weight * m_table[i * 4];
+                    g += weight * m_table[i * 4 + 1];
+                    b += weight * m_table[i * 4 + 2];
+                    a += weight;
+                }
+
+                float* out = &table[(static_cast<size_t>(back) * TABLE_SIZE + front) * 4];
+                out[0] = r;
+                out[1] = g;
+                out[2] = b;
+                out[3] = a;
+            }
+        }
+    });
+}
+
+void TransferFunction::ComputeBrickVisibility(const BrickedVolume& volume, const BrickedVolume* labels,
+    const GradientVolume* gradients, std::vector<unsigned char>& flags) const
+{
+    const size_t brickCount = static_cast<size_t>(volume.BricksX()) * volume.BricksY() * volume.BricksZ();
+    flags.assign(brickCount, 0);
+    if (brickCount == 0) {
+        return;
+    }
+
+    // Count of opaque entries up to each density, so "is anything in
+    // [min, max] opaque" is one subtraction per brick. Linear interpolation
+    // between entries never leaves the range's own entries.
+    int opaqueBefore[TABLE_SIZE + 1];
+    opaqueBefore[0] = 0;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        opaqueBefore[i + 1] = opaqueBefore[i] + (m_table[i * 4 + 3] > 0.0f ? 1 : 0);
+    }
+
+    // With a 2D table the count is a summed-area table over (magnitude,
+    // density), queried with the brick's rectangle of both ranges
+    bool use2D = Is2D() && gradients && !gradients->IsEmpty()
+        && gradients->BricksX() == volume.BricksX()
+        && gradients->BricksY() == volume.BricksY()
+        && gradients->BricksZ() == volume.BricksZ();
+    std::vector<int> opaqueArea;
+    if (use2D) {
+        const int stride = TABLE_SIZE + 1;
+        opaqueArea.assign(static_cast<size_t>(stride) * stride, 0);
+        for (int j = 0; j < TABLE_SIZE; j++) {
+            int rowCount = 0;
+            for (int i = 0; i < TABLE_SIZE; i++) {
+                rowCount += m_table2D[(static_cast<size_t>(j) * TABLE_SIZE + i) * 4 + 3] > 0.0f ? 1 : 0;
+                opaqueArea[(j + 1) * stride + i + 1] = opaqueArea[j * stride + i + 1] + rowCount;
+            }
+        }
+    }
+
+    bool useLabels = labels && !labels->IsEmpty()
+        && labels->BricksX() == volume.BricksX()
+        && labels->BricksY() == volume.BricksY()
+        && labels->BricksZ() == volume.BricksZ();
+
+    ParallelForRange(0, volume.BricksZ(), [&](int, int bzBegin, int bzEnd) {
+        size_t begin = static_cast<size_t>(bzBegin) * volume.BricksX() * volume.BricksY();
+        size_t end = static_cast<size_t>(bzEnd) * volume.BricksX() * volume.BricksY();
+        for (size_t brick = begin; brick < end; brick++) {
+            unsigned char flag = 0;
+            if (use2D) {
+                const int stride = TABLE_SIZE + 1;
+                int d0 = volume.BrickMin(brick), d1 = volume.BrickMax(brick) + 1;
+                int m0 = gradients->BrickMinMagnitude(brick), m1 = gradients->BrickMaxMagnitude(brick) + 1;
+                if (opaqueArea[m1 * stride + d1] - opaqueArea[m0 * stride + d1]
+                    - opaqueArea[m1 * stride + d0] + opaqueArea[m0 * stride + d0] > 0) {
+                    flag |= BRICK_VISIBLE;
+                }
+            }
+            else if (opaqueBefore[volume.BrickMax(brick) + 1] - opaqueBefore[volume.BrickMin(brick)] > 0) {
+                flag |= BRICK_VISIBLE;
+            }
+            if (useLabels && labels->BrickMax(brick) > 0) {
+                flag |= BRICK_LABELLED;
+            }
+            flags[brick] = flag;
+        }
+    });
+}
@@ -0,0 +1,63 @@
+// TransferFunction.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include "GradientVolume.h"
+#include <vector>
+
+// Per-brick flags produced by TransferFunction::ComputeBrickVisibility
+enum BrickVisibility
+{
+    BRICK_VISIBLE = 1,      // some density in the brick's range has non-zero opacity
+    BRICK_LABELLED = 2      // the label volume has a non-zero id in the brick
+};
+
+// 1D transfer function: one straight-alpha RGBA entry per 8-bit density,
+// interpolated linearly between entries. Without a user table it holds the
+// classic brightness/contrast window with alpha = value * opacity, so every
+// render path classifies samples through the same lookup.
+class TransferFunction
+{
+public:
+    static const int TABLE_SIZE = 256;
+
+    TransferFunction();
+
+    // Resamples entries RGBA points spread evenly over densities 0-1;
+    // a null table or entries < 1 reverts to the window
+    bool Set(const float* rgba, int entries);
+
+    // Rebuilds the window table; ignored while a user table is set
+    void SetWindow(float brightness, float contrast, float opacity);
+
+    bool IsCustom() const { return m_custom; }
+    const float* Table() const { return m_table.data(); }
+
+    // 2D table over density and gradient magnitude (the GradientVolume
+    // alpha channel). Resamples densityEntries x magnitudeEntries RGBA
+    // points, density varying fastest; a null table clears it.
+    bool Set2D(const float* rgba, int densityEntries, int magnitudeEntries);
+    bool Is2D() const { return !m_table2D.empty(); }
+
+    // The 2D table for rays sampled stepScale times the reference step:
+    // entry (density, magnitude) at index magnitude * TABLE_SIZE + density,
+    // straight alpha corrected for the step
+    void Build2D(float stepScale, std::vector<float>& table) const;
+
+    // Pre-integrated segment table for rays sampled stepScale times the
+    // step the table's alphas are defined for. Entry (front, back) at
+    // index back * TABLE_SIZE + front holds the premultiplied RGBA of a
+    // segment whose density runs linearly from front to back.
+    void BuildPreIntegrated(float stepScale, std::vector<float>& table) const;
+
+    // Flags each brick of the volume from its min/max range alone, so
+    // editing the table never touches voxel data. Labels may be null; with
+    // a 2D table and matching gradients the magnitude range is used too.
+    void ComputeBrickVisibility(const BrickedVolume& volume, const BrickedVolume* labels,
+        const GradientVolume* gradients, std::vector<unsigned char>& flags) const;
+
+private:
+    std::vector<float> m_table;
+    std::vector<float> m_table2D;
+    bool m_custom;
+};
@@ -0,0 +1,60 @@
+// UpscalePixelShader.hlsl
+
+// The volume is ray cast into the top-left corner of a window-sized
+// texture; this pass stretches that corner over the back buffer
+Texture2D<float4> sourceTexture : register(t0);
+SamplerState linearSampler : register(s0);
+
+cbuffer UpscaleParams : register(b0)
+{
+    float2 sourceSize;      // rendered region in texels
+    float2 textureSize;     // full texture size in texels
+    int edgeAware;
+    float3 upscalePadding;
+}
+
+struct PixelInput {
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+// Colour distance falloff of the edge-aware filter (UpscaleImage in
+// DynamicResolution.cpp), for channels in 0-1
+static const float EDGE_FALLOFF = 255.0f * 255.0f / 2048.0f;
+
+float4 main(PixelInput input) : SV_TARGET
+{
+    float2 texel = max(input.uv * sourceSize - 0.5f, 0.0f);
+
+    [branch]
+    if (edgeAware == 0)
+    {
+        float2 uv = min(texel + 0.5f, sourceSize - 0.5f) / textureSize;
+        return sourceTexture.SampleLevel(linearSampler, uv, 0);
+    }
+
+    // Bilinear taps scaled by their similarity to the nearest one
+    int2 base = (int2)texel;
+    int2 last = (int2)sourceSize - 1;
+    float2 f = texel - base;
+    float4 taps[4] = {
+        sourceTexture.Load(int3(min(base, last), 0)),
+        sourceTexture.Load(int3(min(base + int2(1, 0), last), 0)),
+        sourceTexture.Load(int3(min(base + int2(0, 1), last), 0)),
+        sourceTexture.Load(int3(min(base + int2(1, 1), last), 0))
+    };
+    float weights[4] = { (1 - f.x) * (1 - f.y), f.x * (1 - f.y), (1 - f.x) * f.y, f.x * f.y };
+    float4 nearest = taps[(f.x < 0.5f ? 0 : 1) + (f.y < 0.5f ? 0 : 2)];
+
+    float4 color = float4(0, 0, 0, 0);
+    float total = 0.0f;
+    [unroll]
+    for (int i = 0; i < 4; i++)
+    {
+        float4 d = taps[i] - nearest;
+        float w = weights[i] / (1.0f + dot(d, d) * EDGE_FALLOFF);
+        color += w * taps[i];
+        total += w;
+    }
+    return color / total;
+}
@@ -0,0 +1,214 @@
+// VolumeBounds.cpp
+#include "pch.h"
+#include "VolumeBounds.h"
+#include "ParallelFor.h"
+#include <emmintrin.h>
+#include <climits>
+#include <cmath>
+
+long long ContentBounds::VoxelCount() const
+{
+    if (IsEmpty()) {
+        return 0;
+    }
+    return static_cast<long long>(maxX - minX + 1) * (maxY - minY + 1) * (maxZ - minZ + 1);
+}
+
+ContentBounds FullBounds(int width, int height, int depth)
+{
+    ContentBounds bounds = {};
+    bounds.minX = 0;
+    bounds.minY = 0;
+    bounds.minZ = 0;
+    bounds.maxX = width - 1;
+    bounds.maxY = height - 1;
+    bounds.maxZ = depth - 1;
+    bounds.hasCircle = false;
+    return bounds;
+}
+
+static ContentBounds EmptyBounds()
+{
+    ContentBounds bounds = {};
+    bounds.minX = bounds.minY = bounds.minZ = INT_MAX;
+    bounds.maxX = bounds.maxY = bounds.maxZ = INT_MIN;
+    bounds.hasCircle = false;
+    return bounds;
+}
+
+ContentBounds IntersectBounds(const ContentBounds& a, const ContentBounds& b)
+{
+    ContentBounds result = a;
+    result.minX = max(a.minX, b.minX);
+    result.minY = max(a.minY, b.minY);
+    result.minZ = max(a.minZ, b.minZ);
+    result.maxX = min(a.maxX, b.maxX);
+    result.maxY = min(a.maxY, b.maxY);
+    result.maxZ = min(a.maxZ, b.maxZ);
+    return result;
+}
+
+ContentBounds UnionBounds(const ContentBounds& a, const ContentBounds& b)
+{
+    if (a.IsEmpty()) return b;
+    if (b.IsEmpty()) return a;
+
+    ContentBounds result = {};
+    result.minX = min(a.minX, b.minX);
+    result.minY = min(a.minY, b.minY);
+    result.minZ = min(a.minZ, b.minZ);
+    result.maxX = max(a.maxX, b.maxX);
+    result.maxY = max(a.maxY, b.maxY);
+    result.maxZ = max(a.maxZ, b.maxZ);
+    result.hasCircle = false;
+
+    if (a.hasCircle && b.hasCircle) {
+        // Smallest circle enclosing both footprints
+        float dx = b.centerX - a.centerX;
+        float dy = b.centerY - a.centerY;
+        float distance = sqrtf(dx * dx + dy * dy);
+        result.hasCircle = true;
+        if (distance + b.radius <= a.radius) {
+            result.centerX = a.centerX;
+            result.centerY = a.centerY;
+            result.radius = a.radius;
+        }
+        else if (distance + a.radius <= b.radius) {
+            result.centerX = b.centerX;
+            result.centerY = b.centerY;
+            result.radius = b.radius;
+        }
+        else {
+            result.radius = 0.5f * (distance + a.radius + b.radius);
+            float t = (result.radius - a.radius) / distance;
+            result.centerX = a.centerX + dx * t;
+            result.centerY = a.centerY + dy * t;
+        }
+    }
+
+    return result;
+}
+
+// SSE2 row scans: a saturating subtract of the threshold leaves a non-zero
+// byte exactly where the voxel is above it, so 16 voxels are tested at once.
+static int AboveMask(const unsigned char* p, __m128i threshold)
+{
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i isZero = _mm_cmpeq_epi8(_mm_subs_epu8(v, threshold), _mm_setzero_si128());
+    return ~_mm_movemask_epi8(isZero) & 0xFFFF;
+}
+
+static int FindFirstAbove(const unsigned char* row, int begin, int end, unsigned char threshold)
+{
+    const __m128i thr = _mm_set1_epi8(static_cast<char>(threshold));
+    int x = begin;
+    for (; x + 16 <= end; x += 16) {
+        int mask = AboveMask(row + x, thr);
+        if (mask) {
+            int bit = 0;
+            while (!(mask & (1 << bit))) bit++;
+            return x + bit;
+        }
+    }
+    for (; x < end; x++) {
+        if (row[x] > threshold) return x;
+    }
+    return -1;
+}
+
+static int FindLastAbove(const unsigned char* row, int begin, int end, unsigned char threshold)
+{
+    const __m128i thr = _mm_set1_epi8(static_cast<char>(threshold));
+    int x = end;
+    for (; x - 16 >= begin; x -= 16) {
+        int mask = AboveMask(row + x - 16, thr);
+        if (mask) {
+            int bit = 15;
+            while (!(mask & (1 << bit))) bit--;
+            return x - 16 + bit;
+        }
+    }
+    for (x = x - 1; x >= begin; x--) {
+        if (row[x] > threshold) return x;
+    }
+    return -1;
+}
+
+ContentBounds ComputeContentBounds(const unsigned char* data, int width, int height, int depth,
+    unsigned char threshold, bool fitCircle)
+{
+    const size_t sliceSize = static_cast<size_t>(width) * height;
+
+    // Pass 1: per-thread boxes over slice ranges, merged at the end
+    std::vector<ContentBounds> partial(GetWorkerCount(), EmptyBounds());
+    ParallelForRange(0, depth, [&](int threadIndex, int zBegin, int zEnd) {
+        ContentBounds local = EmptyBounds();
+        for (int z = zBegin; z < zEnd; z++) {
+            const unsigned char* slice = data + sliceSize * z;
+            for (int y = 0; y < height; y++) {
+                const unsigned char* row = slice + static_cast<size_t>(width) * y;
+                int first = FindFirstAbove(row, 0, width, threshold);
+                if (first < 0) {
+                    continue;
+                }
+                int last = FindLastAbove(row, first, width, threshold);
+                local.minX = min(local.minX, first);
+                local.maxX = max(local.maxX, last);
+                local.minY = min(local.minY, y);
+                local.maxY = max(local.maxY, y);
+                local.minZ = min(local.minZ, z);
+                local.maxZ = max(local.maxZ, z);
+            }
+        }
+        partial[threadIndex] = local;
+    });
+
+    ContentBounds bounds = EmptyBounds();
+    for (const ContentBounds& local : partial) {
+        if (!local.IsEmpty()) {
+            bounds = UnionBounds(bounds, local);
+        }
+    }
+
+    if (bounds.IsEmpty() || !fitCircle) {
+        return bounds;
+    }
+
+    // Pass 2: radius around the box centre. Only the extreme voxels of each
+    // row can be farthest from the centre, so rows are scanned from both ends.
+    float centerX = 0.5f * (bounds.minX + bounds.maxX + 1);
+    float centerY = 0.5f * (bounds.minY + bounds.maxY + 1);
+    std::vector<float> partialRadius(GetWorkerCount(), 0.0f);
+    ParallelForRange(bounds.minZ, bounds.maxZ + 1, [&](int threadIndex, int zBegin, int zEnd) {
+        float maxDistance2 = 0.0f;
+        for (int z = zBegin; z < zEnd; z++) {
+            const unsigned char* slice = data + sliceSize * z;
+            for (int y = bounds.minY; y <= bounds.maxY; y++) {
+                const unsigned char* row = slice + static_cast<size_t>(width) * y;
+                int first = FindFirstAbove(row, bounds.minX, bounds.maxX + 1, threshold);
+                if (first < 0) {
+                    continue;
+                }
+                int last = FindLastAbove(row, first, bounds.maxX + 1, threshold);
+                float dy = y + 0.5f - centerY;
+                float dxFirst = first + 0.5f - centerX;
+                float dxLast = last + 0.5f - centerX;
+                float d2 = max(dxFirst * dxFirst, dxLast * dxLast) + dy * dy;
+                maxDistance2 = max(maxDistance2, d2);
+            }
+        }
+        partialRadius[threadIndex] = maxDistance2;
+    });
+
+    float maxDistance2 = 0.0f;
+    for (float r : partialRadius) {
+        maxDistance2 = max(maxDistance2, r);
+    }
+
+    // Pad by half a voxel diagonal so the footprint covers whole voxels
+    bounds.hasCircle = true;
+    bounds.centerX = centerX;
+    bounds.centerY = centerY;
+    bounds.radius = sqrtf(maxDistance2) + 0.7072f;
+    return bounds;
+}
@@ -0,0 +1,33 @@
+// VolumeBounds.h
+#pragma once
+
+// Tight axis-aligned box (inclusive voxel indices) around the voxels of a
+// volume that carry content, plus an optional circular XY footprint for
+// cylindrical cores. An empty volume has maxX < minX.
+struct ContentBounds
+{
+    int minX, minY, minZ;
+    int maxX, maxY, maxZ;
+
+    // Circular footprint in voxel units, shared by all slices
+    bool hasCircle;
+    float centerX, centerY;
+    float radius;
+
+    bool IsEmpty() const { return maxX < minX || maxY < minY || maxZ < minZ; }
+    long long VoxelCount() const;
+};
+
+// Bounds covering the whole volume
+ContentBounds FullBounds(int width, int height, int depth);
+
+// Smallest box containing both inputs (the circle is dropped unless both have one)
+ContentBounds UnionBounds(const ContentBounds& a, const ContentBounds& b);
+
+// Overlap of two boxes, keeping a's circle; empty when they are disjoint
+ContentBounds IntersectBounds(const ContentBounds& a, const ContentBounds& b);
+
+// Scans slices in parallel for voxels strictly above threshold. With
+// threshold 0 this is the non-zero test used for label volumes.
+ContentBounds ComputeContentBounds(const unsigned char* data, int width, int height, int depth,
+    unsigned char threshold, bool fitCircle);
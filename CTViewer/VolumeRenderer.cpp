@@ -4,6 +4,9 @@
 #include "Logger.h"
 #include <d3dcompiler.h>
 #include <DirectXColors.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
 // Reference to the logging function declared in CTViewer.cpp
 extern void Log(const char* message, int severity);
@@ -42,8 +45,32 @@ struct RenderParamsBuffer
     int renderMode;
     XMFLOAT4 volumeScale;
     int showLabels;
-    float padding[2];
+    float isoValue;
+    float stepScale;      // sample distance relative to BASE_STEP_SIZE
+    int preIntegrated;
+    XMFLOAT4 boxMin;      // content bounds in texture space
+    XMFLOAT4 boxMax;
+    XMFLOAT4 volumeDims;  // width, height, depth in voxels
+    XMFLOAT4 cropCircle;  // centre x/y and radius in voxels, w > 0 when enabled
+    XMFLOAT4 brickInfo;   // brick count (rounded up), brick size in voxels
+    XMFLOAT4 valueRange;  // global min/max density
+    int shading;          // ShadingFlags, 0 without a gradient texture
+    int transfer2D;       // classify by density and gradient magnitude
+    int clipPlaneCount;
+    int brickSkip;        // brick flags bound; unbound flags would read as empty
+    XMFLOAT4 clipPlanes[MAX_CLIP_PLANES];  // texture space
 };
+static_assert(sizeof(RenderParamsBuffer) % 16 == 0, "Constant buffer size must be a multiple of 16 bytes");
+
+// Upscale pass parameters (matches UpscalePixelShader.hlsl)
+struct UpscaleParamsBuffer
+{
+    XMFLOAT2 sourceSize;    // rendered region in texels
+    XMFLOAT2 textureSize;   // full texture size in texels
+    int edgeAware;
+    XMFLOAT3 upscalePadding;
+};
+static_assert(sizeof(UpscaleParamsBuffer) % 16 == 0, "Constant buffer size must be a multiple of 16 bytes");
 
 VolumeRenderer::VolumeRenderer()
 {
@@ -65,8 +92,36 @@ VolumeRenderer::VolumeRenderer()
     m_opacity = 0.05f;
     m_brightness = 0.0f;
     m_contrast = 1.0f;
-    m_renderMode = 0;
+    m_renderMode = RENDER_MODE_VOLUME;
     m_showLabels = true;
+    m_filter = FILTER_LINEAR;
+    m_isoValue = 0.5f;
+    m_materials.resize(256, XMFLOAT4(0, 0, 0, 0));
+    m_transferFunction.SetWindow(m_brightness, m_contrast, m_opacity);
+    m_transferDirty = true;
+    m_stepScale = 1.0f;
+    m_preIntegration = false;
+    m_computeGradients = false;
+    m_shading = SHADING_NONE;
+
+    m_autoCrop = false;
+    m_cropThreshold = 16;
+    m_cropCircle = true;
+    m_volumeBounds = FullBounds(0, 0, 0);
+    m_labelBounds = FullBounds(0, 0, 0);
+    m_hasLabelBounds = false;
+    m_clipPlaneCount = 0;
+    for (int i = 0; i < TIMING_FRAMES; i++) {
+        m_timingScale[i] = 1.0f;
+    }
+    m_timingFrame = 0;
+    m_edgeAwareUpscale = false;
+    m_temporalReprojection = false;
+    m_recolorCache = false;
+    m_costView = false;
+    m_costViewLogged = false;
+    m_hasRoi = false;
+    m_roi = FullBounds(0, 0, 0);
 }
 
 VolumeRenderer::~VolumeRenderer()
@@ -149,6 +204,11 @@ bool VolumeRenderer::Initialize(HWND hwnd, int width, int height)
     }
     Log("Samplers created successfully", LOG_INFO);
 
+    // Dynamic resolution is optional; without it frames render at full size
+    if (!CreateUpscaleResources()) {
+        Log("Failed to create upscale resources - dynamic resolution unavailable", LOG_WARNING);
+    }
+
     // Create cube vertices for ray casting
     Log("Creating vertex and index buffers...", LOG_INFO);
     Vertex vertices[] =
@@ -214,6 +274,26 @@ bool VolumeRenderer::Initialize(HWND hwnd, int width, int height)
     return true;
 }
 
+bool VolumeRenderer::InitializeHeadless(int width, int height)
+{
+    char buffer[256];
+    sprintf_s(buffer, "VolumeRenderer::InitializeHeadless: %dx%d", width, height);
+    Log(buffer, LOG_INFO);
+
+    if (width <= 0 || height <= 0) {
+        sprintf_s(buffer, "Invalid dimensions: %dx%d", width, height);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    // No device: volumes are only kept in CPU memory and rendered by RenderCpu
+    m_width = width;
+    m_height = height;
+
+    Log("VolumeRenderer initialized in headless mode", LOG_INFO);
+    return true;
+}
+
 void VolumeRenderer::Shutdown()
 {
     Log("VolumeRenderer::Shutdown called", LOG_INFO);
@@ -227,10 +307,35 @@ void VolumeRenderer::Shutdown()
 
     Log("Releasing DirectX resources", LOG_INFO);
     m_materialBuffer.Reset();
+    m_renderParamsBuffer.Reset();
     m_constantBuffer.Reset();
     m_indexBuffer.Reset();
     m_vertexBuffer.Reset();
     m_volumeSampler.Reset();
+    m_pointSampler.Reset();
+    for (int i = 0; i < TIMING_FRAMES; i++) {
+        m_timingDisjoint[i].Reset();
+        m_timingBegin[i].Reset();
+        m_timingEnd[i].Reset();
+    }
+    m_upscaleParamsBuffer.Reset();
+    m_upscalePixelShader.Reset();
+    m_upscaleVertexShader.Reset();
+    m_scaledSRV.Reset();
+    m_scaledRTV.Reset();
+    m_scaledTexture.Reset();
+    m_gradientSRV.Reset();
+    m_gradientTexture.Reset();
+    m_transfer2DSRV.Reset();
+    m_transfer2DTexture.Reset();
+    m_preIntegratedSRV.Reset();
+    m_preIntegratedTexture.Reset();
+    m_brickFlagsSRV.Reset();
+    m_brickFlagsTexture.Reset();
+    m_transferSRV.Reset();
+    m_transferTexture.Reset();
+    m_brickRangeSRV.Reset();
+    m_brickRangeTexture.Reset();
     m_labelSRV.Reset();
     m_labelTexture.Reset();
     m_volumeSRV.Reset();
@@ -269,18 +374,84 @@ bool VolumeRenderer::LoadVolumeData(const unsigned char* data, int width, int he
     m_volumeDepth = depth;
     m_voxelSize = voxelSize;
 
-    bool result = CreateVolumeTexture(data);
-    if (!result) {
+    bool result = true;
+    if (!m_device) {
+        Log("Headless renderer - skipping volume texture", LOG_INFO);
+    }
+    else if (!(result = CreateVolumeTexture(data))) {
         Log("Failed to create volume texture", LOG_ERROR);
     }
     else {
         Log("Volume texture created successfully", LOG_INFO);
     }
 
+    // Find the air around the sample so rays can skip it
+    if (m_autoCrop) {
+        m_volumeBounds = ComputeContentBounds(data, width, height, depth,
+            static_cast<unsigned char>(m_cropThreshold), m_cropCircle);
+        LogCropSavings(m_volumeBounds);
+    }
+    else {
+        m_volumeBounds = FullBounds(width, height, depth);
+    }
+
+    // Labels of the same size stay valid (remapped volumes are reloaded in
+    // place); otherwise the GPU and CPU copies are dropped together
+    bool keepLabels = !m_cpuLabels.IsEmpty() && m_cpuLabels.Width() == width
+        && m_cpuLabels.Height() == height && m_cpuLabels.Depth() == depth;
+    if (!keepLabels) {
+        if (m_labelSRV || !m_cpuLabels.IsEmpty()) {
+            Log("Labels do not match the new volume dimensions - labels must be reloaded", LOG_WARNING);
+        }
+        m_labelSRV.Reset();
+        m_labelTexture.Reset();
+        m_cpuLabels.Clear();
+        m_hasLabelBounds = false;
+    }
+
+    // Keep a bricked CPU copy so sampling along Y and Z stays cache friendly
+    auto start = std::chrono::steady_clock::now();
+    if (m_cpuVolume.Build(data, width, height, depth, &m_volumeStatistics)) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sprintf_s(buffer, "CPU volume bricked in %.1f ms (%.1f MB)", ms, m_cpuVolume.MemoryUsage() / (1024.0 * 1024.0));
+        Log(buffer, LOG_INFO);
+
+        const VolumeStatistics::Summary& global = m_volumeStatistics.Global();
+        sprintf_s(buffer, "Density range %d-%d, mean %.2f, standard deviation %.2f",
+            global.minValue, global.maxValue, global.mean, global.stddev);
+        Log(buffer, LOG_INFO);
+    }
+    else {
+        m_volumeStatistics.Clear();
+    }
+    m_sliceCache.Invalidate();
+    m_slabWindow.Invalidate();
+
+    m_gradientSRV.Reset();
+    m_gradientTexture.Reset();
+    m_cpuGradients.Clear();
+    if ((m_computeGradients || m_transferFunction.Is2D()) && !BuildGradientVolume(data)) {
+        Log("Failed to build gradient volume", LOG_WARNING);
+    }
+
+    // The shader skips bricks using the same value ranges as the CPU kernels
+    if (m_device && !CreateBrickRangeTexture()) {
+        Log("Failed to create brick range texture", LOG_WARNING);
+    }
+    m_brickFlagsSRV.Reset();
+    m_brickFlagsTexture.Reset();
+    m_transferDirty = true;
+
     return result;
 }
 
 bool VolumeRenderer::LoadLabelData(const unsigned char* data, int width, int height, int depth)
+{
+    m_grainBaseLabels.Clear();
+    return LoadLabels(data, width, height, depth);
+}
+
+bool VolumeRenderer::LoadLabels(const unsigned char* data, int width, int height, int depth)
 {
     char buffer[256];
     sprintf_s(buffer, "LoadLabelData: %dx%dx%d", width, height, depth);
@@ -297,14 +468,27 @@ bool VolumeRenderer::LoadLabelData(const unsigned char* data, int width, int hei
         return false;
     }
 
-    bool result = CreateLabelTexture(data);
-    if (!result) {
+    bool result = true;
+    if (!m_device) {
+        Log("Headless renderer - skipping label texture", LOG_INFO);
+    }
+    else if (!(result = CreateLabelTexture(data))) {
         Log("Failed to create label texture", LOG_ERROR);
     }
     else {
         Log("Label texture created successfully", LOG_INFO);
     }
 
+    // Labelled voxels must stay inside the ray interval even where the density is air
+    if (result && m_autoCrop) {
+        m_labelBounds = ComputeContentBounds(data, width, height, depth, 0, m_cropCircle);
+        m_hasLabelBounds = true;
+        LogCropSavings(GetUnclippedBounds());
+    }
+
+    m_cpuLabels.Build(data, width, height, depth);
+    m_transferDirty = true;
+
     return result;
 }
 
@@ -337,6 +521,9 @@ void VolumeRenderer::UpdateMaterials(const int* colors, int count)
         m_materials[i] = XMFLOAT4(r, g, b, a);
     }
 
+    // The recolor cache compares materials itself
+    m_reprojection.Invalidate();
+
     // Update material buffer
     if (m_context && m_materialBuffer) {
         Log("Updating material buffer on GPU", LOG_INFO);
@@ -353,7 +540,7 @@ void VolumeRenderer::UpdateMaterials(const int* colors, int count)
             Log(buffer, LOG_ERROR);
         }
     }
-    else {
+    else if (m_device) {
         Log("Cannot update materials - context or material buffer is null", LOG_ERROR);
     }
 }
@@ -366,13 +553,37 @@ void VolumeRenderer::Render()
             return;
         }
 
+        // With dynamic resolution the volume is ray cast into the corner of
+        // the scaled target and upscaled afterwards
+        int scaledWidth = m_width;
+        int scaledHeight = m_height;
+        bool scaled = m_gpuResolution.Scale() < 1.0f && CreateScaledTarget();
+        if (scaled) {
+            m_gpuResolution.ScaledSize(m_width, m_height, &scaledWidth, &scaledHeight);
+        }
+
+        // GPU time of the passes below feeds the controller a few frames later
+        int timingSlot = m_timingFrame % TIMING_FRAMES;
+        bool timed = m_gpuResolution.IsEnabled() && m_timingDisjoint[timingSlot];
+        if (timed) {
+            if (m_timingFrame >= TIMING_FRAMES) {
+                ReadFrameTiming(timingSlot);
+            }
+            m_timingScale[timingSlot] = scaled ? m_gpuResolution.Scale() : 1.0f;
+            m_context->Begin(m_timingDisjoint[timingSlot].Get());
+            m_context->End(m_timingBegin[timingSlot].Get());
+        }
+
         // Clear the back buffer
         float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-        m_context->ClearRenderTargetView(m_renderTargetView.Get(), clearColor);
+        ID3D11RenderTargetView* target = scaled ? m_scaledRTV.Get() : m_renderTargetView.Get();
+        m_context->ClearRenderTargetView(target, clearColor);
         m_context->ClearDepthStencilView(m_depthStencilView.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 
         // Set the render target
-        m_context->OMSetRenderTargets(1, m_renderTargetView.GetAddressOf(), m_depthStencilView.Get());
+        m_context->OMSetRenderTargets(1, &target, m_depthStencilView.Get());
+        D3D11_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(scaledWidth), static_cast<float>(scaledHeight), 0.0f, 1.0f };
+        m_context->RSSetViewports(1, &viewport);
 
         // Set up the vertex shader stage
         UINT stride = sizeof(Vertex);
@@ -384,6 +595,7 @@ void VolumeRenderer::Render()
         m_context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
 
         // Update and set constant buffers
+        UpdateTransferFunction();
         UpdateConstantBuffers();
         m_context->VSSetConstantBuffers(0, 1, m_constantBuffer.GetAddressOf());
         m_context->PSSetConstantBuffers(0, 1, m_constantBuffer.GetAddressOf());
@@ -406,8 +618,33 @@ void VolumeRenderer::Render()
             Log("Label shader resource view is null during render", LOG_INFO); // Not an error, might not have labels
         }
 
-        if (m_volumeSampler) {
-            m_context->PSSetSamplers(0, 1, m_volumeSampler.GetAddressOf());
+        if (m_brickRangeSRV) {
+            m_context->PSSetShaderResources(3, 1, m_brickRangeSRV.GetAddressOf());
+        }
+
+        if (m_transferSRV) {
+            m_context->PSSetShaderResources(4, 1, m_transferSRV.GetAddressOf());
+        }
+
+        if (m_brickFlagsSRV) {
+            m_context->PSSetShaderResources(5, 1, m_brickFlagsSRV.GetAddressOf());
+        }
+
+        if (m_preIntegratedSRV) {
+            m_context->PSSetShaderResources(6, 1, m_preIntegratedSRV.GetAddressOf());
+        }
+
+        if (m_gradientSRV) {
+            m_context->PSSetShaderResources(7, 1, m_gradientSRV.GetAddressOf());
+        }
+
+        if (m_transfer2DSRV) {
+            m_context->PSSetShaderResources(8, 1, m_transfer2DSRV.GetAddressOf());
+        }
+
+        ComPtr<ID3D11SamplerState>& sampler = m_filter == FILTER_NEAREST ? m_pointSampler : m_volumeSampler;
+        if (sampler) {
+            m_context->PSSetSamplers(0, 1, sampler.GetAddressOf());
         }
         else {
             Log("Volume sampler is null during render", LOG_WARNING);
@@ -416,6 +653,15 @@ void VolumeRenderer::Render()
         // Draw the cube (which becomes the volume)
         m_context->DrawIndexed(36, 0, 0);
 
+        if (scaled) {
+            UpscaleToBackBuffer(scaledWidth, scaledHeight);
+        }
+        if (timed) {
+            m_context->End(m_timingEnd[timingSlot].Get());
+            m_context->End(m_timingDisjoint[timingSlot].Get());
+            m_timingFrame++;
+        }
+
         // Present the back buffer to the screen
         HRESULT hr = m_swapChain->Present(1, 0);
         if (FAILED(hr)) {
@@ -454,6 +700,9 @@ void VolumeRenderer::Resize(int width, int height)
     Log("Releasing render target and depth stencil", LOG_INFO);
     m_renderTargetView.Reset();
     m_depthStencilView.Reset();
+    m_scaledSRV.Reset();
+    m_scaledRTV.Reset();
+    m_scaledTexture.Reset();
 
     // Resize the swap chain
     Log("Resizing swap chain buffers", LOG_INFO);
@@ -802,6 +1051,17 @@ bool VolumeRenderer::CreateConstantBuffers()
         return false;
     }
 
+    // Create constant buffer for rendering parameters
+    bufferDesc.ByteWidth = sizeof(RenderParamsBuffer);
+
+    hr = m_device->CreateBuffer(&bufferDesc, nullptr, &m_renderParamsBuffer);
+    if (FAILED(hr)) {
+        char buffer[256];
+        sprintf_s(buffer, "CreateBuffer for render params buffer failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
     // Create material buffer
     D3D11_BUFFER_DESC materialDesc = {};
     materialDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -865,10 +1125,169 @@ bool VolumeRenderer::CreateSamplers()
         return false;
     }
 
+    // Point sampler for FILTER_NEAREST
+    samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
+    hr = m_device->CreateSamplerState(&samplerDesc, &m_pointSampler);
+    if (FAILED(hr)) {
+        char buffer[256];
+        sprintf_s(buffer, "CreateSamplerState for point sampler failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
     Log("Samplers created successfully", LOG_INFO);
     return true;
 }
 
+bool VolumeRenderer::CreateUpscaleResources()
+{
+    char buffer[256];
+    ComPtr<ID3DBlob> vsBlob;
+    ComPtr<ID3DBlob> psBlob;
+    ComPtr<ID3DBlob> errorBlob;
+
+    HRESULT hr = D3DCompileFromFile(L"UpscaleVertexShader.hlsl", nullptr, nullptr, "main", "vs_5_0",
+        D3DCOMPILE_DEBUG, 0, &vsBlob, &errorBlob);
+    if (SUCCEEDED(hr)) {
+        hr = D3DCompileFromFile(L"UpscalePixelShader.hlsl", nullptr, nullptr, "main", "ps_5_0",
+            D3DCOMPILE_DEBUG, 0, &psBlob, &errorBlob);
+    }
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "Upscale shader compilation failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        if (errorBlob) {
+            Log(static_cast<char*>(errorBlob->GetBufferPointer()), LOG_ERROR);
+        }
+        return false;
+    }
+
+    hr = m_device->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), nullptr, &m_upscaleVertexShader);
+    if (SUCCEEDED(hr)) {
+        hr = m_device->CreatePixelShader(psBlob->GetBufferPointer(), psBlob->GetBufferSize(), nullptr, &m_upscalePixelShader);
+    }
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "Creating upscale shaders failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    D3D11_BUFFER_DESC bufferDesc = {};
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    bufferDesc.ByteWidth = sizeof(UpscaleParamsBuffer);
+    bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    hr = m_device->CreateBuffer(&bufferDesc, nullptr, &m_upscaleParamsBuffer);
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "Creating upscale params buffer failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    // Timestamp queries are read back TIMING_FRAMES frames late so the
+    // CPU never waits on the GPU
+    D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+    D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+    for (int i = 0; i < TIMING_FRAMES; i++) {
+        if (FAILED(m_device->CreateQuery(&disjointDesc, &m_timingDisjoint[i]))
+            || FAILED(m_device->CreateQuery(&timestampDesc, &m_timingBegin[i]))
+            || FAILED(m_device->CreateQuery(&timestampDesc, &m_timingEnd[i]))) {
+            Log("Creating frame timing queries failed", LOG_ERROR);
+            for (int j = 0; j <= i; j++) {
+                m_timingDisjoint[j].Reset();
+                m_timingBegin[j].Reset();
+                m_timingEnd[j].Reset();
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// The scaled target has the window's size so scale changes only move the
+// viewport; it is recreated on resize
+bool VolumeRenderer::CreateScaledTarget()
+{
+    if (m_scaledTexture) {
+        return true;
+    }
+    if (!m_upscalePixelShader) {
+        return false;
+    }
+
+    D3D11_TEXTURE2D_DESC texDesc = {};
+    texDesc.Width = m_width;
+    texDesc.Height = m_height;
+    texDesc.MipLevels = 1;
+    texDesc.ArraySize = 1;
+    texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    texDesc.SampleDesc.Count = 1;
+    texDesc.Usage = D3D11_USAGE_DEFAULT;
+    texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+    HRESULT hr = m_device->CreateTexture2D(&texDesc, nullptr, &m_scaledTexture);
+    if (SUCCEEDED(hr)) {
+        hr = m_device->CreateRenderTargetView(m_scaledTexture.Get(), nullptr, &m_scaledRTV);
+    }
+    if (SUCCEEDED(hr)) {
+        hr = m_device->CreateShaderResourceView(m_scaledTexture.Get(), nullptr, &m_scaledSRV);
+    }
+    if (FAILED(hr)) {
+        char buffer[256];
+        sprintf_s(buffer, "Creating scaled render target failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        m_scaledSRV.Reset();
+        m_scaledRTV.Reset();
+        m_scaledTexture.Reset();
+        return false;
+    }
+    return true;
+}
+
+void VolumeRenderer::ReadFrameTiming(int slot)
+{
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    UINT64 begin, end;
+    const UINT flags = D3D11_ASYNC_GETDATA_DONOTFLUSH;
+    if (m_context->GetData(m_timingDisjoint[slot].Get(), &disjoint, sizeof(disjoint), flags) != S_OK
+        || m_context->GetData(m_timingBegin[slot].Get(), &begin, sizeof(begin), flags) != S_OK
+        || m_context->GetData(m_timingEnd[slot].Get(), &end, sizeof(end), flags) != S_OK
+        || disjoint.Disjoint || disjoint.Frequency == 0) {
+        return;
+    }
+    // The frame was rendered TIMING_FRAMES frames ago, possibly at another
+    // scale; the controller expects the cost at the current one
+    double milliseconds = (end - begin) * 1000.0 / disjoint.Frequency;
+    float current = m_gpuResolution.Scale() < 1.0f && m_scaledTexture ? m_gpuResolution.Scale() : 1.0f;
+    float measured = m_timingScale[slot];
+    m_gpuResolution.Update(milliseconds * (current * current) / (measured * measured));
+}
+
+void VolumeRenderer::UpscaleToBackBuffer(int scaledWidth, int scaledHeight)
+{
+    UpscaleParamsBuffer params;
+    params.sourceSize = XMFLOAT2(static_cast<float>(scaledWidth), static_cast<float>(scaledHeight));
+    params.textureSize = XMFLOAT2(static_cast<float>(m_width), static_cast<float>(m_height));
+    params.edgeAware = m_edgeAwareUpscale ? 1 : 0;
+    params.upscalePadding = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    m_context->UpdateSubresource(m_upscaleParamsBuffer.Get(), 0, nullptr, &params, 0, 0);
+
+    m_context->OMSetRenderTargets(1, m_renderTargetView.GetAddressOf(), nullptr);
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(m_width), static_cast<float>(m_height), 0.0f, 1.0f };
+    m_context->RSSetViewports(1, &viewport);
+
+    m_context->IASetInputLayout(nullptr);
+    m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_context->VSSetShader(m_upscaleVertexShader.Get(), nullptr, 0);
+    m_context->PSSetShader(m_upscalePixelShader.Get(), nullptr, 0);
+    m_context->PSSetConstantBuffers(0, 1, m_upscaleParamsBuffer.GetAddressOf());
+    m_context->PSSetShaderResources(0, 1, m_scaledSRV.GetAddressOf());
+    m_context->PSSetSamplers(0, 1, m_volumeSampler.GetAddressOf());
+    m_context->Draw(3, 0);
+
+    // The scaled texture is a render target again next frame
+    ID3D11ShaderResourceView* nullView = nullptr;
+    m_context->PSSetShaderResources(0, 1, &nullView);
+}
+
 bool VolumeRenderer::CreateVolumeTexture(const unsigned char* data)
 {
     Log("CreateVolumeTexture called", LOG_INFO);
@@ -935,6 +1354,67 @@ bool VolumeRenderer::CreateVolumeTexture(const unsigned char* data)
     return true;
 }
 
+// Builds the CPU gradient volume and uploads it as an RGBA8 texture. The
+// texture is filled a slab at a time so the upload never needs a second
+// full-size linear copy.
+bool VolumeRenderer::BuildGradientVolume(const unsigned char* data)
+{
+    char buffer[256];
+    auto start = std::chrono::steady_clock::now();
+    if (!m_cpuGradients.Build(data, m_cpuVolume.Width(), m_cpuVolume.Height(), m_cpuVolume.Depth())) {
+        return false;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    sprintf_s(buffer, "Gradient volume built in %.1f ms (%.1f MB)", ms, m_cpuGradients.MemoryUsage() / (1024.0 * 1024.0));
+    Log(buffer, LOG_INFO);
+
+    // Brick visibility and the 2D table depend on the magnitudes
+    m_transferDirty = true;
+
+    if (!m_device) {
+        return true;
+    }
+
+    const int width = m_cpuGradients.Width();
+    const int height = m_cpuGradients.Height();
+    const int depth = m_cpuGradients.Depth();
+
+    D3D11_TEXTURE3D_DESC texDesc = {};
+    texDesc.Width = width;
+    texDesc.Height = height;
+    texDesc.Depth = depth;
+    texDesc.MipLevels = 1;
+    texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    texDesc.Usage = D3D11_USAGE_DEFAULT;
+    texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    HRESULT hr = m_device->CreateTexture3D(&texDesc, nullptr, &m_gradientTexture);
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "CreateTexture3D (gradients) failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    const int slab = 8;
+    std::vector<unsigned int> slices(static_cast<size_t>(width) * height * slab);
+    for (int z = 0; z < depth; z += slab) {
+        int zEnd = min(depth, z + slab);
+        m_cpuGradients.CopySlicesToLinear(z, zEnd, slices.data());
+        D3D11_BOX box = { 0, 0, static_cast<UINT>(z), static_cast<UINT>(width), static_cast<UINT>(height), static_cast<UINT>(zEnd) };
+        m_context->UpdateSubresource(m_gradientTexture.Get(), 0, &box, slices.data(),
+            width * sizeof(unsigned int), width * height * sizeof(unsigned int));
+    }
+
+    hr = m_device->CreateShaderResourceView(m_gradientTexture.Get(), nullptr, &m_gradientSRV);
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "CreateShaderResourceView (gradients) failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        m_gradientTexture.Reset();
+        return false;
+    }
+    return true;
+}
+
 bool VolumeRenderer::CreateLabelTexture(const unsigned char* data)
 {
     Log("CreateLabelTexture called", LOG_INFO);
@@ -999,77 +1479,347 @@ bool VolumeRenderer::CreateLabelTexture(const unsigned char* data)
     return true;
 }
 
-void VolumeRenderer::SetupViewport(int width, int height)
+bool VolumeRenderer::CreateBrickRangeTexture()
 {
+    m_brickRangeSRV.Reset();
+    m_brickRangeTexture.Reset();
+    if (m_cpuVolume.IsEmpty()) {
+        return false;
+    }
+
+    // Interleave min/max per node into an R8G8 texture with one texel per
+    // brick; mip L holds level L of the min-max hierarchy. The base size is
+    // padded to a multiple of the top node so every mip halves exactly, and
+    // the padding gets an empty range (min 255, max 0) that nothing can hit.
+    const int levels = BrickedVolume::RANGE_LEVELS;
+    const int topSize = 1 << (levels - 1);
+    int bricksX = (m_cpuVolume.BricksX() + topSize - 1) / topSize * topSize;
+    int bricksY = (m_cpuVolume.BricksY() + topSize - 1) / topSize * topSize;
+    int bricksZ = (m_cpuVolume.BricksZ() + topSize - 1) / topSize * topSize;
+
+    std::vector<unsigned char> ranges[BrickedVolume::RANGE_LEVELS];
+    D3D11_SUBRESOURCE_DATA initialData[BrickedVolume::RANGE_LEVELS] = {};
+    for (int level = 0; level < levels; level++) {
+        int sizeX = bricksX >> level, sizeY = bricksY >> level, sizeZ = bricksZ >> level;
+        std::vector<unsigned char>& texels = ranges[level];
+        texels.resize(static_cast<size_t>(sizeX) * sizeY * sizeZ * 2);
+        for (size_t i = 0; i < texels.size(); i += 2) {
+            texels[i] = 255;
+            texels[i + 1] = 0;
+        }
+        for (int nz = 0; nz < m_cpuVolume.NodesZ(level); nz++) {
+            for (int ny = 0; ny < m_cpuVolume.NodesY(level); ny++) {
+                for (int nx = 0; nx < m_cpuVolume.NodesX(level); nx++) {
+                    size_t node = m_cpuVolume.NodeIndex(level, nx, ny, nz);
+                    size_t texel = ((static_cast<size_t>(nz) * sizeY + ny) * sizeX + nx) * 2;
+                    texels[texel] = m_cpuVolume.NodeMin(level, node);
+                    texels[texel + 1] = m_cpuVolume.NodeMax(level, node);
+                }
+            }
+        }
+        initialData[level].pSysMem = texels.data();
+        initialData[level].SysMemPitch = sizeX * 2;
+        initialData[level].SysMemSlicePitch = sizeX * sizeY * 2;
+    }
+
+    D3D11_TEXTURE3D_DESC texDesc = {};
+    texDesc.Width = bricksX;
+    texDesc.Height = bricksY;
+    texDesc.Depth = bricksZ;
+    texDesc.MipLevels = levels;
+    texDesc.Format = DXGI_FORMAT_R8G8_UNORM;
+    texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
     char buffer[256];
-    sprintf_s(buffer, "SetupViewport: %dx%d", width, height);
-    Log(buffer, LOG_INFO);
+    HRESULT hr = m_device->CreateTexture3D(&texDesc, initialData, &m_brickRangeTexture);
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "CreateTexture3D for brick ranges failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
 
-    // Set up the viewport
-    D3D11_VIEWPORT viewport = {};
-    viewport.Width = static_cast<float>(width);
-    viewport.Height = static_cast<float>(height);
-    viewport.MinDepth = 0.0f;
-    viewport.MaxDepth = 1.0f;
-    viewport.TopLeftX = 0.0f;
-    viewport.TopLeftY = 0.0f;
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = texDesc.Format;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+    srvDesc.Texture3D.MipLevels = levels;
 
-    m_context->RSSetViewports(1, &viewport);
+    hr = m_device->CreateShaderResourceView(m_brickRangeTexture.Get(), &srvDesc, &m_brickRangeSRV);
+    if (FAILED(hr)) {
+        sprintf_s(buffer, "CreateShaderResourceView for brick ranges failed, HRESULT: 0x%08X", hr);
+        Log(buffer, LOG_ERROR);
+        m_brickRangeTexture.Reset();
+        return false;
+    }
+
+    sprintf_s(buffer, "Brick range texture created: %dx%dx%d", bricksX, bricksY, bricksZ);
+    Log(buffer, LOG_INFO);
+    return true;
 }
 
-void VolumeRenderer::UpdateConstantBuffers()
+void VolumeRenderer::UpdateTransferFunction()
 {
-    if (!m_context || !m_constantBuffer) {
-        Log("Cannot update constant buffers - context or buffer is null", LOG_ERROR);
+    if (!m_transferDirty) {
         return;
     }
+    m_transferDirty = false;
+    m_reprojection.Invalidate();
+    m_recolor.Invalidate();
 
-    // Create view and projection matrices
-    float aspectRatio = static_cast<float>(m_width) / static_cast<float>(m_height);
+    m_transferFunction.SetWindow(m_brightness, m_contrast, m_opacity);
 
-    XMMATRIX world = XMMatrixIdentity();
-    XMMATRIX view = XMMatrixLookAtLH(
-        XMLoadFloat3(&m_cameraPosition),
-        XMLoadFloat3(&m_focusPoint),
-        XMLoadFloat3(&m_upVector));
-    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, aspectRatio, 0.1f, 100.0f);
+    auto start = std::chrono::steady_clock::now();
+    m_transferFunction.ComputeBrickVisibility(m_cpuVolume, &m_cpuLabels, &m_cpuGradients, m_brickFlags);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
 
-    // Set up constant buffer data
-    ConstantBuffer cb;
-    cb.worldMatrix = XMMatrixTranspose(world);
-    cb.viewMatrix = XMMatrixTranspose(view);
-    cb.projectionMatrix = XMMatrixTranspose(projection);
-    cb.cameraPosition = m_cameraPosition;
-    cb.padding = 0.0f;
+    size_t visible = 0;
+    for (unsigned char flag : m_brickFlags) {
+        visible += (flag & BRICK_VISIBLE) ? 1 : 0;
+    }
+    char buffer[256];
+    sprintf_s(buffer, "Brick visibility updated in %.0f us: %zu of %zu bricks visible",
+        us, visible, m_brickFlags.size());
+    Log(buffer, LOG_INFO);
 
-    // Update constant buffer
-    m_context->UpdateSubresource(m_constantBuffer.Get(), 0, nullptr, &cb, 0, 0);
+    if (m_preIntegration) {
+        start = std::chrono::steady_clock::now();
+        m_transferFunction.BuildPreIntegrated(m_stepScale, m_preIntegrated);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sprintf_s(buffer, "Pre-integrated table built in %.1f ms (step scale %.2f)", ms, m_stepScale);
+        Log(buffer, LOG_INFO);
+    }
+    else {
+        std::vector<float>().swap(m_preIntegrated);
+    }
 
-    // Create and update render parameters buffer
-    ComPtr<ID3D11Buffer> renderParamsBuffer;
-    D3D11_BUFFER_DESC bufferDesc = {};
-    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    bufferDesc.ByteWidth = sizeof(RenderParamsBuffer);
-    bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    // The 2D table only applies while gradients exist to index it
+    if (m_transferFunction.Is2D() && !m_cpuGradients.IsEmpty()) {
+        m_transferFunction.Build2D(m_stepScale, m_transfer2D);
+    }
+    else {
+        std::vector<float>().swap(m_transfer2D);
+    }
 
-    HRESULT hr = m_device->CreateBuffer(&bufferDesc, nullptr, &renderParamsBuffer);
-    if (SUCCEEDED(hr)) {
-        RenderParamsBuffer params;
-        params.opacity = m_opacity;
+    if (m_device && !UploadTransferFunction()) {
+        Log("Failed to upload transfer function", LOG_ERROR);
+    }
+}
+
+// Uploads a TABLE_SIZE x TABLE_SIZE RGBA float table, or releases the
+// texture when the table is empty
+bool VolumeRenderer::UploadTable2D(const std::vector<float>& table, ComPtr<ID3D11Texture2D>& texture,
+    ComPtr<ID3D11ShaderResourceView>& srv, const char* name)
+{
+    if (table.empty()) {
+        srv.Reset();
+        texture.Reset();
+        return true;
+    }
+
+    if (!texture) {
+        char buffer[256];
+        D3D11_TEXTURE2D_DESC texDesc = {};
+        texDesc.Width = TransferFunction::TABLE_SIZE;
+        texDesc.Height = TransferFunction::TABLE_SIZE;
+        texDesc.MipLevels = 1;
+        texDesc.ArraySize = 1;
+        texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        texDesc.SampleDesc.Count = 1;
+        texDesc.Usage = D3D11_USAGE_DEFAULT;
+        texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        HRESULT hr = m_device->CreateTexture2D(&texDesc, nullptr, &texture);
+        if (FAILED(hr)) {
+            sprintf_s(buffer, "CreateTexture2D for %s failed, HRESULT: 0x%08X", name, hr);
+            Log(buffer, LOG_ERROR);
+            return false;
+        }
+
+        hr = m_device->CreateShaderResourceView(texture.Get(), nullptr, &srv);
+        if (FAILED(hr)) {
+            sprintf_s(buffer, "CreateShaderResourceView for %s failed, HRESULT: 0x%08X", name, hr);
+            Log(buffer, LOG_ERROR);
+            texture.Reset();
+            return false;
+        }
+    }
+    m_context->UpdateSubresource(texture.Get(), 0, nullptr, table.data(),
+        TransferFunction::TABLE_SIZE * 4 * sizeof(float), 0);
+    return true;
+}
+
+bool VolumeRenderer::UploadTransferFunction()
+{
+    char buffer[256];
+    HRESULT hr;
+
+    if (!m_transferTexture) {
+        D3D11_TEXTURE1D_DESC texDesc = {};
+        texDesc.Width = TransferFunction::TABLE_SIZE;
+        texDesc.MipLevels = 1;
+        texDesc.ArraySize = 1;
+        texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        texDesc.Usage = D3D11_USAGE_DEFAULT;
+        texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        hr = m_device->CreateTexture1D(&texDesc, nullptr, &m_transferTexture);
+        if (FAILED(hr)) {
+            sprintf_s(buffer, "CreateTexture1D for transfer function failed, HRESULT: 0x%08X", hr);
+            Log(buffer, LOG_ERROR);
+            return false;
+        }
+
+        hr = m_device->CreateShaderResourceView(m_transferTexture.Get(), nullptr, &m_transferSRV);
+        if (FAILED(hr)) {
+            sprintf_s(buffer, "CreateShaderResourceView for transfer function failed, HRESULT: 0x%08X", hr);
+            Log(buffer, LOG_ERROR);
+            m_transferTexture.Reset();
+            return false;
+        }
+    }
+    m_context->UpdateSubresource(m_transferTexture.Get(), 0, nullptr, m_transferFunction.Table(), 0, 0);
+
+    if (!UploadTable2D(m_preIntegrated, m_preIntegratedTexture, m_preIntegratedSRV, "pre-integrated table")
+        || !UploadTable2D(m_transfer2D, m_transfer2DTexture, m_transfer2DSRV, "2D transfer function")) {
+        return false;
+    }
+
+    if (m_brickFlags.empty()) {
+        return true;
+    }
+
+    // Recreated on volume load, since the brick grid changes with the volume
+    int bricksX = m_cpuVolume.BricksX();
+    int bricksY = m_cpuVolume.BricksY();
+    if (!m_brickFlagsTexture) {
+        D3D11_TEXTURE3D_DESC texDesc = {};
+        texDesc.Width = bricksX;
+        texDesc.Height = bricksY;
+        texDesc.Depth = m_cpuVolume.BricksZ();
+        texDesc.MipLevels = 1;
+        texDesc.Format = DXGI_FORMAT_R8_UINT;
+        texDesc.Usage = D3D11_USAGE_DEFAULT;
+        texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        hr = m_device->CreateTexture3D(&texDesc, nullptr, &m_brickFlagsTexture);
+        if (FAILED(hr)) {
+            sprintf_s(buffer, "CreateTexture3D for brick flags failed, HRESULT: 0x%08X", hr);
+            Log(buffer, LOG_ERROR);
+            return false;
+        }
+
+        hr = m_device->CreateShaderResourceView(m_brickFlagsTexture.Get(), nullptr, &m_brickFlagsSRV);
+        if (FAILED(hr)) {
+            sprintf_s(buffer, "CreateShaderResourceView for brick flags failed, HRESULT: 0x%08X", hr);
+            Log(buffer, LOG_ERROR);
+            m_brickFlagsTexture.Reset();
+            return false;
+        }
+    }
+    m_context->UpdateSubresource(m_brickFlagsTexture.Get(), 0, nullptr, m_brickFlags.data(),
+        bricksX, bricksX * bricksY);
+
+    return true;
+}
+
+void VolumeRenderer::SetupViewport(int width, int height)
+{
+    char buffer[256];
+    sprintf_s(buffer, "SetupViewport: %dx%d", width, height);
+    Log(buffer, LOG_INFO);
+
+    // Set up the viewport
+    D3D11_VIEWPORT viewport = {};
+    viewport.Width = static_cast<float>(width);
+    viewport.Height = static_cast<float>(height);
+    viewport.MinDepth = 0.0f;
+    viewport.MaxDepth = 1.0f;
+    viewport.TopLeftX = 0.0f;
+    viewport.TopLeftY = 0.0f;
+
+    m_context->RSSetViewports(1, &viewport);
+}
+
+void VolumeRenderer::UpdateConstantBuffers()
+{
+    if (!m_context || !m_constantBuffer) {
+        Log("Cannot update constant buffers - context or buffer is null", LOG_ERROR);
+        return;
+    }
+
+    // Create view and projection matrices
+    float aspectRatio = static_cast<float>(m_width) / static_cast<float>(m_height);
+
+    XMMATRIX world = XMMatrixIdentity();
+    XMMATRIX view = XMMatrixLookAtLH(
+        XMLoadFloat3(&m_cameraPosition),
+        XMLoadFloat3(&m_focusPoint),
+        XMLoadFloat3(&m_upVector));
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, aspectRatio, 0.1f, 100.0f);
+
+    // Set up constant buffer data
+    ConstantBuffer cb;
+    cb.worldMatrix = XMMatrixTranspose(world);
+    cb.viewMatrix = XMMatrixTranspose(view);
+    cb.projectionMatrix = XMMatrixTranspose(projection);
+    cb.cameraPosition = m_cameraPosition;
+    cb.padding = 0.0f;
+
+    // Update constant buffer
+    m_context->UpdateSubresource(m_constantBuffer.Get(), 0, nullptr, &cb, 0, 0);
+
+    // Update render parameters buffer
+    if (m_renderParamsBuffer) {
+        RenderParamsBuffer params;
+        params.opacity = m_opacity;
         params.brightness = m_brightness;
         params.contrast = m_contrast;
         params.renderMode = m_renderMode;
         params.volumeScale = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
         params.showLabels = m_showLabels ? 1 : 0;
-        params.padding[0] = params.padding[1] = 0.0f;
+        params.isoValue = m_isoValue;
+        params.stepScale = m_stepScale;
+        params.transfer2D = m_gradientSRV && m_transfer2DSRV ? 1 : 0;
+        params.preIntegrated = m_preIntegration && m_preIntegratedSRV && !params.transfer2D ? 1 : 0;
+
+        // Content bounds in texture space; voxel i covers [i, i + 1) / size
+        float w = static_cast<float>(max(1, m_volumeWidth));
+        float h = static_cast<float>(max(1, m_volumeHeight));
+        float d = static_cast<float>(max(1, m_volumeDepth));
+        ContentBounds bounds = GetRenderBounds();
+        if (bounds.IsEmpty()) {
+            params.boxMin = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.0f);
+            params.boxMax = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+        else {
+            params.boxMin = XMFLOAT4(bounds.minX / w, bounds.minY / h, bounds.minZ / d, 0.0f);
+            params.boxMax = XMFLOAT4((bounds.maxX + 1) / w, (bounds.maxY + 1) / h, (bounds.maxZ + 1) / d, 0.0f);
+        }
+        params.volumeDims = XMFLOAT4(w, h, d, 0.0f);
+        params.cropCircle = bounds.hasCircle
+            ? XMFLOAT4(bounds.centerX, bounds.centerY, bounds.radius, 1.0f)
+            : XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        params.brickInfo = XMFLOAT4(static_cast<float>(max(1, m_cpuVolume.BricksX())),
+            static_cast<float>(max(1, m_cpuVolume.BricksY())),
+            static_cast<float>(max(1, m_cpuVolume.BricksZ())),
+            static_cast<float>(BrickedVolume::BRICK_SIZE));
+        params.valueRange = m_cpuVolume.IsEmpty()
+            ? XMFLOAT4(0.0f, 1.0f, 0.0f, 0.0f)
+            : XMFLOAT4(m_cpuVolume.MinValue() / 255.0f, m_cpuVolume.MaxValue() / 255.0f, 0.0f, 0.0f);
+        params.shading = m_gradientSRV ? m_shading : SHADING_NONE;
+        params.clipPlaneCount = m_clipPlaneCount;
+        params.brickSkip = m_brickFlagsSRV ? 1 : 0;
+        for (int i = 0; i < MAX_CLIP_PLANES; i++) {
+            params.clipPlanes[i] = i < m_clipPlaneCount
+                ? XMFLOAT4(m_clipPlanes[i][0] * w, m_clipPlanes[i][1] * h, m_clipPlanes[i][2] * d, m_clipPlanes[i][3])
+                : XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        }
 
-        m_context->UpdateSubresource(renderParamsBuffer.Get(), 0, nullptr, &params, 0, 0);
-        m_context->PSSetConstantBuffers(1, 1, renderParamsBuffer.GetAddressOf());
+        m_context->UpdateSubresource(m_renderParamsBuffer.Get(), 0, nullptr, &params, 0, 0);
+        m_context->PSSetConstantBuffers(1, 1, m_renderParamsBuffer.GetAddressOf());
     }
     else {
-        char buffer[256];
-        sprintf_s(buffer, "Failed to create render params buffer, HRESULT: 0x%08X", hr);
-        Log(buffer, LOG_ERROR);
+        Log("Render params buffer is null", LOG_ERROR);
     }
 
     // Set material buffer
@@ -1083,15 +1833,21 @@ void VolumeRenderer::UpdateConstantBuffers()
 
 // Getter/setter methods
 void VolumeRenderer::SetOpacity(float opacity) {
-    m_opacity = max(0.0f, min(1.0f, opacity));
+    opacity = max(0.0f, min(1.0f, opacity));
+    m_transferDirty |= opacity != m_opacity;
+    m_opacity = opacity;
 }
 
 void VolumeRenderer::SetBrightness(float brightness) {
-    m_brightness = max(-1.0f, min(1.0f, brightness));
+    brightness = max(-1.0f, min(1.0f, brightness));
+    m_transferDirty |= brightness != m_brightness;
+    m_brightness = brightness;
 }
 
 void VolumeRenderer::SetContrast(float contrast) {
-    m_contrast = max(0.1f, min(5.0f, contrast));
+    contrast = max(0.1f, min(5.0f, contrast));
+    m_transferDirty |= contrast != m_contrast;
+    m_contrast = contrast;
 }
 
 void VolumeRenderer::SetRenderMode(int mode) {
@@ -1101,3 +1857,982 @@ void VolumeRenderer::SetRenderMode(int mode) {
 void VolumeRenderer::SetShowLabels(bool show) {
     m_showLabels = show;
 }
+
+void VolumeRenderer::SetSampleFilter(int filter) {
+    m_filter = filter == FILTER_NEAREST ? FILTER_NEAREST : FILTER_LINEAR;
+}
+
+void VolumeRenderer::SetIsoValue(float isoValue) {
+    m_isoValue = max(0.0f, min(1.0f, isoValue));
+}
+
+void VolumeRenderer::SetSampling(float stepScale, bool preIntegrated) {
+    m_stepScale = max(0.25f, min(8.0f, stepScale));
+    m_preIntegration = preIntegrated;
+    m_transferDirty = true;
+}
+
+bool VolumeRenderer::SetGradientVolume(bool enable) {
+    m_computeGradients = enable;
+    if (!enable) {
+        ReleaseGradientVolume();
+        return true;
+    }
+    return EnsureGradientVolume();
+}
+
+bool VolumeRenderer::EnsureGradientVolume() {
+    if (m_cpuVolume.IsEmpty() || !m_cpuGradients.IsEmpty()) {
+        return true;
+    }
+
+    std::vector<unsigned char> data(static_cast<size_t>(m_cpuVolume.Width()) * m_cpuVolume.Height() * m_cpuVolume.Depth());
+    m_cpuVolume.CopyToLinear(data.data());
+    return BuildGradientVolume(data.data());
+}
+
+void VolumeRenderer::ReleaseGradientVolume() {
+    if (m_computeGradients || m_transferFunction.Is2D() || m_cpuGradients.IsEmpty()) {
+        return;
+    }
+    m_gradientSRV.Reset();
+    m_gradientTexture.Reset();
+    m_cpuGradients.Clear();
+    m_transferDirty = true;
+}
+
+bool VolumeRenderer::SetTransferFunction2D(const float* rgba, int densityEntries, int magnitudeEntries) {
+    bool set = m_transferFunction.Set2D(rgba, densityEntries, magnitudeEntries);
+    m_transferDirty = true;
+
+    char buffer[256];
+    if (set) {
+        sprintf_s(buffer, "2D transfer function set: %d x %d entries", densityEntries, magnitudeEntries);
+        Log(buffer, LOG_INFO);
+        return EnsureGradientVolume();
+    }
+    Log("2D transfer function cleared", LOG_INFO);
+    ReleaseGradientVolume();
+    return false;
+}
+
+int VolumeRenderer::GetJointHistogram(unsigned int* counts, int capacity) {
+    const int size = GradientVolume::HISTOGRAM_SIZE * GradientVolume::HISTOGRAM_SIZE;
+    if (!counts || capacity < size || m_cpuVolume.IsEmpty()) {
+        return 0;
+    }
+    if (!EnsureGradientVolume()) {
+        return 0;
+    }
+
+    const std::vector<unsigned int>& histogram = m_cpuGradients.JointHistogram();
+    std::copy(histogram.begin(), histogram.end(), counts);
+    ReleaseGradientVolume();
+    return size;
+}
+
+int VolumeRenderer::GetHistogram(unsigned long long* counts, int capacity) const {
+    if (m_volumeStatistics.IsEmpty() || capacity < VolumeStatistics::BINS) {
+        return 0;
+    }
+
+    std::copy(m_volumeStatistics.Histogram(), m_volumeStatistics.Histogram() + VolumeStatistics::BINS, counts);
+    return VolumeStatistics::BINS;
+}
+
+int VolumeRenderer::GetSliceHistograms(unsigned int* counts, int capacity) const {
+    const int depth = m_volumeStatistics.Depth();
+    if (m_volumeStatistics.IsEmpty() || capacity / VolumeStatistics::BINS < depth) {
+        return 0;
+    }
+
+    const unsigned int* bins = m_volumeStatistics.SliceHistogram(0);
+    std::copy(bins, bins + static_cast<size_t>(depth) * VolumeStatistics::BINS, counts);
+    return depth * VolumeStatistics::BINS;
+}
+
+int VolumeRenderer::GetVolumeStatistics(double* values, int capacity) const {
+    const int depth = m_volumeStatistics.Depth();
+    if (m_volumeStatistics.IsEmpty() || capacity / 4 < depth + 1) {
+        return 0;
+    }
+
+    auto store = [](const VolumeStatistics::Summary& summary, double* out) {
+        out[0] = summary.minValue;
+        out[1] = summary.maxValue;
+        out[2] = summary.mean;
+        out[3] = summary.stddev;
+    };
+    store(m_volumeStatistics.Global(), values);
+    for (int z = 0; z < depth; z++) {
+        store(m_volumeStatistics.Slice(z), values + 4 * (z + 1));
+    }
+    return 4 * (depth + 1);
+}
+
+int VolumeRenderer::GetMaterialStatistics(double* values, int capacity) {
+    const BrickedVolume& source = AnalysisLabels();
+    const int valuesPerLabel = 15;
+    if (m_cpuVolume.IsEmpty() || source.IsEmpty()) {
+        Log("Cannot compute material statistics - volume and labels must be loaded", LOG_ERROR);
+        return 0;
+    }
+    if (capacity < 256 * valuesPerLabel) {
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<MaterialStats> stats;
+    if (!ComputeMaterialStatistics(m_cpuVolume, source, m_voxelSize, stats)) {
+        Log("Cannot compute material statistics - label and volume dimensions differ", LOG_ERROR);
+        return 0;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    int materials = 0;
+    for (int l = 0; l < 256; l++) {
+        const MaterialStats& s = stats[l];
+        double* out = values + l * valuesPerLabel;
+        out[0] = static_cast<double>(s.count);
+        out[1] = s.volume;
+        out[2] = s.mean;
+        out[3] = s.stddev;
+        out[4] = s.minDensity;
+        out[5] = s.maxDensity;
+        for (int c = 0; c < 6; c++) {
+            out[6 + c] = s.bounds[c];
+        }
+        // Voxel centres at i + 0.5, as in the rest of the API
+        for (int c = 0; c < 3; c++) {
+            out[12 + c] = s.count > 0 ? s.centroid[c] + 0.5 : 0.0;
+        }
+        materials += s.count > 0 ? 1 : 0;
+    }
+
+    char buffer[256];
+    sprintf_s(buffer, "Material statistics: %d labels present, computed in %.1f ms", materials, ms);
+    Log(buffer, LOG_INFO);
+    return 256 * valuesPerLabel;
+}
+
+int VolumeRenderer::LabelComponents(int material, int connectivity, unsigned int* ids) {
+    const BrickedVolume& source = AnalysisLabels();
+    m_components.clear();
+    if (source.IsEmpty()) {
+        Log("Cannot label components - no labels loaded", LOG_ERROR);
+        return -1;
+    }
+
+    // Without an output buffer only the component table is kept
+    std::vector<unsigned int> scratch;
+    if (!ids) {
+        scratch.resize(static_cast<size_t>(source.Width()) * source.Height() * source.Depth());
+        ids = scratch.data();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int count = LabelConnectedComponents(source, static_cast<unsigned char>(material), connectivity, ids, m_components);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char buffer[256];
+    if (count < 0) {
+        sprintf_s(buffer, "Cannot label components - unsupported connectivity %d", connectivity);
+        Log(buffer, LOG_ERROR);
+        return -1;
+    }
+    sprintf_s(buffer, "Material %d: %d components (%d-connected) labelled in %.1f ms", material, count, connectivity, ms);
+    Log(buffer, LOG_INFO);
+    return count;
+}
+
+int VolumeRenderer::GetComponentInfo(long long* values, int capacity) const {
+    const int valuesPerComponent = 7;
+    int count = min(static_cast<int>(m_components.size()), capacity / valuesPerComponent);
+    for (int i = 0; i < count; i++) {
+        long long* out = values + i * valuesPerComponent;
+        out[0] = static_cast<long long>(m_components[i].size);
+        for (int c = 0; c < 6; c++) {
+            out[1 + c] = m_components[i].bounds[c];
+        }
+    }
+    return count;
+}
+
+bool VolumeRenderer::DistanceTransform(int material, const float* spacing, bool squared, void* out) {
+    const BrickedVolume& source = AnalysisLabels();
+    if (source.IsEmpty()) {
+        Log("Cannot compute distance transform - no labels loaded", LOG_ERROR);
+        return false;
+    }
+
+    float isotropic[3] = { m_voxelSize, m_voxelSize, m_voxelSize };
+    if (!spacing) {
+        spacing = isotropic;
+    }
+    for (int c = 0; c < 3; c++) {
+        if (!(spacing[c] > 0.0f)) {
+            Log("Cannot compute distance transform - voxel spacing must be positive", LOG_ERROR);
+            return false;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ::DistanceTransform(source, static_cast<unsigned char>(material), spacing, squared, out);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char buffer[256];
+    sprintf_s(buffer, "Material %d: %s distance transform (%dx%dx%d) computed in %.1f ms", material,
+        squared ? "squared" : "Euclidean", source.Width(), source.Height(), source.Depth(), ms);
+    Log(buffer, LOG_INFO);
+    return true;
+}
+
+bool VolumeRenderer::ApplyMorphology(int material, int operation, int element, int radius, int replacement,
+    unsigned char* out) {
+    const BrickedVolume& source = AnalysisLabels();
+    if (source.IsEmpty()) {
+        Log("Cannot apply morphology - no labels loaded", LOG_ERROR);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    BitMask before, mask;
+    before.Build(source, static_cast<unsigned char>(material));
+    mask = before;
+    if (!::ApplyMorphology(mask, operation, element, radius)) {
+        char buffer[256];
+        sprintf_s(buffer, "Cannot apply morphology - unsupported operation %d, element %d or radius %d", operation, element, radius);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    const int width = source.Width(), height = source.Height(), depth = source.Depth();
+    std::vector<unsigned char> labels;
+    if (!out) {
+        labels.resize(static_cast<size_t>(width) * height * depth);
+        out = labels.data();
+    }
+    source.CopyToLinear(out);
+    WriteMaskChanges(before, mask, static_cast<unsigned char>(material), static_cast<unsigned char>(replacement), out);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char buffer[256];
+    sprintf_s(buffer, "Material %d: morphology %d (element %d, radius %d) %llu -> %llu voxels in %.1f ms", material,
+        operation, element, radius, before.Count(), mask.Count(), ms);
+    Log(buffer, LOG_INFO);
+
+    if (!labels.empty()) {
+        return LoadLabelData(labels.data(), width, height, depth);
+    }
+    return true;
+}
+
+int VolumeRenderer::SeparateGrains(int material, float h, unsigned int* ids, bool display) {
+    const BrickedVolume& source = AnalysisLabels();
+    m_components.clear();
+    if (source.IsEmpty()) {
+        Log("Cannot separate grains - no labels loaded", LOG_ERROR);
+        return -1;
+    }
+    if (!(h > 0.0f)) {
+        Log("Cannot separate grains - marker depth must be positive", LOG_ERROR);
+        return -1;
+    }
+
+    const int width = source.Width(), height = source.Height(), depth = source.Depth();
+    const size_t voxels = static_cast<size_t>(width) * height * depth;
+    std::vector<unsigned int> scratch;
+    if (!ids) {
+        scratch.resize(voxels);
+        ids = scratch.data();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int count = ::SeparateGrains(source, static_cast<unsigned char>(material), h, ids, m_components);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char buffer[256];
+    sprintf_s(buffer, "Material %d: %d grains separated (h = %.2f) in %.1f ms", material, count, h, ms);
+    Log(buffer, LOG_INFO);
+
+    if (display) {
+        if (!DisplayGrains(ids)) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+int VolumeRenderer::ExtractPoreNetwork(int material, float h, unsigned int* ids, bool display) {
+    const BrickedVolume& source = AnalysisLabels();
+    m_components.clear();
+    m_pores.clear();
+    m_throats.clear();
+    if (source.IsEmpty()) {
+        Log("Cannot extract pore network - no labels loaded", LOG_ERROR);
+        return -1;
+    }
+    if (!(h > 0.0f)) {
+        Log("Cannot extract pore network - marker depth must be positive", LOG_ERROR);
+        return -1;
+    }
+
+    const int width = source.Width(), height = source.Height(), depth = source.Depth();
+    const size_t voxels = static_cast<size_t>(width) * height * depth;
+    std::vector<unsigned int> scratch;
+    if (!ids) {
+        scratch.resize(voxels);
+        ids = scratch.data();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int count = ::ExtractPoreNetwork(source, static_cast<unsigned char>(material), h, m_voxelSize, ids,
+        m_components, m_pores, m_throats);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char buffer[256];
+    sprintf_s(buffer, "Material %d: pore network of %d pores and %d throats (h = %.2f) extracted in %.1f ms",
+        material, count, static_cast<int>(m_throats.size()), h, ms);
+    Log(buffer, LOG_INFO);
+
+    if (display) {
+        if (!DisplayGrains(ids)) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+// The voxels of the grains take grain ids cycling through the 255 non-zero
+// labels; every other label stays, and the labels as they were are kept
+bool VolumeRenderer::DisplayGrains(const unsigned int* ids) {
+    if (m_grainBaseLabels.IsEmpty()) {
+        m_grainBaseLabels = m_cpuLabels;
+    }
+    const int width = m_grainBaseLabels.Width(), height = m_grainBaseLabels.Height(), depth = m_grainBaseLabels.Depth();
+    const size_t voxels = static_cast<size_t>(width) * height * depth;
+    std::vector<unsigned char> labels(voxels);
+    m_grainBaseLabels.CopyToLinear(labels.data());
+    GrainsToLabels(ids, voxels, labels.data());
+    return LoadLabels(labels.data(), width, height, depth);
+}
+
+bool VolumeRenderer::RestoreLabels() {
+    if (m_grainBaseLabels.IsEmpty()) {
+        return true;
+    }
+    const int width = m_grainBaseLabels.Width(), height = m_grainBaseLabels.Height(), depth = m_grainBaseLabels.Depth();
+    std::vector<unsigned char> labels(static_cast<size_t>(width) * height * depth);
+    m_grainBaseLabels.CopyToLinear(labels.data());
+    Log("Restoring labels replaced by the grain display", LOG_INFO);
+    return LoadLabelData(labels.data(), width, height, depth);
+}
+
+int VolumeRenderer::GetPores(double* values, int capacity) const {
+    const int valuesPerPore = 7;
+    int count = min(static_cast<int>(m_pores.size()), capacity / valuesPerPore);
+    for (int i = 0; i < count; i++) {
+        const PoreInfo& pore = m_pores[i];
+        double* out = values + i * valuesPerPore;
+        out[0] = pore.volume;
+        out[1] = pore.area;
+        out[2] = pore.radius;
+        out[3] = pore.center[0];
+        out[4] = pore.center[1];
+        out[5] = pore.center[2];
+        out[6] = pore.coordination;
+    }
+    return count;
+}
+
+int VolumeRenderer::GetThroats(double* values, int capacity) const {
+    const int valuesPerThroat = 6;
+    int count = min(static_cast<int>(m_throats.size()), capacity / valuesPerThroat);
+    for (int i = 0; i < count; i++) {
+        const ThroatInfo& throat = m_throats[i];
+        double* out = values + i * valuesPerThroat;
+        out[0] = throat.pore1;
+        out[1] = throat.pore2;
+        out[2] = throat.radius;
+        out[3] = throat.length;
+        out[4] = throat.volume;
+        out[5] = throat.area;
+    }
+    return count;
+}
+
+void VolumeRenderer::SetShading(int flags) {
+    m_shading = flags & (SHADING_PHONG | SHADING_GRADIENT_OPACITY);
+}
+
+bool VolumeRenderer::SetTransferFunction(const float* rgba, int entries) {
+    bool custom = m_transferFunction.Set(rgba, entries);
+    m_transferDirty = true;
+
+    char buffer[256];
+    if (custom) {
+        sprintf_s(buffer, "Transfer function set: %d entries", entries);
+    }
+    else {
+        sprintf_s(buffer, "Transfer function cleared - using brightness/contrast window");
+    }
+    Log(buffer, LOG_INFO);
+    return custom;
+}
+
+void VolumeRenderer::SetAutoCrop(bool enable, int threshold, bool circularMask) {
+    m_autoCrop = enable;
+    m_cropThreshold = max(0, min(254, threshold));
+    m_cropCircle = circularMask;
+
+    // Disabling takes effect immediately; new thresholds apply on the next load
+    if (!enable) {
+        m_volumeBounds = FullBounds(m_volumeWidth, m_volumeHeight, m_volumeDepth);
+        m_hasLabelBounds = false;
+    }
+}
+
+bool VolumeRenderer::GetContentBounds(int* bounds) const {
+    ContentBounds content = GetUnclippedBounds();
+    if (!bounds || content.IsEmpty()) {
+        return false;
+    }
+
+    bounds[0] = content.minX;
+    bounds[1] = content.minY;
+    bounds[2] = content.minZ;
+    bounds[3] = content.maxX;
+    bounds[4] = content.maxY;
+    bounds[5] = content.maxZ;
+    return true;
+}
+
+void VolumeRenderer::SetTargetFrameTime(float milliseconds, bool edgeAware) {
+    m_gpuResolution.SetTarget(milliseconds);
+    m_cpuResolution.SetTarget(milliseconds);
+    m_edgeAwareUpscale = edgeAware;
+    m_timingFrame = 0;
+    if (!m_gpuResolution.IsEnabled()) {
+        std::vector<unsigned char>().swap(m_cpuScaled);
+        m_scaledSRV.Reset();
+        m_scaledRTV.Reset();
+        m_scaledTexture.Reset();
+    }
+}
+
+int VolumeRenderer::SetClipPlanes(const float* planes, int count) {
+    m_clipPlaneCount = 0;
+    if (!planes) {
+        return 0;
+    }
+
+    for (int i = 0; i < count && m_clipPlaneCount < MAX_CLIP_PLANES; i++) {
+        const float* plane = planes + i * 4;
+        if (plane[0] == 0.0f && plane[1] == 0.0f && plane[2] == 0.0f) {
+            continue;
+        }
+        for (int c = 0; c < 4; c++) {
+            m_clipPlanes[m_clipPlaneCount][c] = plane[c];
+        }
+        m_clipPlaneCount++;
+    }
+
+    if (count > MAX_CLIP_PLANES) {
+        char buffer[256];
+        sprintf_s(buffer, "Only the first %d clip planes are used (%d given)", MAX_CLIP_PLANES, count);
+        Log(buffer, LOG_WARNING);
+    }
+    return m_clipPlaneCount;
+}
+
+bool VolumeRenderer::SetRegionOfInterest(const int* box) {
+    if (!box) {
+        m_hasRoi = false;
+        return true;
+    }
+
+    // Clamped to the loaded volume; before a load only the order is checked
+    int roi[6];
+    const int dims[3] = { m_volumeWidth, m_volumeHeight, m_volumeDepth };
+    bool valid = true;
+    for (int axis = 0; axis < 3; axis++) {
+        roi[axis] = box[axis];
+        roi[axis + 3] = box[axis + 3];
+        if (dims[axis] > 0) {
+            roi[axis] = max(0, roi[axis]);
+            roi[axis + 3] = min(dims[axis] - 1, roi[axis + 3]);
+        }
+        valid = valid && box[axis] <= box[axis + 3] && roi[axis] <= roi[axis + 3];
+    }
+    if (!valid) {
+        char buffer[256];
+        sprintf_s(buffer, "Ignoring region of interest %d-%d, %d-%d, %d-%d: empty or outside the %dx%dx%d volume",
+            box[0], box[3], box[1], box[4], box[2], box[5], m_volumeWidth, m_volumeHeight, m_volumeDepth);
+        Log(buffer, LOG_WARNING);
+        return false;
+    }
+
+    m_hasRoi = true;
+    m_roi = FullBounds(0, 0, 0);
+    m_roi.minX = roi[0];
+    m_roi.minY = roi[1];
+    m_roi.minZ = roi[2];
+    m_roi.maxX = roi[3];
+    m_roi.maxY = roi[4];
+    m_roi.maxZ = roi[5];
+    return true;
+}
+
+bool VolumeRenderer::BenchmarkVolumeLayout(double* samplesPerSecond) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot benchmark volume layout - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    MeasureLayoutThroughput(m_cpuVolume, samplesPerSecond);
+
+    char buffer[256];
+    const char* axes[3] = { "X", "Y", "Z" };
+    for (int axis = 0; axis < 3; axis++) {
+        sprintf_s(buffer, "Layout benchmark %s: z-major %.1f Msamples/s, bricked %.1f Msamples/s",
+            axes[axis], samplesPerSecond[axis] / 1e6, samplesPerSecond[3 + axis] / 1e6);
+        Log(buffer, LOG_INFO);
+    }
+    return true;
+}
+
+bool VolumeRenderer::RenderCpu(unsigned char* rgba, int width, int height) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot render on CPU - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    // The cost view logs its summary for the first frame only
+    if (m_costView) {
+        bool log = !m_costViewLogged;
+        m_costViewLogged = true;
+        return RenderCostMap(rgba, nullptr, width, height, log);
+    }
+
+    UpdateTransferFunction();
+    if (!m_cpuResolution.IsEnabled()) {
+        CastCpuFrame(rgba, width, height);
+        return true;
+    }
+
+    // Time the whole frame, upscale included, against the target
+    auto start = std::chrono::steady_clock::now();
+    int scaledWidth, scaledHeight;
+    m_cpuResolution.ScaledSize(width, height, &scaledWidth, &scaledHeight);
+    if (scaledWidth == width && scaledHeight == height) {
+        CastCpuFrame(rgba, width, height);
+    }
+    else {
+        m_cpuScaled.resize(static_cast<size_t>(scaledWidth) * scaledHeight * 4);
+        CastCpuFrame(m_cpuScaled.data(), scaledWidth, scaledHeight);
+        UpscaleImage(m_cpuScaled.data(), scaledWidth, scaledHeight, rgba, width, height, m_edgeAwareUpscale);
+    }
+    m_cpuResolution.Update(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return true;
+}
+
+// Ray casts the current view, reusing the previous frame when enabled
+void VolumeRenderer::CastCpuFrame(unsigned char* rgba, int width, int height) {
+    if (m_recolorCache) {
+        m_recolor.Render(m_cpuVolume, &m_cpuLabels, GetCpuRenderParams(), GetCpuCamera(), width, height, rgba);
+    }
+    else if (m_temporalReprojection) {
+        m_reprojection.Render(m_cpuVolume, &m_cpuLabels, GetCpuRenderParams(), GetCpuCamera(), width, height, rgba);
+    }
+    else {
+        CpuRayCaster::Render(m_cpuVolume, &m_cpuLabels, GetCpuRenderParams(), GetCpuCamera(), width, height, rgba);
+    }
+}
+
+void VolumeRenderer::SetTemporalReprojection(bool enable) {
+    m_temporalReprojection = enable;
+    m_reprojection.Invalidate();
+}
+
+void VolumeRenderer::SetRecolorCache(bool enable) {
+    m_recolorCache = enable;
+    if (!enable) {
+        m_recolor = RecolorCache();
+    }
+    m_recolor.Invalidate();
+}
+
+void VolumeRenderer::SetCostView(bool enable) {
+    m_costView = enable;
+    m_costViewLogged = false;
+}
+
+bool VolumeRenderer::RenderCostMap(unsigned char* rgba, int* counts, int width, int height, bool log) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot render cost map - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    UpdateTransferFunction();
+    CpuRenderParams params = GetCpuRenderParams();
+    std::vector<RayCost> costs(static_cast<size_t>(width) * height);
+    CpuRayCaster::RenderCost(m_cpuVolume, &m_cpuLabels, params, GetCpuCamera(), width, height, costs.data());
+
+    if (rgba) {
+        CpuRayCaster::CostToColor(costs.data(), width, height, params.maxSteps, rgba);
+    }
+
+    long long samples = 0, bricks = 0, skipped = 0;
+    int terminations[RAY_TERMINATION_COUNT] = {};
+    for (size_t i = 0; i < costs.size(); i++) {
+        const RayCost& cost = costs[i];
+        samples += cost.samples;
+        bricks += cost.bricks;
+        skipped += cost.skipped;
+        terminations[cost.termination]++;
+        if (counts) {
+            counts[i * 4] = cost.samples;
+            counts[i * 4 + 1] = cost.bricks;
+            counts[i * 4 + 2] = cost.skipped;
+            counts[i * 4 + 3] = cost.termination;
+        }
+    }
+
+    if (!log) {
+        return true;
+    }
+
+    char buffer[256];
+    double rays = static_cast<double>(costs.size());
+    sprintf_s(buffer, "Cost map %dx%d: %.1f samples/ray, %.1f bricks/ray (%.0f%% skipped)",
+        width, height, samples / rays, bricks / rays, bricks > 0 ? 100.0 * skipped / bricks : 0.0);
+    Log(buffer, LOG_INFO);
+    sprintf_s(buffer, "Terminations: %d missed, %d exited, %d opaque, %d step limit, %d extreme, %d surface",
+        terminations[RAY_MISSED], terminations[RAY_EXITED], terminations[RAY_OPAQUE],
+        terminations[RAY_STEP_LIMIT], terminations[RAY_EXTREME], terminations[RAY_SURFACE]);
+    Log(buffer, LOG_INFO);
+    return true;
+}
+
+int VolumeRenderer::RenderCameraPath(const float* poses, int count, int width, int height, const FrameSink& deliver) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot render camera path - no volume loaded", LOG_ERROR);
+        return 0;
+    }
+
+    std::vector<CpuCamera> cameras(count);
+    for (int i = 0; i < count; i++) {
+        const float* pose = poses + i * 10;
+        CpuCamera& camera = cameras[i];
+        for (int c = 0; c < 3; c++) {
+            camera.position[c] = pose[c];
+            camera.target[c] = pose[3 + c];
+            camera.up[c] = pose[6 + c];
+        }
+        camera.fovY = pose[9] > 0.0f ? pose[9] : XM_PIDIV4;
+    }
+
+    UpdateTransferFunction();
+    auto start = std::chrono::steady_clock::now();
+    int delivered = RenderFrameBatch(m_cpuVolume, &m_cpuLabels, GetCpuRenderParams(), cameras.data(), count,
+        width, height, deliver);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char buffer[256];
+    sprintf_s(buffer, "Camera path: %d of %d frames at %dx%d in %.1f s (%.2f frames/s)",
+        delivered, count, width, height, seconds, seconds > 0.0 ? delivered / seconds : 0.0);
+    Log(buffer, LOG_INFO);
+    return delivered;
+}
+
+bool VolumeRenderer::ExtractSlice(const float* origin, const float* u, const float* v, int width, int height,
+    int interpolation, unsigned char* out) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot extract slice - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    // Reslice samples with voxel centres on integers
+    const float centred[3] = { origin[0] - 0.5f, origin[1] - 0.5f, origin[2] - 0.5f };
+    ::ExtractSlice(m_cpuVolume, centred, u, v, width, height, interpolation, out);
+    return true;
+}
+
+bool VolumeRenderer::GetAxisSliceSize(int axis, int lod, int* width, int* height) const {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot size axis slice - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    return AxisSliceSize(m_cpuVolume, axis, lod, *width, *height);
+}
+
+bool VolumeRenderer::ExtractAxisSlice(int axis, int index, int lod, unsigned char* out) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot extract axis slice - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    int width, height;
+    const int size[3] = { m_cpuVolume.Width(), m_cpuVolume.Height(), m_cpuVolume.Depth() };
+    if (!AxisSliceSize(m_cpuVolume, axis, lod, width, height) || index < 0 || index >= size[axis]) {
+        char buffer[256];
+        sprintf_s(buffer, "Cannot extract axis slice - axis %d, index %d, lod %d out of range", axis, index, lod);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    m_sliceCache.Get(m_cpuVolume, axis, index, lod, out);
+    return true;
+}
+
+bool VolumeRenderer::ProjectSlab(const float* origin, const float* u, const float* v, const float* w, int thickness,
+    int width, int height, int interpolation, int mode, unsigned char* out) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot project slab - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    // Same half-voxel shift as ExtractSlice
+    const float centred[3] = { origin[0] - 0.5f, origin[1] - 0.5f, origin[2] - 0.5f };
+    ::ProjectSlab(m_cpuVolume, centred, u, v, w, thickness, width, height, interpolation, mode, out);
+    return true;
+}
+
+bool VolumeRenderer::ProjectAxisSlab(int axis, int first, int thickness, int mode, unsigned char* out) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot project axis slab - no volume loaded", LOG_ERROR);
+        return false;
+    }
+
+    const int size[3] = { m_cpuVolume.Width(), m_cpuVolume.Height(), m_cpuVolume.Depth() };
+    if (axis < 0 || axis > 2 || first < 0 || thickness < 1 || first + thickness > size[axis]) {
+        char buffer[256];
+        sprintf_s(buffer, "Cannot project axis slab - axis %d, slices %d to %d out of range", axis, first, first + thickness - 1);
+        Log(buffer, LOG_ERROR);
+        return false;
+    }
+
+    m_slabWindow.Render(m_cpuVolume, axis, first, thickness, mode, out);
+    return true;
+}
+
+int VolumeRenderer::BenchmarkReprojection(int width, int height, int frames, float degreesPerFrame, double* results) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot benchmark reprojection - no volume loaded", LOG_ERROR);
+        return 0;
+    }
+
+    UpdateTransferFunction();
+    CpuRenderParams params = GetCpuRenderParams();
+    CpuCamera camera = GetCpuCamera();
+
+    // Orbit about the focus point like RotateCamera, starting from the
+    // current view; frame 0 only primes the cache
+    size_t pixelBytes = static_cast<size_t>(width) * height * 4;
+    std::vector<unsigned char> reference(pixelBytes);
+    std::vector<unsigned char> image(pixelBytes);
+    ReprojectionCache cache;
+    double fullMs = 0.0, reusedMs = 0.0, castFraction = 0.0, rmse = 0.0;
+    for (int frame = 0; frame <= frames; frame++) {
+        float theta = m_cameraTheta + XMConvertToRadians(degreesPerFrame) * frame;
+        float cosPhi = cos(m_cameraPhi);
+        camera.position[0] = m_focusPoint.x + m_cameraRadius * cosPhi * sin(theta);
+        camera.position[1] = m_focusPoint.y + m_cameraRadius * sin(m_cameraPhi);
+        camera.position[2] = m_focusPoint.z + m_cameraRadius * cosPhi * cos(theta);
+
+        auto start = std::chrono::steady_clock::now();
+        CpuRayCaster::Render(m_cpuVolume, &m_cpuLabels, params, camera, width, height, reference.data());
+        auto middle = std::chrono::steady_clock::now();
+        int cast = cache.Render(m_cpuVolume, &m_cpuLabels, params, camera, width, height, image.data());
+        auto end = std::chrono::steady_clock::now();
+        if (frame == 0) {
+            continue;
+        }
+
+        fullMs += std::chrono::duration<double, std::milli>(middle - start).count();
+        reusedMs += std::chrono::duration<double, std::milli>(end - middle).count();
+        castFraction += static_cast<double>(cast) / (static_cast<double>(width) * height);
+        double sum = 0.0;
+        for (size_t i = 0; i < pixelBytes; i++) {
+            double d = static_cast<double>(image[i]) - reference[i];
+            sum += d * d;
+        }
+        rmse += sqrt(sum / pixelBytes);
+    }
+
+    results[0] = fullMs / frames;
+    results[1] = reusedMs / frames;
+    results[2] = castFraction / frames;
+    results[3] = rmse / frames;
+
+    char buffer[256];
+    sprintf_s(buffer, "Reprojection over %d frames of %.1f degrees: %.2f ms full, %.2f ms reused (%.1f%% of rays cast), RMSE %.2f",
+        frames, degreesPerFrame, results[0], results[1], results[2] * 100.0, results[3]);
+    Log(buffer, LOG_INFO);
+    return 4;
+}
+
+int VolumeRenderer::BenchmarkRenderKernels(int width, int height, double* msPerFrame, int capacity) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot benchmark render kernels - no volume loaded", LOG_ERROR);
+        return 0;
+    }
+
+    UpdateTransferFunction();
+    int count = CpuRayCaster::Benchmark(m_cpuVolume, &m_cpuLabels, GetCpuRenderParams(), GetCpuCamera(),
+        width, height, msPerFrame, capacity);
+
+    char buffer[256];
+    const char* modeNames[RENDER_MODE_COUNT] = { "volume", "MIP", "isosurface", "MinIP", "average" };
+    const char* variantNames[KERNEL_VARIANT_COUNT] = { "", " pre-integrated", " shaded", " pre-integrated shaded",
+        " 2D", " 2D shaded" };
+    for (int i = 0; i < count; i++) {
+        int mode, variant, filter;
+        bool showLabels;
+        CpuRayCaster::DescribeKernel(i, &mode, &variant, &showLabels, &filter);
+        if (msPerFrame[i] < 0.0) {
+            continue;
+        }
+        sprintf_s(buffer, "Kernel %s%s/%s/%s: %.2f ms per %dx%d frame", modeNames[mode], variantNames[variant],
+            showLabels ? "labels" : "no labels", filter == FILTER_NEAREST ? "nearest" : "linear",
+            msPerFrame[i], width, height);
+        Log(buffer, LOG_INFO);
+    }
+    return count;
+}
+
+int VolumeRenderer::ValidatePreIntegration(int width, int height, double* rmse) {
+    if (m_cpuVolume.IsEmpty()) {
+        Log("Cannot validate pre-integration - no volume loaded", LOG_ERROR);
+        return 0;
+    }
+
+    UpdateTransferFunction();
+    CpuRenderParams params = GetCpuRenderParams();
+    CpuCamera camera = GetCpuCamera();
+    params.renderMode = RENDER_MODE_VOLUME;
+
+    // Reference: point samples at an eighth of the base step
+    size_t pixelBytes = static_cast<size_t>(width) * height * 4;
+    std::vector<unsigned char> reference(pixelBytes);
+    std::vector<unsigned char> image(pixelBytes);
+    params.stepSize = BASE_STEP_SIZE / 8.0f;
+    params.maxSteps = BASE_MAX_STEPS * 8;
+    params.preIntegrated = nullptr;
+    CpuRayCaster::Render(m_cpuVolume, &m_cpuLabels, params, camera, width, height, reference.data());
+
+    auto imageError = [&]() {
+        double sum = 0.0;
+        for (size_t i = 0; i < pixelBytes; i++) {
+            double d = static_cast<double>(image[i]) - reference[i];
+            sum += d * d;
+        }
+        return sqrt(sum / pixelBytes);
+    };
+
+    char buffer[256];
+    std::vector<float> table;
+    const float stepScales[3] = { 1.0f, 2.0f, 4.0f };
+    for (int i = 0; i < 3; i++) {
+        params.stepSize = BASE_STEP_SIZE * stepScales[i];
+        params.maxSteps = static_cast<int>(BASE_MAX_STEPS / stepScales[i] + 0.5f);
+
+        params.preIntegrated = nullptr;
+        CpuRayCaster::Render(m_cpuVolume, &m_cpuLabels, params, camera, width, height, image.data());
+        rmse[i * 2] = imageError();
+
+        m_transferFunction.BuildPreIntegrated(stepScales[i], table);
+        params.preIntegrated = table.data();
+        CpuRayCaster::Render(m_cpuVolume, &m_cpuLabels, params, camera, width, height, image.data());
+        rmse[i * 2 + 1] = imageError();
+
+        sprintf_s(buffer, "Step scale %.0f: RMSE %.2f point-sampled, %.2f pre-integrated",
+            stepScales[i], rmse[i * 2], rmse[i * 2 + 1]);
+        Log(buffer, LOG_INFO);
+    }
+    return 6;
+}
+
+CpuRenderParams VolumeRenderer::GetCpuRenderParams() const {
+    CpuRenderParams params = {};
+    params.renderMode = m_renderMode;
+    params.filter = m_filter;
+    params.showLabels = m_showLabels;
+    params.opacity = m_opacity;
+    params.brightness = m_brightness;
+    params.contrast = m_contrast;
+    params.isoValue = m_isoValue;
+    params.stepSize = BASE_STEP_SIZE * m_stepScale;
+    params.maxSteps = static_cast<int>(BASE_MAX_STEPS / m_stepScale + 0.5f);
+    params.bounds = GetRenderBounds();
+    params.materials = reinterpret_cast<const float*>(m_materials.data());
+    params.transferFunction = m_transferFunction.Table();
+    params.brickFlags = m_brickFlags.empty() ? nullptr : m_brickFlags.data();
+    params.preIntegrated = m_preIntegration && !m_preIntegrated.empty() ? m_preIntegrated.data() : nullptr;
+    params.shading = m_shading;
+    params.gradients = m_cpuGradients.IsEmpty() ? nullptr : &m_cpuGradients;
+    params.transfer2D = m_transfer2D.empty() ? nullptr : m_transfer2D.data();
+    params.clipPlaneCount = m_clipPlaneCount;
+    for (int i = 0; i < m_clipPlaneCount; i++) {
+        for (int c = 0; c < 4; c++) {
+            params.clipPlanes[i][c] = m_clipPlanes[i][c];
+        }
+    }
+    return params;
+}
+
+CpuCamera VolumeRenderer::GetCpuCamera() const {
+    CpuCamera camera = {};
+    camera.position[0] = m_cameraPosition.x;
+    camera.position[1] = m_cameraPosition.y;
+    camera.position[2] = m_cameraPosition.z;
+    camera.target[0] = m_focusPoint.x;
+    camera.target[1] = m_focusPoint.y;
+    camera.target[2] = m_focusPoint.z;
+    camera.up[0] = m_upVector.x;
+    camera.up[1] = m_upVector.y;
+    camera.up[2] = m_upVector.z;
+    camera.fovY = XM_PIDIV4;
+    return camera;
+}
+
+ContentBounds VolumeRenderer::GetUnclippedBounds() const {
+    if (m_hasLabelBounds) {
+        return UnionBounds(m_volumeBounds, m_labelBounds);
+    }
+    return m_volumeBounds;
+}
+
+ContentBounds VolumeRenderer::GetRenderBounds() const {
+    if (m_hasRoi) {
+        return IntersectBounds(GetUnclippedBounds(), m_roi);
+    }
+    return GetUnclippedBounds();
+}
+
+void VolumeRenderer::LogCropSavings(const ContentBounds& bounds) {
+    char buffer[256];
+    double total = static_cast<double>(m_volumeWidth) * m_volumeHeight * m_volumeDepth;
+    if (bounds.IsEmpty() || total <= 0.0) {
+        Log("Content bounds are empty - nothing above the crop threshold", LOG_WARNING);
+        return;
+    }
+
+    double boxFraction = bounds.VoxelCount() / total;
+    sprintf_s(buffer, "Content bounds: x %d-%d, y %d-%d, z %d-%d (%.1f%% of the volume, %.1f%% skipped)",
+        bounds.minX, bounds.maxX, bounds.minY, bounds.maxY, bounds.minZ, bounds.maxZ,
+        100.0 * boxFraction, 100.0 * (1.0 - boxFraction));
+    Log(buffer, LOG_INFO);
+
+    if (bounds.hasCircle) {
+        // Footprint area is capped by the box rectangle it sits in
+        double boxArea = static_cast<double>(bounds.maxX - bounds.minX + 1) * (bounds.maxY - bounds.minY + 1);
+        double circleArea = min(boxArea, XM_PI * bounds.radius * bounds.radius);
+        double circleFraction = boxFraction * circleArea / boxArea;
+        sprintf_s(buffer, "Circular footprint: centre (%.1f, %.1f), radius %.1f (%.1f%% of the volume, %.1f%% skipped)",
+            bounds.centerX, bounds.centerY, bounds.radius,
+            100.0 * circleFraction, 100.0 * (1.0 - circleFraction));
+        Log(buffer, LOG_INFO);
+    }
+}
@@ -8,6 +8,24 @@ extern void Log(const char* message, int severity);
 #include <wrl/client.h>
 #include <vector>
 #include <memory>
+#include "VolumeBounds.h"
+#include "BrickedVolume.h"
+#include "GradientVolume.h"
+#include "TransferFunction.h"
+#include "CpuRayCaster.h"
+#include "DynamicResolution.h"
+#include "ReprojectionCache.h"
+#include "RecolorCache.h"
+#include "FrameBatch.h"
+#include "Reslice.h"
+#include "SlabProjection.h"
+#include "VolumeStatistics.h"
+#include "MaterialStatistics.h"
+#include "ConnectedComponents.h"
+#include "DistanceTransform.h"
+#include "Morphology.h"
+#include "Watershed.h"
+#include "PoreNetwork.h"
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
@@ -18,6 +36,7 @@ public:
     ~VolumeRenderer();
 
     bool Initialize(HWND hwnd, int width, int height);
+    bool InitializeHeadless(int width, int height);
     void Shutdown();
     bool LoadVolumeData(const unsigned char* data, int width, int height, int depth, float voxelSize);
     bool LoadLabelData(const unsigned char* data, int width, int height, int depth);
@@ -34,6 +53,112 @@ public:
     void SetContrast(float contrast);
     void SetRenderMode(int mode);
     void SetShowLabels(bool show);
+    void SetSampleFilter(int filter);
+    void SetIsoValue(float isoValue);
+
+    // Replaces the brightness/contrast window with a lookup table; null reverts
+    bool SetTransferFunction(const float* rgba, int entries);
+
+    // 2D transfer function over density and gradient magnitude; builds the
+    // gradient volume if needed. Null reverts to the 1D table.
+    bool SetTransferFunction2D(const float* rgba, int densityEntries, int magnitudeEntries);
+    int GetJointHistogram(unsigned int* counts, int capacity);
+
+    // Density histograms and summaries counted while the volume loaded
+    int GetHistogram(unsigned long long* counts, int capacity) const;
+    int GetSliceHistograms(unsigned int* counts, int capacity) const;
+    int GetVolumeStatistics(double* values, int capacity) const;
+
+    // Per-label statistics over the CPU volume and labels, 15 values per label
+    int GetMaterialStatistics(double* values, int capacity);
+
+    // Connected components of one material of the CPU labels; the sizes and
+    // bounds of the last labelling stay available until the next one
+    int LabelComponents(int material, int connectivity, unsigned int* ids);
+    int GetComponentInfo(long long* values, int capacity) const;
+
+    // Euclidean distance map of one material of the CPU labels; spacing
+    // defaults to the isotropic voxel size
+    bool DistanceTransform(int material, const float* spacing, bool squared, void* out);
+
+    // Morphology of one material of the CPU labels: removed voxels take
+    // replacement, added voxels take material. out receives the labels, or
+    // with a null out they replace the loaded labels.
+    bool ApplyMorphology(int material, int operation, int element, int radius, int replacement, unsigned char* out);
+
+    // Watershed grain separation of one material of the CPU labels; the
+    // grains replace the component table and, with display, recolour the
+    // material's voxels until RestoreLabels
+    int SeparateGrains(int material, float h, unsigned int* ids, bool display);
+
+    // Pore network of one material of the CPU labels, kept until the next
+    // extraction; the pores also replace the component table
+    int ExtractPoreNetwork(int material, float h, unsigned int* ids, bool display);
+    int GetPores(double* values, int capacity) const;
+    int GetThroats(double* values, int capacity) const;
+    bool RestoreLabels();
+
+    // Sample distance as a multiple of the base step; pre-integration keeps
+    // quality at larger steps
+    void SetSampling(float stepScale, bool preIntegrated);
+
+    // Precomputed gradients for shading; built at load (or now) when enabled
+    bool SetGradientVolume(bool enable);
+    void SetShading(int flags);
+
+    // Headless check of pre-integration against a fine-step reference;
+    // fills RMSE for step scales 1, 2 and 4 (plain, pre-integrated)
+    int ValidatePreIntegration(int width, int height, double* rmse);
+
+    // Dynamic resolution: both backends ray cast at a scale chosen to meet
+    // the target frame time and upscale to the output size
+    void SetTargetFrameTime(float milliseconds, bool edgeAware);
+
+    // Temporal reuse of CPU frames while the camera moves
+    void SetTemporalReprojection(bool enable);
+    int BenchmarkReprojection(int width, int height, int frames, float degreesPerFrame, double* results);
+
+    // Deep-pixel cache so material edits recomposite CPU frames
+    void SetRecolorCache(bool enable);
+
+    // Per-pixel ray cost of the CPU path, as a heat map and raw counts; the
+    // summary is logged unless log is false
+    void SetCostView(bool enable);
+    bool RenderCostMap(unsigned char* rgba, int* counts, int width, int height, bool log = true);
+
+    // Renders camera poses (10 floats each) on all cores, delivered in order
+    int RenderCameraPath(const float* poses, int count, int width, int height, const FrameSink& deliver);
+
+    // Oblique reslice of the CPU volume (see Reslice.h)
+    bool ExtractSlice(const float* origin, const float* u, const float* v, int width, int height,
+        int interpolation, unsigned char* out);
+
+    // Brick-tiled axis slices through the slice cache
+    bool GetAxisSliceSize(int axis, int lod, int* width, int* height) const;
+    bool ExtractAxisSlice(int axis, int index, int lod, unsigned char* out);
+
+    // Thick-slab MIP/MinIP/mean; axis slabs slide incrementally
+    bool ProjectSlab(const float* origin, const float* u, const float* v, const float* w, int thickness,
+        int width, int height, int interpolation, int mode, unsigned char* out);
+    bool ProjectAxisSlab(int axis, int first, int thickness, int mode, unsigned char* out);
+
+    // Air cropping: rays are restricted to the content bounds found at load
+    void SetAutoCrop(bool enable, int threshold, bool circularMask);
+    bool GetContentBounds(int* bounds) const;
+
+    // Cut-away views: planes and the region of interest shorten every ray
+    int SetClipPlanes(const float* planes, int count);
+    bool SetRegionOfInterest(const int* box);
+
+    // CPU-resident copies of the loaded volumes
+    const BrickedVolume& GetCpuVolume() const { return m_cpuVolume; }
+    const BrickedVolume& GetCpuLabels() const { return m_cpuLabels; }
+    bool BenchmarkVolumeLayout(double* samplesPerSecond);
+
+    // CPU ray caster using the current camera and rendering parameters
+    bool RenderCpu(unsigned char* rgba, int width, int height);
+    void CastCpuFrame(unsigned char* rgba, int width, int height);
+    int BenchmarkRenderKernels(int width, int height, double* msPerFrame, int capacity);
 
 private:
     // DirectX resources
@@ -48,6 +173,7 @@ private:
     ComPtr<ID3D11Buffer> m_vertexBuffer;
     ComPtr<ID3D11Buffer> m_indexBuffer;
     ComPtr<ID3D11Buffer> m_constantBuffer;
+    ComPtr<ID3D11Buffer> m_renderParamsBuffer;
     ComPtr<ID3D11Buffer> m_materialBuffer;
     ComPtr<ID3D11ShaderResourceView> m_materialSRV;
 
@@ -56,7 +182,35 @@ private:
     ComPtr<ID3D11ShaderResourceView> m_volumeSRV;
     ComPtr<ID3D11Texture3D> m_labelTexture;
     ComPtr<ID3D11ShaderResourceView> m_labelSRV;
+    ComPtr<ID3D11Texture3D> m_brickRangeTexture;
+    ComPtr<ID3D11ShaderResourceView> m_brickRangeSRV;
+    ComPtr<ID3D11Texture1D> m_transferTexture;
+    ComPtr<ID3D11ShaderResourceView> m_transferSRV;
+    ComPtr<ID3D11Texture3D> m_brickFlagsTexture;
+    ComPtr<ID3D11ShaderResourceView> m_brickFlagsSRV;
+    ComPtr<ID3D11Texture2D> m_preIntegratedTexture;
+    ComPtr<ID3D11ShaderResourceView> m_preIntegratedSRV;
+    ComPtr<ID3D11Texture2D> m_transfer2DTexture;
+    ComPtr<ID3D11ShaderResourceView> m_transfer2DSRV;
+    ComPtr<ID3D11Texture3D> m_gradientTexture;
+    ComPtr<ID3D11ShaderResourceView> m_gradientSRV;
     ComPtr<ID3D11SamplerState> m_volumeSampler;
+    ComPtr<ID3D11SamplerState> m_pointSampler;
+
+    // Dynamic resolution: window-sized target whose top-left corner holds
+    // the scaled frame, the upscale pass and GPU timestamp queries
+    static const int TIMING_FRAMES = 4;
+    ComPtr<ID3D11Texture2D> m_scaledTexture;
+    ComPtr<ID3D11RenderTargetView> m_scaledRTV;
+    ComPtr<ID3D11ShaderResourceView> m_scaledSRV;
+    ComPtr<ID3D11VertexShader> m_upscaleVertexShader;
+    ComPtr<ID3D11PixelShader> m_upscalePixelShader;
+    ComPtr<ID3D11Buffer> m_upscaleParamsBuffer;
+    ComPtr<ID3D11Query> m_timingDisjoint[TIMING_FRAMES];
+    ComPtr<ID3D11Query> m_timingBegin[TIMING_FRAMES];
+    ComPtr<ID3D11Query> m_timingEnd[TIMING_FRAMES];
+    float m_timingScale[TIMING_FRAMES];
+    int m_timingFrame;
 
     // Volume data properties
     int m_volumeWidth;
@@ -82,8 +236,80 @@ private:
     float m_contrast;
     int m_renderMode;
     bool m_showLabels;
+    int m_filter;
+    float m_isoValue;
     std::vector<XMFLOAT4> m_materials;
 
+    // Transfer function and the per-brick flags derived from it
+    TransferFunction m_transferFunction;
+    std::vector<unsigned char> m_brickFlags;
+    bool m_transferDirty;
+    float m_stepScale;
+    bool m_preIntegration;
+    std::vector<float> m_preIntegrated;
+    std::vector<float> m_transfer2D;
+
+    // Gradient volume and the ShadingFlags applied with it
+    bool m_computeGradients;
+    int m_shading;
+
+    // Frame-time controllers per backend and the CPU low-resolution frame
+    ResolutionController m_gpuResolution;
+    ResolutionController m_cpuResolution;
+    bool m_edgeAwareUpscale;
+    std::vector<unsigned char> m_cpuScaled;
+
+    // Previous CPU frame reprojected into the next one
+    bool m_temporalReprojection;
+    ReprojectionCache m_reprojection;
+
+    // Label contributions of the last CPU frame for material edits
+    bool m_recolorCache;
+    RecolorCache m_recolor;
+
+    // RenderCpu draws the cost heat map instead of the volume, logging the
+    // summary of the first frame after the view is switched on
+    bool m_costView;
+    bool m_costViewLogged;
+
+    // Recent axis slices, dropped on the next volume load
+    SliceCache m_sliceCache;
+
+    // Last ProjectAxisSlab result, updated when the slab moves by one slice
+    SlabWindow m_slabWindow;
+
+    // Histograms and statistics counted by the last volume load
+    VolumeStatistics m_volumeStatistics;
+
+    // Labels as loaded while a grain or pore display has recoloured them;
+    // the analysis kernels run on these
+    BrickedVolume m_grainBaseLabels;
+
+    // Components, grains or pores of the last analysis, for GetComponentInfo
+    std::vector<ComponentInfo> m_components;
+
+    // Last extracted pore network
+    std::vector<PoreInfo> m_pores;
+    std::vector<ThroatInfo> m_throats;
+
+    // Content bounds (auto air cropping)
+    bool m_autoCrop;
+    int m_cropThreshold;
+    bool m_cropCircle;
+    ContentBounds m_volumeBounds;
+    ContentBounds m_labelBounds;
+    bool m_hasLabelBounds;
+
+    // Clip planes (voxel space) and region of interest
+    float m_clipPlanes[MAX_CLIP_PLANES][4];
+    int m_clipPlaneCount;
+    bool m_hasRoi;
+    ContentBounds m_roi;
+
+    // CPU copies in bricked layout for sampling and analysis kernels
+    BrickedVolume m_cpuVolume;
+    BrickedVolume m_cpuLabels;
+    GradientVolume m_cpuGradients;
 
     // Helper methods
     bool CreateDeviceAndSwapChain(HWND hwnd);
@@ -92,9 +318,33 @@ private:
     bool CreateShaders();
     bool CreateConstantBuffers();
     bool CreateSamplers();
+    bool CreateUpscaleResources();
+    bool CreateScaledTarget();
+    void ReadFrameTiming(int slot);
+    void UpscaleToBackBuffer(int scaledWidth, int scaledHeight);
     bool CreateVolumeTexture(const unsigned char* data = nullptr);
     bool CreateLabelTexture(const unsigned char* data = nullptr);
+    bool CreateBrickRangeTexture();
+    bool BuildGradientVolume(const unsigned char* data);
+    // Gradients from the resident volume on demand, without touching the
+    // shading flag, and their release once neither shading nor a 2D table
+    // asks for them
+    bool EnsureGradientVolume();
+    bool LoadLabels(const unsigned char* data, int width, int height, int depth);
+    bool DisplayGrains(const unsigned int* ids);
+    const BrickedVolume& AnalysisLabels() const { return m_grainBaseLabels.IsEmpty() ? m_cpuLabels : m_grainBaseLabels; }
+    void ReleaseGradientVolume();
+    void UpdateTransferFunction();
+    bool UploadTransferFunction();
+    bool UploadTable2D(const std::vector<float>& table, ComPtr<ID3D11Texture2D>& texture,
+        ComPtr<ID3D11ShaderResourceView>& srv, const char* name);
     void SetupViewport(int width, int height);
     void UpdateConstantBuffers();
+    // Volume and label content box, and that box clipped to the region of interest
+    ContentBounds GetUnclippedBounds() const;
+    ContentBounds GetRenderBounds() const;
+    void LogCropSavings(const ContentBounds& bounds);
+    CpuRenderParams GetCpuRenderParams() const;
+    CpuCamera GetCpuCamera() const;
 };
 
@@ -0,0 +1,122 @@
+// VolumeStatistics.cpp
+#include "pch.h"
+#include "VolumeStatistics.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <emmintrin.h>
+
+namespace
+{
+    template <typename Count>
+    VolumeStatistics::Summary Summarize(const Count* bins)
+    {
+        VolumeStatistics::Summary summary = {};
+        double sum = 0.0, sumSquares = 0.0;
+        int lowest = -1, highest = -1;
+        for (int v = 0; v < VolumeStatistics::BINS; v++) {
+            if (bins[v] == 0) {
+                continue;
+            }
+            if (lowest < 0) {
+                lowest = v;
+            }
+            highest = v;
+            summary.count += bins[v];
+            sum += static_cast<double>(bins[v]) * v;
+            sumSquares += static_cast<double>(bins[v]) * v * v;
+        }
+
+        if (summary.count > 0) {
+            double n = static_cast<double>(summary.count);
+            summary.minValue = static_cast<unsigned char>(lowest);
+            summary.maxValue = static_cast<unsigned char>(highest);
+            summary.mean = sum / n;
+            summary.stddev = sqrt(max(0.0, sumSquares / n - summary.mean * summary.mean));
+        }
+        return summary;
+    }
+}
+
+VolumeStatistics::VolumeStatistics()
+    : m_depth(0), m_global()
+{
+}
+
+void VolumeStatistics::Clear()
+{
+    m_depth = 0;
+    m_partialBins.clear();
+    m_sliceBins.clear();
+    m_bins.clear();
+    m_slices.clear();
+    m_global = Summary();
+}
+
+void VolumeStatistics::Reset(int depth)
+{
+    m_depth = depth;
+    m_partialBins.assign(static_cast<size_t>(depth) * PARTIALS * BINS, 0u);
+    m_sliceBins.assign(static_cast<size_t>(depth) * BINS, 0u);
+    m_bins.assign(BINS, 0ull);
+    m_slices.assign(depth, Summary());
+    m_global = Summary();
+}
+
+void VolumeStatistics::CountRow(int z, const unsigned char* row, int count)
+{
+    unsigned int* bins = m_partialBins.data() + static_cast<size_t>(z) * PARTIALS * BINS;
+
+    // Neighbouring voxels usually share a value, so consecutive increments
+    // of one bin would wait on each other; voxels go to four interleaved
+    // copies of the bins instead, and a uniform run of 16 (air, padding)
+    // is one compare
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i first = _mm_set1_epi8(static_cast<char>(row[i]));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, first)) == 0xFFFF) {
+            bins[row[i]] += 16;
+            continue;
+        }
+        for (int k = 0; k < 16; k += PARTIALS) {
+            bins[row[i + k]]++;
+            bins[BINS + row[i + k + 1]]++;
+            bins[2 * BINS + row[i + k + 2]]++;
+            bins[3 * BINS + row[i + k + 3]]++;
+        }
+    }
+    for (; i < count; i++) {
+        bins[row[i]]++;
+    }
+}
+
+void VolumeStatistics::Finish()
+{
+    ParallelForRange(0, m_depth, [&](int, int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            const unsigned int* partial = m_partialBins.data() + static_cast<size_t>(z) * PARTIALS * BINS;
+            unsigned int* bins = m_sliceBins.data() + static_cast<size_t>(z) * BINS;
+            for (int v = 0; v < BINS; v++) {
+                bins[v] = partial[v] + partial[BINS + v] + partial[2 * BINS + v] + partial[3 * BINS + v];
+            }
+        }
+    });
+    std::vector<unsigned int>().swap(m_partialBins);
+
+    ParallelForRange(0, BINS, [&](int, int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            unsigned long long total = 0;
+            for (int z = 0; z < m_depth; z++) {
+                total += m_sliceBins[static_cast<size_t>(z) * BINS + v];
+            }
+            m_bins[v] = total;
+        }
+    });
+
+    ParallelForRange(0, m_depth, [&](int, int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            m_slices[z] = Summarize(SliceHistogram(z));
+        }
+    });
+    m_global = Summarize(m_bins.data());
+}
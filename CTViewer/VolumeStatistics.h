@@ -0,0 +1,55 @@
+// VolumeStatistics.h
+#pragma once
+
+#include <vector>
+
+// Global and per-slice density histograms of an 8-bit volume, with the
+// minimum, maximum, mean and standard deviation derived exactly from the
+// bins. BrickedVolume::Build counts each row as it copies it, so loading
+// reads the data once. Every slice has its own bins, filled by the one
+// thread that copies it, and Finish merges them into the global histogram.
+class VolumeStatistics
+{
+public:
+    static const int BINS = 256;
+
+    struct Summary
+    {
+        unsigned long long count;
+        unsigned char minValue;
+        unsigned char maxValue;
+        double mean;
+        double stddev;
+    };
+
+    VolumeStatistics();
+
+    void Clear();
+    bool IsEmpty() const { return m_depth == 0; }
+    int Depth() const { return m_depth; }
+
+    // Zeroes the bins for a volume of depth slices
+    void Reset(int depth);
+
+    // Counts count voxels of slice z. Rows of one slice must come from one
+    // thread; different slices may be counted concurrently.
+    void CountRow(int z, const unsigned char* row, int count);
+
+    // Merges the slice bins and derives every summary
+    void Finish();
+
+    const unsigned long long* Histogram() const { return m_bins.data(); }
+    const unsigned int* SliceHistogram(int z) const { return m_sliceBins.data() + static_cast<size_t>(z) * BINS; }
+    const Summary& Global() const { return m_global; }
+    const Summary& Slice(int z) const { return m_slices[z]; }
+
+private:
+    static const int PARTIALS = 4;
+
+    int m_depth;
+    std::vector<unsigned int> m_partialBins;
+    std::vector<unsigned int> m_sliceBins;
+    std::vector<unsigned long long> m_bins;
+    std::vector<Summary> m_slices;
+    Summary m_global;
+};
@@ -0,0 +1,484 @@
+// Watershed.cpp
+#include "pch.h"
+#include "Watershed.h"
+#include "DistanceTransform.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Distances are quantised to 1/16 voxel for the hierarchical queue
+    const float LEVEL_SCALE = 16.0f;
+    const int LEVELS = 65536;
+
+    // Slices flooded together; fixed so the grains do not depend on the
+    // number of workers
+    const int SLAB_DEPTH = 32;
+
+    const unsigned int UNPROCESSED = UINT_MAX;
+
+    // Two basins that touch, and the highest level at which they do
+    struct Edge
+    {
+        unsigned int a;
+        unsigned int b;
+        unsigned short saddle;
+    };
+
+    struct Slab
+    {
+        int zBegin;
+        int zEnd;
+        std::vector<Edge> edges;
+        std::vector<ComponentInfo> basins;
+        std::vector<unsigned short> peaks;
+    };
+
+    // Hierarchical queue storage, one per worker and reused across the
+    // slabs it floods
+    struct FloodQueue
+    {
+        std::vector<unsigned int> start;
+        std::vector<unsigned int> order;
+        std::vector<unsigned int> front;
+        std::vector<unsigned int> next;
+        std::vector<unsigned int> choice;
+    };
+
+    // Parents always have smaller indices than their children
+    unsigned int Find(unsigned int* parent, unsigned int x)
+    {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    // Orders edges by basin pair with the highest saddle first, so unique
+    // keeps one edge per pair
+    bool ByPair(const Edge& l, const Edge& r)
+    {
+        if (l.a != r.a) {
+            return l.a < r.a;
+        }
+        if (l.b != r.b) {
+            return l.b < r.b;
+        }
+        return l.saddle > r.saddle;
+    }
+
+    bool SamePair(const Edge& l, const Edge& r)
+    {
+        return l.a == r.a && l.b == r.b;
+    }
+
+    void Normalize(std::vector<Edge>& edges)
+    {
+        for (Edge& e : edges) {
+            if (e.a > e.b) {
+                std::swap(e.a, e.b);
+            }
+        }
+        std::sort(edges.begin(), edges.end(), ByPair);
+        edges.erase(std::unique(edges.begin(), edges.end(), SamePair), edges.end());
+    }
+
+    const unsigned int QUEUED = UINT_MAX - 1;
+
+    int Neighbours(unsigned int idx, int width, int height, int depth, size_t sliceSize, unsigned int* out)
+    {
+        const int x = static_cast<int>(idx % width);
+        const int y = static_cast<int>((idx / width) % height);
+        const int z = static_cast<int>(idx / sliceSize);
+        int count = 0;
+        if (x > 0) out[count++] = idx - 1;
+        if (x + 1 < width) out[count++] = idx + 1;
+        if (y > 0) out[count++] = idx - width;
+        if (y + 1 < height) out[count++] = idx + width;
+        if (z > 0) out[count++] = static_cast<unsigned int>(idx - sliceSize);
+        if (z + 1 < depth) out[count++] = static_cast<unsigned int>(idx + sliceSize);
+        return count;
+    }
+
+    // Joins idx to the basin of u, keeping the smaller index as the root
+    void Attach(unsigned int* ids, unsigned int idx, unsigned int u)
+    {
+        unsigned int ru = Find(ids, u);
+        if (idx < ru) {
+            ids[ru] = idx;
+            ids[idx] = idx;
+        }
+        else {
+            ids[idx] = ru;
+        }
+    }
+
+    // Floods one slab in decreasing level order. Each level grows out of
+    // the voxels already flooded one breadth-first layer at a time, a voxel
+    // taking the basin of its highest flooded 6-neighbour from an earlier
+    // layer, so plateaus and ridges go to the geodesically nearest basin.
+    // Exact ties alternate with voxel parity rather than favouring lower
+    // coordinates. Voxels the level cannot reach start a basin per
+    // connected plateau. ids then hold slab-local basin numbers, in order
+    // of each basin's first voxel, and every contact between two basins is
+    // recorded as an edge.
+    void FloodSlab(const unsigned short* levels, unsigned int* ids, int width, int height, int depth, Slab& slab,
+        FloodQueue& queue)
+    {
+        const size_t sliceSize = static_cast<size_t>(width) * height;
+        const unsigned int n = static_cast<unsigned int>(sliceSize * depth);
+        std::fill(ids, ids + n, UNPROCESSED);
+
+        // Hierarchical queue as a counting sort, highest level first and
+        // scan order within a level
+        std::vector<unsigned int>& start = queue.start;
+        start.assign(LEVELS, 0);
+        for (unsigned int i = 0; i < n; i++) {
+            start[levels[i]]++;
+        }
+        unsigned int material = 0;
+        for (int l = LEVELS - 1; l > 0; l--) {
+            unsigned int count = start[l];
+            start[l] = material;
+            material += count;
+        }
+        std::vector<unsigned int>& order = queue.order;
+        order.resize(material);
+        for (unsigned int i = 0; i < n; i++) {
+            if (levels[i] != 0) {
+                order[start[levels[i]]++] = i;
+            }
+        }
+
+        std::vector<unsigned int>& front = queue.front;
+        std::vector<unsigned int>& next = queue.next;
+        std::vector<unsigned int>& choice = queue.choice;
+        unsigned int neighbours[6];
+        unsigned int begin = 0;
+        for (int l = LEVELS - 1; l > 0; l--) {
+            const unsigned int end = start[l];
+            if (begin == end) {
+                continue;
+            }
+            const unsigned short level = static_cast<unsigned short>(l);
+
+            // First layer: voxels touching a higher level
+            front.clear();
+            for (unsigned int i = begin; i < end; i++) {
+                const unsigned int idx = order[i];
+                const int count = Neighbours(idx, width, height, depth, sliceSize, neighbours);
+                for (int k = 0; k < count; k++) {
+                    if (ids[neighbours[k]] < QUEUED) {
+                        ids[idx] = QUEUED;
+                        front.push_back(idx);
+                        break;
+                    }
+                }
+            }
+
+            while (!front.empty()) {
+                // Every voxel of a layer picks from the earlier layers before
+                // any of them is attached
+                choice.resize(front.size());
+                for (size_t i = 0; i < front.size(); i++) {
+                    const unsigned int idx = front[i];
+                    const int count = Neighbours(idx, width, height, depth, sliceSize, neighbours);
+                    const unsigned int x = idx % width;
+                    const unsigned int y = (idx / width) % height;
+                    const unsigned int z = static_cast<unsigned int>(idx / sliceSize);
+                    const bool last = ((x + y + z) & 1) != 0;
+                    unsigned int best = UNPROCESSED;
+                    for (int k = 0; k < count; k++) {
+                        const unsigned int u = neighbours[k];
+                        if (ids[u] >= QUEUED) {
+                            continue;
+                        }
+                        if (best == UNPROCESSED || levels[u] > levels[best] || (last && levels[u] == levels[best])) {
+                            best = u;
+                        }
+                    }
+                    choice[i] = best;
+                }
+                for (size_t i = 0; i < front.size(); i++) {
+                    Attach(ids, front[i], choice[i]);
+                }
+
+                next.clear();
+                for (unsigned int idx : front) {
+                    const int count = Neighbours(idx, width, height, depth, sliceSize, neighbours);
+                    for (int k = 0; k < count; k++) {
+                        const unsigned int u = neighbours[k];
+                        if (ids[u] == UNPROCESSED && levels[u] == level) {
+                            ids[u] = QUEUED;
+                            next.push_back(u);
+                        }
+                    }
+                }
+                front.swap(next);
+            }
+
+            // Plateaus the flood did not reach are new basins, rooted at
+            // their first voxel in scan order
+            for (unsigned int i = begin; i < end; i++) {
+                const unsigned int root = order[i];
+                if (ids[root] != UNPROCESSED) {
+                    continue;
+                }
+                ids[root] = root;
+                front.assign(1, root);
+                while (!front.empty()) {
+                    const unsigned int idx = front.back();
+                    front.pop_back();
+                    const int count = Neighbours(idx, width, height, depth, sliceSize, neighbours);
+                    for (int k = 0; k < count; k++) {
+                        const unsigned int u = neighbours[k];
+                        if (ids[u] == UNPROCESSED && levels[u] == level) {
+                            ids[u] = root;
+                            front.push_back(u);
+                        }
+                    }
+                }
+            }
+            begin = end;
+        }
+
+        // Parents precede children, so one ascending pass turns roots into
+        // basin numbers and every other voxel copies its parent's
+        const size_t base = sliceSize * slab.zBegin;
+        for (unsigned int i = 0; i < n; i++) {
+            unsigned int parent = ids[i];
+            if (parent == UNPROCESSED) {
+                continue;
+            }
+            if (parent == i) {
+                ids[i] = static_cast<unsigned int>(slab.basins.size());
+                ComponentInfo empty = { 0, { INT_MAX, INT_MAX, INT_MAX, -1, -1, -1 } };
+                slab.basins.push_back(empty);
+                slab.peaks.push_back(0);
+            }
+            else {
+                ids[i] = ids[parent];
+            }
+
+            const size_t global = base + i;
+            const int coords[3] = { static_cast<int>(i % width), static_cast<int>((i / width) % height),
+                static_cast<int>(global / sliceSize) };
+            ComponentInfo& info = slab.basins[ids[i]];
+            info.size++;
+            for (int c = 0; c < 3; c++) {
+                info.bounds[c] = min(info.bounds[c], coords[c]);
+                info.bounds[c + 3] = max(info.bounds[c + 3], coords[c]);
+            }
+            slab.peaks[ids[i]] = max(slab.peaks[ids[i]], levels[i]);
+        }
+
+        // Basins meet where two 6-neighbours differ, at the lower level
+        for (unsigned int i = 0; i < n; i++) {
+            if (ids[i] == UNPROCESSED) {
+                continue;
+            }
+            const unsigned int x = i % width;
+            const unsigned int y = (i / width) % height;
+            const unsigned int z = static_cast<unsigned int>(i / sliceSize);
+            const unsigned int forward[3] = { x + 1 < static_cast<unsigned int>(width) ? i + 1 : UNPROCESSED,
+                y + 1 < static_cast<unsigned int>(height) ? i + width : UNPROCESSED,
+                z + 1 < static_cast<unsigned int>(depth) ? static_cast<unsigned int>(i + sliceSize) : UNPROCESSED };
+            for (unsigned int j : forward) {
+                if (j != UNPROCESSED && ids[j] != UNPROCESSED && ids[j] != ids[i]) {
+                    slab.edges.push_back({ ids[i], ids[j], min(levels[i], levels[j]) });
+                }
+            }
+        }
+        Normalize(slab.edges);
+    }
+}
+
+int SeparateGrains(const BrickedVolume& labels, unsigned char material, float h, unsigned int* ids,
+    std::vector<ComponentInfo>& grains, std::vector<float>* peaks, std::vector<GrainContact>* contacts)
+{
+    grains.clear();
+    if (peaks) {
+        peaks->clear();
+    }
+    if (contacts) {
+        contacts->clear();
+    }
+    if (labels.IsEmpty()) {
+        return 0;
+    }
+
+    const int width = labels.Width(), height = labels.Height(), depth = labels.Depth();
+    const size_t sliceSize = static_cast<size_t>(width) * height;
+
+    // Distance map, quantised; 0 marks voxels outside the material
+    const float spacing[3] = { 1.0f, 1.0f, 1.0f };
+    DistanceTransform(labels, material, spacing, false, ids);
+    std::vector<unsigned short> levels(sliceSize * depth);
+    ParallelForEach(0, depth, [&](int, int z) {
+        const float* distance = reinterpret_cast<const float*>(ids) + sliceSize * z;
+        unsigned short* level = levels.data() + sliceSize * z;
+        for (size_t i = 0; i < sliceSize; i++) {
+            float d = distance[i] * LEVEL_SCALE + 0.5f;
+            level[i] = static_cast<unsigned short>(distance[i] <= 0.0f ? 0 : d >= LEVELS - 1 ? LEVELS - 1 : max(1.0f, d));
+        }
+    });
+
+    // Local indices of a slab must fit in 32 bits
+    const int slabDepth = static_cast<int>(min(static_cast<size_t>(SLAB_DEPTH), max(static_cast<size_t>(1), (UNPROCESSED - 1) / sliceSize)));
+    std::vector<Slab> slabs((depth + slabDepth - 1) / slabDepth);
+    for (size_t t = 0; t < slabs.size(); t++) {
+        slabs[t].zBegin = static_cast<int>(t) * slabDepth;
+        slabs[t].zEnd = min(depth, slabs[t].zBegin + slabDepth);
+    }
+    std::vector<FloodQueue> queues(GetWorkerCount());
+    ParallelForEach(0, static_cast<int>(slabs.size()), [&](int thread, int t) {
+        Slab& slab = slabs[t];
+        const size_t base = sliceSize * slab.zBegin;
+        FloodSlab(levels.data() + base, ids + base, width, height, slab.zEnd - slab.zBegin, slab, queues[thread]);
+    });
+    std::vector<FloodQueue>().swap(queues);
+
+    std::vector<size_t> offsets(slabs.size() + 1, 0);
+    for (size_t t = 0; t < slabs.size(); t++) {
+        offsets[t + 1] = offsets[t] + slabs[t].basins.size();
+    }
+    const size_t basinCount = offsets.back();
+    if (basinCount >= UINT_MAX) {
+        throw std::runtime_error("Too many watershed basins");
+    }
+
+    // Edges in global basin numbers, plus those across each slab's first slice
+    std::vector<std::vector<Edge>> borders(slabs.size());
+    ParallelForEach(0, static_cast<int>(slabs.size()), [&](int, int t) {
+        for (Edge& e : slabs[t].edges) {
+            e.a += static_cast<unsigned int>(offsets[t]);
+            e.b += static_cast<unsigned int>(offsets[t]);
+        }
+        if (t == 0) {
+            return;
+        }
+        const size_t above = sliceSize * slabs[t].zBegin;
+        const size_t below = above - sliceSize;
+        for (size_t i = 0; i < sliceSize; i++) {
+            if (levels[below + i] != 0 && levels[above + i] != 0) {
+                borders[t].push_back({ static_cast<unsigned int>(offsets[t - 1] + ids[below + i]),
+                    static_cast<unsigned int>(offsets[t] + ids[above + i]), min(levels[below + i], levels[above + i]) });
+            }
+        }
+        Normalize(borders[t]);
+    });
+
+    std::vector<Edge> edges;
+    for (size_t t = 0; t < slabs.size(); t++) {
+        edges.insert(edges.end(), slabs[t].edges.begin(), slabs[t].edges.end());
+        edges.insert(edges.end(), borders[t].begin(), borders[t].end());
+        std::vector<Edge>().swap(slabs[t].edges);
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& l, const Edge& r) {
+        return l.saddle != r.saddle ? l.saddle > r.saddle : ByPair(l, r);
+    });
+
+    // Merge basins from the highest saddle down; the root keeps the peak
+    std::vector<unsigned int> parent(basinCount);
+    std::vector<unsigned short> peak(basinCount);
+    for (size_t t = 0; t < slabs.size(); t++) {
+        for (size_t b = 0; b < slabs[t].peaks.size(); b++) {
+            parent[offsets[t] + b] = static_cast<unsigned int>(offsets[t] + b);
+            peak[offsets[t] + b] = slabs[t].peaks[b];
+        }
+    }
+    const int depthLevels = max(1, static_cast<int>(h * LEVEL_SCALE + 0.5f));
+    auto findBasin = [&](unsigned int x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+    for (const Edge& e : edges) {
+        unsigned int ra = findBasin(e.a), rb = findBasin(e.b);
+        if (ra == rb) {
+            continue;
+        }
+        bool aLower = peak[ra] < peak[rb] || (peak[ra] == peak[rb] && ra > rb);
+        unsigned int lower = aLower ? ra : rb;
+        unsigned int higher = aLower ? rb : ra;
+        if (peak[lower] - e.saddle < depthLevels) {
+            parent[lower] = higher;
+        }
+    }
+
+    // Grains numbered by their first basin, which is also their first voxel
+    std::vector<unsigned int> grainOf(basinCount, 0);
+    unsigned int count = 0;
+    for (size_t b = 0; b < basinCount; b++) {
+        unsigned int root = findBasin(static_cast<unsigned int>(b));
+        if (grainOf[root] == 0) {
+            grainOf[root] = ++count;
+        }
+        grainOf[b] = grainOf[root];
+    }
+
+    ComponentInfo empty = { 0, { INT_MAX, INT_MAX, INT_MAX, -1, -1, -1 } };
+    grains.assign(count, empty);
+    for (size_t t = 0; t < slabs.size(); t++) {
+        for (size_t b = 0; b < slabs[t].basins.size(); b++) {
+            ComponentInfo& grain = grains[grainOf[offsets[t] + b] - 1];
+            const ComponentInfo& basin = slabs[t].basins[b];
+            grain.size += basin.size;
+            for (int c = 0; c < 3; c++) {
+                grain.bounds[c] = min(grain.bounds[c], basin.bounds[c]);
+                grain.bounds[c + 3] = max(grain.bounds[c + 3], basin.bounds[c + 3]);
+            }
+        }
+    }
+
+    if (peaks) {
+        peaks->assign(count, 0.0f);
+        for (size_t b = 0; b < basinCount; b++) {
+            float& p = (*peaks)[grainOf[b] - 1];
+            p = max(p, peak[b] / LEVEL_SCALE);
+        }
+    }
+    if (contacts) {
+        std::vector<Edge> between;
+        for (const Edge& e : edges) {
+            if (grainOf[e.a] != grainOf[e.b]) {
+                between.push_back({ grainOf[e.a], grainOf[e.b], e.saddle });
+            }
+        }
+        Normalize(between);
+        contacts->resize(between.size());
+        for (size_t i = 0; i < between.size(); i++) {
+            (*contacts)[i] = { between[i].a, between[i].b, between[i].saddle / LEVEL_SCALE };
+        }
+    }
+
+    ParallelForEach(0, static_cast<int>(slabs.size()), [&](int, int t) {
+        const unsigned int* map = grainOf.data() + offsets[t];
+        unsigned int* slab = ids + sliceSize * slabs[t].zBegin;
+        const size_t n = sliceSize * (slabs[t].zEnd - slabs[t].zBegin);
+        for (size_t i = 0; i < n; i++) {
+            slab[i] = slab[i] == UNPROCESSED ? 0 : map[slab[i]];
+        }
+    });
+    return static_cast<int>(count);
+}
+
+void GrainsToLabels(const unsigned int* ids, size_t count, unsigned char* labels)
+{
+    const size_t CHUNK = 1 << 20;
+    int chunks = static_cast<int>((count + CHUNK - 1) / CHUNK);
+    ParallelForEach(0, chunks, [&](int, int c) {
+        size_t end = min(count, (c + 1) * CHUNK);
+        for (size_t i = c * CHUNK; i < end; i++) {
+            if (ids[i] != 0) {
+                labels[i] = static_cast<unsigned char>(1 + (ids[i] - 1) % 255);
+            }
+        }
+    });
+}
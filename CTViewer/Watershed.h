@@ -0,0 +1,47 @@
+// Watershed.h
+#pragma once
+
+#include "BrickedVolume.h"
+#include "ConnectedComponents.h"
+#include <vector>
+
+// Two touching grains, ids first < second, and the largest distance to the
+// other material along their shared boundary: the radius of the widest
+// sphere that passes from one to the other
+struct GrainContact
+{
+    unsigned int first;
+    unsigned int second;
+    float radius;
+};
+
+// Splits the voxels labelled material into grains with a marker-controlled
+// watershed of their Euclidean distance map. ids receives one 32-bit grain
+// id per voxel in z-major order, 0 outside the material and 1 to N inside,
+// numbered in order of each grain's first voxel; grains[id - 1] holds its
+// size and bounds.
+//
+// The markers are the h-maxima of the distance map (h in voxels): two maxima
+// stay separate grains only if the distance between them dips by at least h
+// below the lower one. Slabs of slices are flooded in parallel in decreasing
+// distance order, through a hierarchical queue of distances quantised to
+// 1/16 voxel: each level spreads breadth-first from the basins already
+// flooded, so plateau and ridge voxels join the nearest one, every unreached
+// local maximum starts a basin and each meeting of two basins is recorded
+// with its level. The basin graph, including the edges across slab borders,
+// is then merged in decreasing saddle order, a basin whose peak rises less
+// than h above the saddle joining its neighbour, which gives the same grains
+// as flooding from the markers. ids doubles as the distance buffer. Scratch
+// is two bytes per voxel for the quantised distances, plus per worker a
+// flood queue of up to sixteen bytes per material voxel of one slab and
+// 256 KB of level counts, kept from slab to slab. Optionally also returns each
+// grain's largest distance (its inscribed radius, in voxels) and the
+// touching grain pairs sorted by id, both read off the merged basin graph.
+// Returns N.
+int SeparateGrains(const BrickedVolume& labels, unsigned char material, float h, unsigned int* ids,
+    std::vector<ComponentInfo>& grains, std::vector<float>* peaks = nullptr,
+    std::vector<GrainContact>* contacts = nullptr);
+
+// Grain ids folded into 8-bit labels 1 to 255 for display; voxels outside
+// the grains (id 0) keep their label
+void GrainsToLabels(const unsigned int* ids, size_t count, unsigned char* labels);